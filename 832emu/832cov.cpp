@@ -0,0 +1,121 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <getopt.h>
+
+#include "debug.h"
+#include "binaryblob.h"
+#include "mapfile.h"
+#include "coverage.h"
+#include "lcov.h"
+
+// Merges the coverage bitmaps written by 832e -V, and reports on them.
+
+
+void usage(const char *name)
+{
+	printf("Usage: %s [options] file...\n",name);
+	printf("Files starting with a coverage bitmap's magic are merged; any others are\n");
+	printf("taken to be the assembly sources of the program, for -l.\n");
+	printf("    -h --help\t  display this message\n");
+	printf("    -o --output\t  write the merged bitmap to the specified file\n");
+	printf("    -m --map\t  read symbols from a map file written by 832l -m or -M, and print\n");
+	printf("\t\t  the coverage of each function\n");
+	printf("    -b --binary\t  read the program image, which -l needs\n");
+	printf("    -l --lcov\t  write an lcov tracefile for the assembly sources to the specified file\n");
+}
+
+
+int main(int argc,char **argv)
+{
+	static struct option long_options[] =
+	{
+		{"help",no_argument,NULL,'h'},
+		{"output",required_argument,NULL,'o'},
+		{"map",required_argument,NULL,'m'},
+		{"binary",required_argument,NULL,'b'},
+		{"lcov",required_argument,NULL,'l'},
+		{0, 0, 0, 0}
+	};
+
+	try
+	{
+		Debug.SetLevel(WARN);
+		EightThirtyTwoSymbolMap symbols;
+		const char *outputfile=0;
+		const char *binaryfile=0;
+		const char *lcovfile=0;
+
+		while(1)
+		{
+			int c=getopt_long(argc,argv,"ho:m:b:l:",long_options,NULL);
+			if(c==-1)
+				break;
+			switch(c)
+			{
+				case 'h':
+					usage(argv[0]);
+					return(0);
+				case 'o':
+					outputfile=optarg;
+					break;
+				case 'm':
+					symbols.Load(optarg);
+					break;
+				case 'b':
+					binaryfile=optarg;
+					break;
+				case 'l':
+					lcovfile=optarg;
+					break;
+			}
+		}
+
+		EightThirtyTwoCoverage coverage;
+		std::vector<const char *> sources;
+		int bitmaps=0;
+		for(int i=optind;i<argc;++i)
+		{
+			if(EightThirtyTwoCoverage::IsCoverageFile(argv[i]))
+			{
+				coverage.Load(argv[i]);
+				++bitmaps;
+			}
+			else
+				sources.push_back(argv[i]);
+		}
+		if(!bitmaps)
+		{
+			usage(argv[0]);
+			return(1);
+		}
+		if(!sources.empty() && !lcovfile)
+			throw "Assembly sources are only used with -l";
+
+		if(outputfile)
+			coverage.Save(outputfile);
+		if(!symbols.IsEmpty())
+			coverage.Report(stdout,symbols);
+		if(lcovfile)
+		{
+			if(symbols.IsEmpty() || !binaryfile)
+				throw "The lcov tracefile needs a map file and the program image - use -m and -b";
+			BinaryBlob image(binaryfile);
+			EightThirtyTwoLCOV lcov(symbols,coverage,image.GetPointer(),image.GetSize());
+			for(unsigned int i=0;i<sources.size();++i)
+				lcov.AddSource(sources[i]);
+			lcov.Write(lcovfile);
+		}
+	}
+	catch(const char *err)
+	{
+		std::cerr << "Error: " << err << std::endl;
+		return(1);
+	}
+	return(0);
+}
+
@@ -1,387 +1,43 @@
 #include <iostream>
 #include <string>
-#include <sstream>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <climits>
+#include <cstring>
 
 #include <getopt.h>
 
 #include "binaryblob.h"
 #include "debug.h"
+#include "emulator.h"
+#include "gdbstub.h"
+#include "peripherals.h"
 
-#include "832opcodes.h"
-
-/* Note: Emulator is not currently useful since I'm using the CPU in little-endian mode and the
-   emulator only supports big-endian mode! */
-
-#define STACKSIZE 1024
-int STACKOFFSET=0;
-
-
-enum e32endian {BIGENDIAN,LITTLEENDIAN};
-enum e32size {WORD,HALFWORD,BYTE};
-
-
-class EightThirtyTwoMemory
-{
-	public:
-	EightThirtyTwoMemory(int ramsize) : uartbusyctr(0), ram(0), ramsize(ramsize), uartin(0)
-	{
-		ram=new unsigned char[ramsize];
-	}
-	virtual ~EightThirtyTwoMemory()
-	{
-		if(ram)
-			delete[] ram;
-	}
-	virtual void SetUARTIn(const char *c)
-	{
-		uartin=c;
-	}
-	virtual int ReadB(unsigned int addr)
-	{
-	}
-	virtual int Read(unsigned int addr,e32endian endian,e32size opsize)
-	{
-		switch(addr)
-		{
-			case 0xffffffc4:
-				Debug[COMMENT] << std::endl << "Reading from SPI_CS" << std::endl;
-				break;
-			case 0xffffffc8:
-				Debug[COMMENT] << std::endl << "Reading from SPI" << std::endl;
-				break;
-			case 0xffffffcc:
-				Debug[COMMENT] << std::endl << "Reading from SPI_PUMP" << std::endl;
-				break;
-			case 0xda8000:
-			case 0xffffff84:
-			case 0xffffffc0:
-				Debug[COMMENT] << std::endl << "Reading from UART" << std::endl;
-				if(uartbusyctr)
-				{
-					--uartbusyctr;
-					return(0);
-				}
-				else
-				{
-					int result=0x100;
-					uartbusyctr=1;	// Make the UART pretend to be busy for the next n cycles
-					if(uartin)
-						result=0x300 | (unsigned char)*uartin++;	// Received byte ready...
-					else
-					{
-						if(std::cin.readsome(inbuf,1))
-							result=0x300 | (inbuf[0]&0xff);
-					}
-
-					if(result==0x300)	// End of string?
-						uartin=0;
-
-					return(result);
-				}
-				break;
-			default:
-				Debug[TRACE] << std::endl << "Reading from RAM " << addr << std::endl;
-				if(endian==BIGENDIAN)
-				{
-					Debug[TRACE] << "(Big endian)" <<std::endl;
-					int r;
-					switch(opsize)
-					{
-						case WORD:
-							r=(*this)[addr]<<24;
-							r|=(*this)[addr+1]<<16;
-							r|=(*this)[addr+2]<<8;
-							r|=(*this)[addr+3];
-							break;
-						case HALFWORD:
-							r|=(*this)[addr]<<8;
-							r|=(*this)[addr+1];
-							break;
-						case BYTE:
-							r=(*this)[addr];
-							break;
-					}
-					return(r);
-				}
-				else
-				{
-					Debug[TRACE] << "(Little endian)" <<std::endl;
-					int r;
-					switch(opsize)
-					{
-						case WORD:
-							r=(*this)[addr+3]<<24;
-							r|=(*this)[addr+2]<<16;
-							r|=(*this)[addr+1]<<8;
-							r|=(*this)[addr];
-							return(r);
-						case HALFWORD:
-							r|=(*this)[addr+1]<<8;
-							r|=(*this)[addr];
-							break;
-						case BYTE:
-							r=(*this)[addr];
-							break;
-					}
-					return(r);
-				}
-		}
-		return(0);
-	}
-	virtual void Write(unsigned int addr,int v,e32endian endian,e32size opsize)
-	{
-		switch(addr)
-		{
-			case 0xda8000:
-				v>>=16;
-			case 0xffffff84:
-			case 0xffffffc0:
-				if(char(v))
-				{
-					Debug[COMMENT] << std::endl << "Writing " << char(v) << " to UART" << std::endl;
-					std::cout << char(v);
-				}
-				else
-				{
-					Debug[COMMENT] << std::endl << "Writing (nul) to UART" << std::endl;
-					std::cout << "(nul)";
-				}
-				break;
-
-			case 0xffffff88:
-				Debug[COMMENT] << std::endl << "Setting UART divisor to " << v << std::endl;
-				break;
-
-			case 0xffffff8C:
-				Debug[COMMENT] << std::endl << "Writing to overlay register: " << v << std::endl;
-				break;
-
-			case 0xffffff90:
-				Debug[COMMENT] << std::endl << "Writing " << v << " to HEX display" << std::endl;
-				break;
-
-			case 0xffffffc4:
-				Debug[COMMENT] << std::endl << "Setting spi_cs line " << (v&1 ? "low" : "high" ) << std::endl;
-				break;
-
-			case 0xffffffc8:
-				Debug[COMMENT] << std::endl << "Writing " << v << " to SPI" << std::endl;
-				break;
-
-			case 0xffffffcc:
-				Debug[COMMENT] << std::endl << "Writing " << v << " to SPI_pump" << std::endl;
-				break;
-
-			case 0xfffffffc:
-				Debug[COMMENT] << std::endl << "Breadcrumb " << std::endl;
-				break;
-
-			default:
-				Debug[TRACE] << std::endl << "Writing " << v << " to RAM " << addr <<std::endl;
-				if(endian==BIGENDIAN)
-				{
-					Debug[TRACE] << "(Big endian)" <<std::endl;
-					switch(opsize)
-					{
-						case WORD:
-							(*this)[addr]=(v>>24)&255;
-							(*this)[addr+1]=(v>>16)&255;
-							(*this)[addr+2]=(v>>8)&255;
-							(*this)[addr+3]=v&255;
-							break;
-						case HALFWORD:
-							(*this)[addr]=(v>>24)&255;
-							(*this)[addr+1]=(v>>16)&255;
-							break;
-						case BYTE:
-							(*this)[addr]=(v>>24)&255;
-							break;
-					}
-				}
-				else
-				{
-					Debug[TRACE] << "(Little endian)" <<std::endl;
-					switch(opsize)
-					{
-						case WORD:
-							(*this)[addr+3]=(v>>24)&255;
-							(*this)[addr+2]=(v>>16)&255;
-							(*this)[addr+1]=(v>>8)&255;
-							(*this)[addr]=v&255;
-							break;
-						case HALFWORD:
-							(*this)[addr+1]=(v>>8)&255;
-							(*this)[addr]=v&255;
-							break;
-						case BYTE:
-							(*this)[addr]=v&255;
-							break;
-					}
-				}
-		}
-	}
-	virtual unsigned char &operator[](const int idx)
-	{
-		return(ram[idx]);
-	}
-	virtual int GetRAMSize()
-	{
-		return(ramsize);
-	}
-	protected:
-	int uartbusyctr;
-	unsigned char *ram;
-	int ramsize;
-	const char *uartin;
-	char inbuf[4];
-};
-
-
-// EightThirtyTwoProgram overlays the program loaded from disk onto a fixed-size memory block.
-// Accesses within the program are sent directly to the binary blob.
-// Accesses beyond the program are passed to the EightThirtyTwoMemory superclass.
-// FIXME - need to support byte accesses to EightThirtyTwoMemory.
+// EightThirtyTwoProgram loads a program from disk into the start of the memory map.
+// The blob is constructed before, and destroyed after, the memory map, whose pages
+// use the file's copy-on-write mapping directly wherever the program fills them.
 
 class EightThirtyTwoProgram : public BinaryBlob, public EightThirtyTwoMemory
 {
 	public:
-	EightThirtyTwoProgram(const char *filename, int ramsize=8*1024*1024) : BinaryBlob(filename), EightThirtyTwoMemory(ramsize), base(0)
+	EightThirtyTwoProgram(const char *filename,const char *memorymap=0) : BinaryBlob(filename), EightThirtyTwoMemory(memorymap)
 	{
+		MapImage(0,GetPointer(),GetSize());
 	}
 	~EightThirtyTwoProgram()
 	{
 	}
-	virtual int Read(unsigned int addr,e32endian endian,e32size opsize)
-	{
-		if(((addr-base)>=0) && ((addr-base)<=(size&~3)))
-		{
-			if(endian==BIGENDIAN)
-			{
-				int r;
-				Debug[TRACE] << "(Read internal memory Big endian)" << std::endl;
-				switch(opsize)
-				{
-					case WORD:
-						r=(*this)[addr]<<24;
-						r|=(*this)[addr+1]<<16;
-						r|=(*this)[addr+2]<<8;
-						r|=(*this)[addr+3];
-						break;
-					case HALFWORD:
-						r|=(*this)[addr]<<8;
-						r|=(*this)[addr+1];
-						break;
-					case BYTE:
-						r=(*this)[addr];
-						break;
-				}
-				return(r);
-			}
-			else
-			{
-				int r;
-				Debug[TRACE] << "(Read internal memory little endian)" << std::endl;
-				switch(opsize)
-				{
-					case WORD:
-						r=(*this)[addr+3]<<24;
-						r|=(*this)[addr+2]<<16;
-						r|=(*this)[addr+1]<<8;
-						r|=(*this)[addr];
-						return(r);
-					case HALFWORD:
-						r|=(*this)[addr+1]<<8;
-						r|=(*this)[addr];
-						break;
-					case BYTE:
-						r=(*this)[addr];
-						break;
-				}
-				return(r);
-			}
-		}
-		return(EightThirtyTwoMemory::Read(addr,endian,opsize));
-	}
-	virtual void Write(unsigned int addr,int v,e32endian endian,e32size opsize)
-	{
-		if(((addr-base)>=0) && ((addr-base)<(size-3)))
-		{
-			if(endian==BIGENDIAN)
-			{
-				Debug[TRACE] << "(Write internal memory Big endian)" << std::endl;
-				switch(opsize)
-				{
-					case WORD:
-						(*this)[addr]=(v>>24)&255;
-						(*this)[addr+1]=(v>>16)&255;
-						(*this)[addr+2]=(v>>8)&255;
-						(*this)[addr+3]=v&255;
-						break;
-					case HALFWORD:
-						(*this)[addr]=(v>>8)&255;
-						(*this)[addr+1]=v&255;
-						break;
-					case BYTE:
-						(*this)[addr]=v&255;
-						break;
-				}
-			}
-			else
-			{
-				Debug[TRACE] << "(Write internal memory little endian)" << std::endl;
-				switch(opsize)
-				{
-					case WORD:
-						(*this)[addr+3]=(v>>24)&255;
-						(*this)[addr+2]=(v>>16)&255;
-						(*this)[addr+1]=(v>>8)&255;
-						(*this)[addr]=v&255;
-						break;
-					case HALFWORD:
-						(*this)[addr+1]=(v>>8)&255;
-						(*this)[addr]=v&255;
-						break;
-					case BYTE:
-						(*this)[addr]=v&255;
-						break;
-				}
-			}
-		}
-		else
-			EightThirtyTwoMemory::Write(addr,v,endian,opsize);
-	}
-	void SetBase(int base)
-	{
-		this->base=base;
-	}
-	unsigned char &operator[](const int idx)
-	{
-		if(idx<size)
-			return(BinaryBlob::operator[](idx));
-		else
-			return(EightThirtyTwoMemory::operator[](idx));
-	}
-	protected:
-	int base;
 };
 
 
-class EightThirtyTwoEmu 
+// The command-line front end: options, reports on exit, and server and batch modes.
+
+class EightThirtyTwoCommandLine : public EightThirtyTwoEmu
 {
 	public:
-	EightThirtyTwoEmu() : initpc(0), steps(-1), endian(LITTLEENDIAN)
-	{
-		temp=0;
-		regfile[0]=0;
-		regfile[1]=0;
-		regfile[2]=0;
-		regfile[3]=0;
-		regfile[4]=0;
-		regfile[5]=0;
-		regfile[6]=0;
-	}
-
-	~EightThirtyTwoEmu()
+	EightThirtyTwoCommandLine() : serverfile(0), batchfile(0), jobs(0), gdbport(0), uartinfile(0)
 	{
 	}
 
@@ -393,16 +49,46 @@ class EightThirtyTwoEmu
 			{"steps",required_argument,NULL,'s'},
 			{"offset",required_argument,NULL,'o'},
 			{"report",required_argument,NULL,'r'},
+			{"trace",required_argument,NULL,'t'},
+			{"bintrace",required_argument,NULL,'T'},
+			{"keyframes",required_argument,NULL,'k'},
+			{"memmap",required_argument,NULL,'M'},
+			{"jit",no_argument,NULL,'j'},
+			{"nofuse",no_argument,NULL,'n'},
+			{"noskip",no_argument,NULL,'i'},
+			{"dualthread",no_argument,NULL,'d'},
+			{"clock",required_argument,NULL,'c'},
+			{"baud",required_argument,NULL,'b'},
+			{"fifo",required_argument,NULL,'f'},
+			{"input",required_argument,NULL,'I'},
+			{"cycles",no_argument,NULL,'C'},
+			{"waitstates",required_argument,NULL,'w'},
+			{"generics",required_argument,NULL,'g'},
+			{"profile",required_argument,NULL,'p'},
+			{"callgraph",required_argument,NULL,'G'},
+			{"stats",required_argument,NULL,'S'},
+			{"coverage",required_argument,NULL,'V'},
+			{"map",required_argument,NULL,'m'},
+			{"checkpoint",required_argument,NULL,'x'},
+			{"restore",required_argument,NULL,'R'},
+			{"stop",required_argument,NULL,'X'},
+			{"break",required_argument,NULL,'a'},
+			{"watch",required_argument,NULL,'W'},
+			{"gdb",required_argument,NULL,'D'},
+			{"history",required_argument,NULL,'U'},
+			{"server",required_argument,NULL,'F'},
+			{"batch",required_argument,NULL,'B'},
+			{"jobs",required_argument,NULL,'J'},
 			{0, 0, 0, 0}
 		};
-		bool offset=false;
-		int stackbit=30;
-		bool stackboot=false;
+		int keyframes=4096;
+		const char *tracefile=0;
+		bool binarytrace=false;
 
 		while(1)
 		{
 			int c;
-			c = getopt_long(argc,argv,"he:s:r:o:bm",long_options,NULL);
+			c = getopt_long(argc,argv,"he:s:r:o:t:T:k:M:jnidc:Cw:g:p:G:S:V:m:x:R:X:a:W:D:U:F:B:J:b:f:I:",long_options,NULL);
 			if(c==-1)
 				break;
 			switch (c)
@@ -413,6 +99,47 @@ class EightThirtyTwoEmu
 					printf("    -e --endian\t  Set endian mode to \"l\" (default) or \"b\"\n");
 					printf("    -s --steps\t  Emulate a specific number of steps (default: indefinite)\n");
 					printf("    -r --report\t  set reporting level - 0 for silent, 4 for verbose\n");
+					printf("    -t --trace\t  write an execution trace to the specified file\n");
+					printf("    -T --bintrace\t  write a compact binary execution trace, for decoding with 832trace\n");
+					printf("    -k --keyframes\t  set the binary trace keyframe interval (default: 4096)\n");
+					printf("    -M --memmap\t  read the memory map (RAM, ROM and peripherals) from the specified file\n");
+					printf("    -j --jit\t  translate frequently executed code to native code (x86-64 hosts only)\n");
+					printf("    -n --nofuse\t  execute li chains one instruction at a time\n");
+					printf("    -i --noskip\t  run busy-wait loops in full, rather than skipping ahead to the\n");
+					printf("\t\t  next event\n");
+					printf("    -d --dualthread\t  run two hardware threads, interleaved as by the CPU's dispatch logic\n");
+					printf("    -c --clock\t  set the emulated clock frequency in MHz, for the timers (default: 100)\n");
+					printf("    -b --baud\t  model the UART's timing at the specified baud rate\n");
+					printf("    -f --fifo\t  with -b, set the depth of the UART's FIFOs (default: 1)\n");
+					printf("    -I --input\t  read the UART's input from the specified file, FIFO or terminal\n");
+					printf("\t\t  once any given on the command line is used up, rather than stdin\n");
+					printf("    -C --cycles\t  model the CPU's pipeline timing, and report cycles and CPI\n");
+					printf("    -w --waitstates\t  set the number of wait states for each memory access (implies -C)\n");
+					printf("    -g --generics\t  set the CPU's generics for the timing model (implies -C), e.g.\n");
+					printf("\t\t  \"prefetch=false,forwarding=false,multiplier=false\"\n");
+					printf("    -p --profile\t  print a flat profile on exit, using a map file written by 832l -m or -M\n");
+					printf("    -G --callgraph\t  with -p, also print a call graph profile, and write collapsed stacks\n");
+					printf("\t\t  for flamegraph tools to the specified file\n");
+					printf("    -S --stats\t  write instruction mix statistics to the specified file\n");
+					printf("    -V --coverage\t  write a bitmap of the code reached to the specified file, for 832cov,\n");
+					printf("\t\t  and with -m or -p print the coverage of each function on exit\n");
+					printf("    -m --map\t  read symbols from a map file written by 832l -m or -M\n");
+					printf("    -X --stop\t  stop before executing the specified address or symbol\n");
+					printf("    -a --break\t  stop at the specified address or symbol, and show the registers\n");
+					printf("\t\t  (may be given more than once)\n");
+					printf("    -W --watch\t  stop after an access to the range start[,end][:r|w|rw] - writes\n");
+					printf("\t\t  to a word by default (may be given more than once)\n");
+					printf("    -D --gdb\t  wait for GDB to connect to the specified local port, and let it\n");
+					printf("\t\t  control the program\n");
+					printf("    -U --history\t  with -D, keep up to the specified number of megabytes of history,\n");
+					printf("\t\t  so GDB can run the program backwards\n");
+					printf("    -x --checkpoint\t  save the machine state to the specified file when emulation stops\n");
+					printf("    -R --restore\t  resume from a checkpoint saved with -x\n");
+					printf("    -F --server\t  boot as far as -X, then run once for each line of the specified\n");
+					printf("\t\t  file, sent to the UART, restoring the machine state before each run\n");
+					printf("    -B --batch\t  run the tests listed in the specified manifest in parallel, and\n");
+					printf("\t\t  print a summary\n");
+					printf("    -J --jobs\t  set the number of tests to run at once (default: one per core)\n");
 					printf("    -o --offsetstack\t  specify base address for stack RAM. Zero by default,\n");
 					printf("\t\t  specified as a bit number, so 30=0x40000000, etc.\n");
 					break;
@@ -420,8 +147,7 @@ class EightThirtyTwoEmu
 					endian=optarg[0]=='l' ? LITTLEENDIAN : BIGENDIAN;
 					break;
 				case 'o':
-					offset=true;
-					stackbit=atoi(optarg);
+					stackoffset=1<<atoi(optarg);
 					break;
 				case 's':
 					steps=atoi(optarg);
@@ -429,403 +155,620 @@ class EightThirtyTwoEmu
 				case 'r':
 					Debug.SetLevel(DebugLevel(atoi(optarg)));
 					break;
+				case 't':
+					tracefile=optarg;
+					binarytrace=false;
+					break;
+				case 'T':
+					tracefile=optarg;
+					binarytrace=true;
+					break;
+				case 'k':
+					keyframes=atoi(optarg);
+					break;
+				case 'M':
+					memorymap=optarg;
+					break;
+				case 'j':
+					usejit=true;
+					break;
+				case 'n':
+					usefusion=false;
+					break;
+				case 'i':
+					useskip=false;
+					break;
+				case 'd':
+					dualthread=true;
+					break;
+				case 'c':
+					frequency=atoi(optarg);
+					if(frequency<=0)
+						throw "Clock frequency must be at least 1MHz";
+					break;
+				case 'b':
+					uartbaud=atoi(optarg);
+					if(uartbaud<=0)
+						throw "The baud rate must be positive";
+					break;
+				case 'f':
+					uartfifo=atoi(optarg);
+					if(uartfifo<1 || uartfifo>UART_MAXFIFO)
+						throw "The UART's FIFOs must hold 1 to 256 characters";
+					break;
+				case 'I':
+					uartinfile=optarg;
+					break;
+				case 'C':
+					timed=true;
+					break;
+				case 'w':
+					timing.waitstates=atoi(optarg);
+					if(timing.waitstates<0)
+						throw "Wait states can't be negative";
+					timed=true;
+					break;
+				case 'g':
+					ParseGenerics(optarg);
+					timed=true;
+					break;
+				case 'p':
+					symbols.Load(optarg);
+					if(!profile)
+						profile=new EightThirtyTwoProfile;
+					break;
+				case 'G':
+					callgraphfile=optarg;
+					break;
+				case 'm':
+					symbols.Load(optarg);
+					break;
+				case 'x':
+					checkpointfile=optarg;
+					break;
+				case 'R':
+					restorefile=optarg;
+					break;
+				case 'X':
+					stopat=optarg;
+					break;
+				case 'a':
+					breakat.push_back(optarg);
+					break;
+				case 'W':
+					watchat.push_back(optarg);
+					break;
+				case 'D':
+					gdbport=atoi(optarg);
+					if(gdbport<=0 || gdbport>65535)
+						throw "The GDB port must be between 1 and 65535";
+					break;
+				case 'U':
+					if(atoi(optarg)<1)
+						throw "The history needs at least 1MB";
+					SetHistory(atoi(optarg));
+					break;
+				case 'F':
+					serverfile=optarg;
+					break;
+				case 'B':
+					batchfile=optarg;
+					break;
+				case 'J':
+					jobs=atoi(optarg);
+					if(jobs<1)
+						throw "At least one job is needed";
+					break;
+				case 'S':
+					statsfile=optarg;
+					if(!stats)
+						stats=new EightThirtyTwoStats;
+					break;
+				case 'V':
+					coveragefile=optarg;
+					if(!coverage)
+						coverage=new EightThirtyTwoCoverage;
+					break;
 			}
 		}
 
+		if(history && !gdbport)
+			throw "Running backwards needs a debugger - use -D";
+
+		if(callgraphfile)
+		{
+			if(!profile)
+				throw "The call graph needs a map file - use -p";
+			if(callgraph)
+				delete callgraph;
+			callgraph=new EightThirtyTwoCallGraph(symbols);
+		}
+
+		if(trace)
+			delete trace;
+		trace=0;
+		if(tracefile && binarytrace)
+			trace=new EightThirtyTwoBinaryTrace(tracefile,keyframes);
+		else if(tracefile)
+			trace=new EightThirtyTwoTextTrace(tracefile);
+		else if(Debug.GetLevel()>=TRACE)	// Verbose reporting traces execution to stderr.
+			trace=new EightThirtyTwoTextTrace(stderr);
+
 		return(optind);
 	}
 
 	
 
-	int GetOpcode(EightThirtyTwoMemory &prg, int pc)
+	// Parses a comma-separated list of generics, each optionally followed by =true or =false.
+
+	void ParseGenerics(char *list)
+	{
+		for(char *generic=strtok(list,",");generic;generic=strtok(0,","))
+		{
+			bool enable=true;
+			char *value=strchr(generic,'=');
+			if(value)
+			{
+				*value++=0;
+				enable=strcmp(value,"false")!=0 && strcmp(value,"0")!=0;
+			}
+			if(strcmp(generic,"prefetch")==0)
+				timing.prefetch=enable;
+			else if(strcmp(generic,"forwarding")==0)
+				timing.forwarding=enable;
+			else if(strcmp(generic,"multiplier")==0)
+				timing.multiplier=enable;
+			else
+				throw "Unknown generic - expected prefetch, forwarding or multiplier";
+		}
+	}
+
+	const char *GetMemoryMap()
 	{
-//		int t=prg.Read(pc&~3,endian);
-//		int opcode=t>>((3-(pc&3))<<3);
-//		return(opcode&0xff);
-		return(prg[pc]&0xff);
+		return(memorymap);
 	}
 
+	const char *GetServerInputs()
+	{
+		return(serverfile);
+	}
+
+	const char *GetBatchManifest()
+	{
+		return(batchfile);
+	}
 
-	void Run(EightThirtyTwoProgram &prg)
+	int GetGDBPort()
+	{
+		return(gdbport);
+	}
+
+	const char *GetUARTInFile()
+	{
+		return(uartinfile);
+	}
+
+	int GetJobs()
+	{
+		return(jobs);
+	}
+
+	int GetSteps()
+	{
+		return(steps);
+	}
+
+	void SetSteps(int s)
+	{
+		steps=s;
+	}
+
+	int GetTicks()
+	{
+		return(tick);
+	}
+
+	// True if emulation ended because the step limit was reached.
+	bool TimedOut()
+	{
+		return(steps>=0 && tick>=steps);
+	}
+
+	// Takes the settings which affect how a program runs from another emulator,
+	// for batch mode.  Tracing, profiling and the like are left disabled.
+
+	void CopyOptions(const EightThirtyTwoCommandLine &o)
+	{
+		if(o.trace || o.profile || o.stats || o.coverage || o.checkpointfile || o.restorefile || o.stopat || o.serverfile
+				|| !o.breakat.empty() || !o.watchat.empty() || o.gdbport)
+			throw "Tracing, profiling, statistics, coverage, checkpoints, breakpoints, GDB and server mode aren't supported in batch mode";
+		initpc=o.initpc;
+		steps=o.steps;
+		endian=o.endian;
+		memorymap=o.memorymap;
+		stackoffset=o.stackoffset;
+		usejit=o.usejit;
+		usefusion=o.usefusion;
+		useskip=o.useskip;
+		dualthread=o.dualthread;
+		timed=o.timed;
+		timing=o.timing;
+		frequency=o.frequency;
+		uartbaud=o.uartbaud;
+		uartfifo=o.uartfifo;
+	}
+
+	void Run(EightThirtyTwoMemory &prg)
 	{
 		Debug[WARN] << "Starting emulation" << std::endl;
 		Debug[ERROR] << std::hex << std::endl;
-		for(int i=0;i<7;++i)
-			regfile[i]=0;
-		regfile[7]=initpc;
-                regfile[6]=prg.GetRAMSize();
-		zero=0; carry=0;
-		cond=1;
-
-		int tick=0;
-		bool run=true;
-		bool immediate_continuation=false;
-		enum e32size sizemod=WORD;
-		bool sign_mod=false;
-
-		while(run)
-		{
-			int nextpc;
-			int opcode;
-			int operand;
-			int operim;
-			int t;
-			long long t2;
+		Reset(prg);
+		std::chrono::steady_clock::time_point starttime=std::chrono::steady_clock::now();
+		Execute();
+		std::chrono::duration<double> elapsed=std::chrono::steady_clock::now()-starttime;
+		Debug[WARN] << std::endl << std::dec << tick << " instructions in " << elapsed.count() << " seconds";
+		if(elapsed.count()>0.0)
+			Debug[WARN] << " (" << tick/elapsed.count() << " instructions per second)";
+		Debug[WARN] << std::endl;
+		if(exited)
+			Debug[WARN] << "Exit status " << exitstatus << std::endl;
+		Report();
+	}
+
+	// Server mode boots the program once, as far as the -X address, and snapshots
+	// the machine there.  Each line of the input file is then given to the UART
+	// in turn, and the program run to completion from the snapshot.  Only the
+	// memory pages written by a run are copied, and put back before the next.
+
+	void Serve(EightThirtyTwoMemory &prg,const char *inputfile)
+	{
+		if(dualthread || timed || trace)
+			throw "Server mode doesn't support tracing or the pipeline model";
+		std::vector<std::string> inputs;
+		ReadInputs(inputfile,inputs);
+		Debug[WARN] << "Starting emulation" << std::endl;
+		Debug[ERROR] << std::hex << std::endl;
+		Reset(prg);
 
-			std::stringstream mnem;
-			mnem << std::hex;
+		std::chrono::steady_clock::time_point starttime=std::chrono::steady_clock::now();
+		if(stopping)
+		{
+			Execute();
+			if(!stopped)
+				throw "The program finished before reaching the stop address";
+			stopping=false;
+			ClearBreakpoint(stopaddr);
+			std::chrono::duration<double> boottime=std::chrono::steady_clock::now()-starttime;
+			Debug[WARN] << std::dec << "Booted in " << tick << " instructions, " << boottime.count() << " seconds" << std::hex << std::endl;
+		}
 
-			opcode=GetOpcode(prg,regfile[7]);
-			operand=opcode&0x7;
-			operim=opcode&0x3f;
-			opcode&=0xf8;
+		EightThirtyTwoContext bootcontext;
+		SaveContext(bootcontext);
+		int boottick=tick;
+		unsigned long long bootidle=idle;
+		bool bootpaused=paused;
+		bool bootinterrupting=interrupting;
+		prg.Snapshot();
+
+		std::vector<std::pair<unsigned int,unsigned int> > restored;
+		unsigned long long instructions=0;
+		starttime=std::chrono::steady_clock::now();
+		for(unsigned int i=0;i<inputs.size();++i)
+		{
+			if(i)
+			{
+				restored.clear();
+				prg.Rollback(restored);
+				for(unsigned int j=0;j<restored.size();++j)
+					InvalidateCode(restored[j].first,restored[j].second);
+				LoadContext(bootcontext);
+				tick=boottick;
+				idle=bootidle;
+				paused=bootpaused;
+				interrupting=bootinterrupting;
+				watching=false;
+				exited=false;
+			}
+			prg.SetUARTIn(inputs[i].c_str());
+			Execute();
+			instructions+=tick-boottick;
+			std::cout << std::endl;
+		}
+		std::chrono::duration<double> elapsed=std::chrono::steady_clock::now()-starttime;
+		Debug[WARN] << std::endl << std::dec << inputs.size() << " runs, " << instructions << " instructions in " << elapsed.count() << " seconds";
+		if(elapsed.count()>0.0)
+			Debug[WARN] << " (" << inputs.size()/elapsed.count() << " runs per second)";
+		Debug[WARN] << std::endl;
+		Report();
+	}
 
-			Debug[TRACE] << std::dec << tick << ", r7: " << std::hex << regfile[7];
+	// Hands the program to a debugger from reset.  The debugger runs it a slice at a
+	// time, so the pipeline model and traces, which expect a single run, aren't
+	// supported.  If the debugger detaches, the program runs on to the usual end,
+	// still keeping any history.
 
-			nextpc=regfile[7]+1;
-			regfile[7]=nextpc;			
+	void RunDebugger(EightThirtyTwoMemory &prg,int port)
+	{
+		if(dualthread || timed || trace)
+			throw "The GDB server doesn't support tracing or the pipeline model";
+		Reset(prg);
+		int limit=steps;
+		EightThirtyTwoGDBStub stub(*this,prg);
+		if(stub.Serve(port))
+		{
+			steps=limit;
+			Execute();
+		}
+		Report();
+	}
 
-			Debug[TRACE] << " op: " << opcode;
+	// One input per line; the line ending isn't included.
 
-			if(cond) // is execution enabled?
+	void ReadInputs(const char *filename,std::vector<std::string> &inputs)
+	{
+		FILE *f;
+		if(!(f=FOpenUTF8(filename,"r")))
+			throw "Can't open input file";
+		std::string line;
+		int c;
+		while((c=fgetc(f))!=EOF)
+		{
+			if(c=='\n')
 			{
-				if((opcode&0xc0)==0xc0)
-				{
-					if(immediate_continuation)
-					{
-						temp<<=6;
-						temp|=operim;
-						mnem<<("li (cont) ");
-						mnem << operim;
-					}
-					else
-					{
-						temp=operim;
-						if(operim&0x20)
-							temp|=0xffffffc0;
-						mnem<<("li ");
-						mnem<< operim;
-						immediate_continuation=true;
-					}
-				}
-				else if((opcode|operand)==ovl_hlf)	// Evaluate overloaded (zero-operand) opcodes here
-				{
-					sizemod=HALFWORD;
-					mnem << ("hlf ");
-					// Set the halfword modifier, cleared by the next instruction that could use it.
-				}
-				else if((opcode|operand)==ovl_byt)
-				{
-					sizemod=BYTE;
-					mnem << ("byt ");
-					// Set the byte modifier, cleared by the next instruction that could use it.
-				}
-				else if((opcode|operand)==ovl_sgn)
-				{
-					sign_mod=true;
-					mnem << ("sgn ");
-					// Set the sign modifier, cleared by the next instruction that could use it.
-				}
-				else if((opcode|operand)==ovl_ldt)
-				{
-					temp=prg.Read(temp,endian,sizemod);
-					sizemod=WORD;
-					mnem << ("ldt ");
-				}
-				else	// Now having dealt with special cases, consider full opcodes
-				{
-					immediate_continuation=false;
-					switch(opcode)
-					{
-
-						// Control flow:
-
-						case opc_cond: // cond
-							if(!operand)
-								steps=1;
-							t=((zero&carry)<<3)|((!zero&carry)<<2)|((zero&!carry)<<1)|(!zero&!carry);
-							operand|=(operand&2)<<2;
-							cond=(operand&t)>0;
-							mnem << ("cond ") << operand << (", ") << t;
-							break;
-
-
-						// Register
-
-
-						case opc_mt: // mt
-							temp=regfile[operand];
-							mnem << ("mt ") << operand;
-							break;
-
-						case opc_mr: // mr
-							regfile[operand]=temp;
-							if(operand==7)
-								cond=1; // cancel cond on write to r7
-							mnem << ("mr ") << operand;
-							break;
-
-						case opc_exg: // exg
-							t=regfile[operand];
-							regfile[operand]=temp;
-							temp=t;
-							if(operand==7)
-								cond=1; // cancel cond on write to r7
-							mnem << ("exg ") << operand;
-							break;
-
-
-						// Memory
-
-
-						case opc_ld: // ld
-							temp=prg.Read(regfile[operand],endian,sizemod); // &0xfffffffc);
-							zero=(temp==0);
-							carry=(temp&0x80000000)!=0;
-							sizemod=WORD;
-							mnem << ("ld ") << operand;
-							break;
-
-						case opc_ldinc: // ldinc
-							temp=prg.Read(regfile[operand],endian,sizemod); // &0xfffffffc);
-							regfile[operand]+=4;
-							zero=(temp==0);
-							carry=(temp&0x80000000)!=0;
-							sizemod=WORD;
-							mnem << ("ldinc ") << operand;
-							break;
-
-						case opc_ldbinc: // ldbinc
-							Debug[TRACE] << " operand " << operand << ": " << regfile[operand]; 
-							temp=prg[regfile[operand]];
-							regfile[operand]++;
-							zero=(temp==0);
-							carry=0;
-							sizemod=WORD;
-							mnem << ("ldbinc ") << operand;
-							break;
-
-						case opc_ldidx: // ldidx
-							temp=prg.Read(temp+regfile[operand],endian,sizemod);//&0xfffffffc);
-							sizemod=WORD;
-							zero=(temp==0);
-							carry=(temp&0x80000000)!=0;
-							mnem << ("ldidx ") << operand;
-							break;
-
-
-						case opc_st: // st
-							prg.Write(regfile[operand],temp,endian,sizemod); // &0xfffffffc,temp);
-							sizemod=WORD;
-							mnem << ("st ") << operand;
-							break;
-
-						case opc_stdec: // stdec
-							regfile[operand]-=4;
-							prg.Write(regfile[operand],temp,endian,sizemod); //&0xfffffffc,temp);
-							sizemod=WORD;
-							mnem << ("stdec ") << operand;
-							break;
-
-						case opc_stmpdec: // stmpdec
-							temp-=4;
-							prg.Write(temp,regfile[operand],endian,sizemod);
-							sizemod=WORD;
-							mnem << ("stmpdec ") << operand;
-							break;
-
-						case opc_stbinc: // stbinc
-							prg[regfile[operand]]=temp&0xff;
-							regfile[operand]++;
-							sizemod=WORD;
-							mnem << ("stbinc ") << operand;
-							break;
-
-						case opc_stinc: // stinc
-							prg.Write(regfile[operand],temp,endian,sizemod); //&0xfffffffc,temp);
-							regfile[operand]+=4;
-							sizemod=WORD;
-							mnem << ("stinc ") << operand;
-							break;
-
-						// Arithmetic
-
-
-						case opc_add: // add
-							t2=regfile[operand];
-							t2+=temp;
-							carry=(t2>>32)&1;
-							zero=(t2&0xffffffff)==0;
-							if(operand==7)
-							{
-								cond=1; // cancel cond on write to r7
-								temp=regfile[operand];	// For r7, previous value goes to temp
-							}
-							regfile[operand]=t2;
-							mnem << ("add ") << operand;
-							break;
-
-						case opc_addt: // addt;
-							t=regfile[operand];
-							t2=regfile[operand];
-							t2+=temp;
-							carry=(t2>>32)&1;
-							zero=(t2&0xffffffff)==0;
-							if(operand==7)
-								cond=1; // cancel cond on write to r7
-							temp=t2; // result goes to temp.
-
-							mnem << ("addt ") << operand;
-							break;
-
-						case opc_cmp: // cmp - FIXME - heed then clear sign modifier.
-							sign_mod=(sign_mod) and (((regfile[operand]>>31)&1) xor ((temp>>31)&1));
-							t2=regfile[operand];
-							t2-=temp;
-							carry=(t2>>32)&1;
-							carry^=sign_mod;
-							sign_mod=0;
-							zero=(t2&0xffffffff)==0;
-							mnem << ("cmp ") << operand;
-							break;
-
-						case opc_sub: // sub - FIXME - heed then clear sign modifier.
-							sign_mod=(not sign_mod) and (((regfile[operand]>>31)&1) xor ((temp>>31)&1));
-							t2=regfile[operand];
-							t2-=temp;
-							carry=(t2>>32)&1;
-							carry^=sign_mod;
-							sign_mod=0;
-							regfile[operand]=t2;
-							zero=(t2&0xffffffff)==0;
-							if(operand==7)
-								cond=1; // cancel cond on write to r7
-							mnem << ("sub ") << operand;
-							break;
-
-
-						// Logical
-
-
-						case opc_and: // and
-							regfile[operand]&=temp;
-							carry=0;
-							zero=regfile[operand]==0;
-							mnem << ("and ") << operand;
-							break;
-
-						case opc_or: // or
-							regfile[operand]|=temp;
-							carry=0;
-							zero=regfile[operand]==0;
-							mnem << ("or ") << operand;
-							break;
-
-						case opc_xor: // xor
-							regfile[operand]^=temp;
-							carry=0;
-							zero=regfile[operand]==0;
-							mnem << ("xor ") << operand;
-							break;
-
-						case opc_shl: // shl
-							t2=regfile[operand]<<(temp-1);
-							carry=t2>>32;
-							regfile[operand]<<=temp;
-							zero=regfile[operand]==0;
-							mnem << ("shl ") << operand;
-							break;
-
-						case opc_shr: // asr FIXME heed sign bit
-							carry=regfile[operand]>>(temp-1);
-							carry&=1;
-							if(sign_mod)
-							{
-								t=regfile[operand];
-								t>>=temp;
-								regfile[operand]=t;
-								mnem << ("shr(a) ") << operand;
-							}
-							else
-							{
-								regfile[operand]>>=temp;
-								mnem << ("shr(l) ") << operand;
-							}
-							sign_mod=false;
-							zero=regfile[operand]==0;
-							break;
-
-						case opc_ror: // ror
-							carry=regfile[operand]>>(temp-1);
-							carry&=1;
-							t=regfile[operand]<<(32-temp);
-							regfile[operand]=(regfile[operand]>>temp)|t;
-                                                        mnem << ("ror ") << operand;
-							break;
-
-					}
-				}
+				inputs.push_back(line);
+				line.clear();
 			}
-			else // execution disabled by cond
+			else if(c!='\r')
+				line+=c;
+		}
+		if(!line.empty())
+			inputs.push_back(line);
+		fclose(f);
+	}
+
+	void Report()
+	{
+		if(interrupts)
+			Debug[WARN] << std::dec << interrupts << " interrupts taken in " << GetCycles() << " cycles" << std::hex << std::endl;
+		if(dualthread)
+		{
+			unsigned long long cycles=pipeline.GetCycles();
+			Debug[WARN] << std::dec << "Thread 1: " << threadticks[0] << " instructions, thread 2: " << threadticks[1]
+				<< " instructions, " << cycles << " cycles";
+			if(cycles)
+				Debug[WARN] << " (" << double(tick)/cycles << " instructions per cycle)";
+			Debug[WARN] << std::hex << std::endl;
+		}
+		if(timed)
+			ReportTiming();
+		if(profile)
+			profile->Report(stderr,symbols,pipelined);
+		if(callgraph)
+		{
+			callgraph->Report(stderr,pipelined ? "cycles" : "instructions");
+			callgraph->WriteCollapsed(callgraphfile);
+		}
+		if(stats)
+			stats->Write(statsfile);
+		if(coverage)
+		{
+			coverage->Save(coveragefile);
+			if(!symbols.IsEmpty())
+				coverage->Report(stderr,symbols);
+		}
+		if(fuse)
+		{
+			Debug[WARN] << std::dec << "Superinstructions: " << fused[HANDLER_LICHAIN-HANDLER_FUSED] << " li chains, "
+				<< fused[HANDLER_LIJUMP-HANDLER_FUSED] << " jumps, "
+				<< fused[HANDLER_LIADDT-HANDLER_FUSED] << " PC-relative addresses, "
+				<< fused[HANDLER_LILDT-HANDLER_FUSED] << " loads" << std::hex << std::endl;
+		}
+		if(skipped)
+			Debug[WARN] << std::dec << skipped << " instructions skipped in busy-wait loops" << std::hex << std::endl;
+		Debug[COMMENT] << prg->GetResidentSize()/1024 << "KB of emulated memory in use" << std::endl;
+		if(checkpointfile)
+			SaveCheckpoint(checkpointfile);
+		if(jit)
+		{
+			jit->ReportStats();
+			delete jit;
+			jit=0;
+		}
+		Debug[WARN] << std::hex;
+	}
+
+	protected:
+	const char *serverfile;	// Inputs for server mode
+	const char *batchfile;	// Manifest for batch mode
+	int jobs;	// Threads for batch mode, or 0 for one per core
+	int gdbport;	// Port for the GDB server, or 0
+	const char *uartinfile;	// Console input, if not stdin
+};
+
+
+// Batch mode runs the tests listed in a manifest, each with its own emulator
+// and memory map, on a pool of threads, then prints a summary in manifest order.
+// Each line of the manifest names a program, its step limit or "-" to use the
+// -s limit, and a file holding its expected output or "-" to accept any output,
+// optionally followed by the UART input, which runs to the end of the line.
+// Expected output is compared with what 832e would print to stdout, so it can
+// be recorded with "832e program > file".  Everything after a '#' is ignored.
+
+struct EightThirtyTwoBatchTest
+{
+	int line;
+	std::string program;
+	int steps;	// -1 to use the -s limit
+	std::string expected;	// Empty to accept any output
+	std::string input;
+	bool passed;
+	std::string result;	// Why the test failed
+	int ticks;
+	double seconds;
+};
+
+
+class EightThirtyTwoBatch
+{
+	public:
+	EightThirtyTwoBatch(EightThirtyTwoCommandLine &options,const char *manifest) : options(options), next(0)
+	{
+		FILE *f;
+		if(!(f=FOpenUTF8(manifest,"r")))
+			throw "Can't open manifest";
+		char buf[4096];
+		int line=0;
+		while(fgets(buf,sizeof(buf),f))
+		{
+			++line;
+			char *p=strpbrk(buf,"#\r\n");
+			if(p)
+				*p=0;
+			char *program=strtok(buf," \t");
+			if(!program)
+				continue;
+			char *steps=strtok(0," \t");
+			char *expected=strtok(0," \t");
+			if(!steps || !expected)
 			{
-				mnem << ("(");
-				if(opcode==opc_cond)
-				{
-					t=((zero&carry)<<3)|((!zero&carry)<<2)|((zero&!carry)<<1)|(!zero&!carry);
-					operand|=(operand&2)<<2;
-					cond=(operand&t)>0;
-					mnem << ("cond ") << operand << (", ") << t;
-				}
-				else if(operand==7)
-				{
-					switch(opcode)
-					{
-						case opc_mr: // mr
-						case opc_exg: // exg
-						case opc_add: // add
-						case opc_sub: // sub
-						case opc_addt: // addt;
-							cond=1;
-					}
-				}
-				mnem << (")");
+				fclose(f);
+				throw "Manifest lines need a program, a step limit and an expected output file";
 			}
-			++tick;
-			if(steps>=0 && tick>=steps)
-				run=0;
+			char *input=strtok(0,"");
+			EightThirtyTwoBatchTest t;
+			t.line=line;
+			t.program=program;
+			t.steps=strcmp(steps,"-")==0 ? -1 : atoi(steps);
+			t.expected=strcmp(expected,"-")==0 ? "" : expected;
+			if(input)
+				t.input=input+strspn(input," \t");
+			t.passed=false;
+			t.ticks=0;
+			t.seconds=0.0;
+			tests.push_back(t);
+		}
+		fclose(f);
+	}
 
-			Debug[TRACE] << "\tOp: " << (opcode|operand) << ", " << mnem.str() << "\n\t\t";
-			DumpRegs();
-			Debug[TRACE] << std::endl;
+	// Returns the number of tests which failed.
+	int Run(int jobs)
+	{
+		if(jobs<1)
+			jobs=std::thread::hardware_concurrency();
+		if(jobs<1)
+			jobs=1;
+		if((unsigned int)jobs>tests.size())
+			jobs=tests.size();
+
+		std::chrono::steady_clock::time_point starttime=std::chrono::steady_clock::now();
+		std::vector<std::thread> pool;
+		for(int i=0;i<jobs;++i)
+			pool.push_back(std::thread(&EightThirtyTwoBatch::Worker,this));
+		for(int i=0;i<jobs;++i)
+			pool[i].join();
+		std::chrono::duration<double> elapsed=std::chrono::steady_clock::now()-starttime;
+
+		int failed=0;
+		double total=0.0;
+		for(unsigned int i=0;i<tests.size();++i)
+		{
+			const EightThirtyTwoBatchTest &t=tests[i];
+			printf("%s %9.4fs %12d instructions  %s",t.passed ? "PASS" : "FAIL",t.seconds,t.ticks,t.program.c_str());
+			if(!t.input.empty())
+				printf(" \"%s\"",t.input.c_str());
+			if(!t.passed)
+				printf(" - %s (line %d)",t.result.c_str(),t.line);
+			printf("\n");
+			if(!t.passed)
+				++failed;
+			total+=t.seconds;
+		}
+		printf("%d tests, %d passed, %d failed in %.4f seconds (%.4f seconds of emulation on %d threads)\n",
+			int(tests.size()),int(tests.size())-failed,failed,elapsed.count(),total,jobs);
+		return(failed);
+	}
+
+	protected:
+	// Failures are reported in the summary, so the emulators run silently.
+	void Worker()
+	{
+		Debug.SetLevel(NONE);
+		unsigned int i;
+		while((i=next++)<tests.size())
+			RunTest(tests[i]);
+	}
 
-			if(!run)
-				Debug[TRACE] << "Emulation ended\n" << std::endl;
+	void RunTest(EightThirtyTwoBatchTest &t)
+	{
+		std::chrono::steady_clock::time_point starttime=std::chrono::steady_clock::now();
+		try
+		{
+			std::string output;
+			EightThirtyTwoCommandLine emu;
+			emu.CopyOptions(options);
+			if(t.steps>=0)
+				emu.SetSteps(t.steps);
+			EightThirtyTwoProgram prg(t.program.c_str(),emu.GetMemoryMap());
+			prg.SetUARTIn(t.input.c_str());
+			prg.SetUARTOut(&output);
+			emu.Run(prg);
+			t.ticks=emu.GetTicks();
+			output+='\n';
+			if(emu.TimedOut())
+				t.result="step limit reached";
+			else if(emu.HasExited() && emu.GetExitStatus())
+				t.result="exited with status "+std::to_string(emu.GetExitStatus());
+			else if(!t.expected.empty())
+				Compare(t,output);
+			else
+				t.passed=true;
 		}
+		catch(const char *err)
+		{
+			t.result=err;
+		}
+		catch(const std::exception &e)
+		{
+			t.result=e.what();
+		}
+		std::chrono::duration<double> elapsed=std::chrono::steady_clock::now()-starttime;
+		t.seconds=elapsed.count();
 	}
-	void DumpRegs()
+
+	void Compare(EightThirtyTwoBatchTest &t,const std::string &output)
 	{
-		Debug[TRACE] << "Temp: " << temp << ", ";
-		for(int i=0;i<7;++i)
+		FILE *f;
+		if(!(f=FOpenUTF8(t.expected.c_str(),"rb")))
 		{
-			Debug[TRACE] << "r" << i << ": " << regfile[i] << ", ";
+			t.result="can't open "+t.expected;
+			return;
 		}
-		Debug[TRACE] << "Z: " << zero << ", C: " << carry << ", Cond: " << cond;
+		std::string expected;
+		char buf[4096];
+		size_t len;
+		while((len=fread(buf,1,sizeof(buf),f))>0)
+			expected.append(buf,len);
+		fclose(f);
+		if(output==expected)
+		{
+			t.passed=true;
+			return;
+		}
+		size_t i=0;
+		while(i<output.size() && i<expected.size() && output[i]==expected[i])
+			++i;
+		t.result="output differs from "+t.expected+" at byte "+std::to_string(i);
 	}
-	protected:
-	unsigned int regfile[8];
-	int cond;
-	unsigned int temp;
-	int zero;
-	int carry;
-	int initpc;
-	int steps;
-	enum e32endian endian;
-};
 
+	EightThirtyTwoCommandLine &options;
+	std::vector<EightThirtyTwoBatchTest> tests;
+	std::atomic<unsigned int> next;
+};
 
 
 int main(int argc, char **argv)
 {
+	int status=0;
 	try
 	{
 		Debug.SetLevel(WARN);
@@ -833,11 +776,18 @@ int main(int argc, char **argv)
 		{
 			int i;
 			char *uartin=0;
-			EightThirtyTwoEmu sim;
+			EightThirtyTwoCommandLine sim;
 			i=sim.ParseOptions(argc,argv);
+			if(sim.GetBatchManifest())
+			{
+				EightThirtyTwoBatch batch(sim,sim.GetBatchManifest());
+				return(batch.Run(sim.GetJobs()) ? 1 : 0);
+			}
 			if(i<argc)
 			{
-				EightThirtyTwoProgram prg(argv[i++]);
+				EightThirtyTwoProgram prg(argv[i++],sim.GetMemoryMap());
+				if(sim.GetUARTInFile())
+					prg.SetUARTInFile(sim.GetUARTInFile());
 				if(i<argc)
 				{
 					Debug[TRACE] << "Setting uartin to " << argv[i] << std::endl;
@@ -847,15 +797,29 @@ int main(int argc, char **argv)
 				{
 					Debug[TRACE] << "All arguments used: " << i << ", " << argc << std::endl;
 				}
-				sim.Run(prg);
-				std::cout << std::endl;
+				if(sim.GetServerInputs())
+					sim.Serve(prg,sim.GetServerInputs());
+				else if(sim.GetGDBPort())
+					sim.RunDebugger(prg,sim.GetGDBPort());
+				else
+				{
+					sim.Run(prg);
+					std::cout << std::endl;
+				}
+				status=sim.GetExitStatus();
 			}
 		}
 	}
 	catch(const char *err)
 	{
 		std::cerr << "Error: " << err << std::endl;
+		status=1;
+	}
+	catch(const std::exception &e)
+	{
+		std::cerr << "Error: " << e.what() << std::endl;
+		status=1;
 	}
-	return(0);
+	return(status);
 }
 
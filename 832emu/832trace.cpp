@@ -0,0 +1,165 @@
+#include <iostream>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <getopt.h>
+
+#include "debug.h"
+#include "binarytrace.h"
+#include "mapfile.h"
+
+// Decoder for the binary execution traces written by 832e -T.
+
+
+static const char *sizenames[]={"word","halfword","byte","?"};
+
+
+void print_record(const EightThirtyTwoTraceRecord &r,EightThirtyTwoSymbolMap &symbols)
+{
+	bool skipped=r.flags&TRACEFLAG_SKIPPED;
+	printf("%u, r7: %x",r.tick,r.pc);
+	if(!symbols.IsEmpty())
+		printf(" <%s>",symbols.Describe(r.pc).c_str());
+	printf("\tOp: %x, %s%s%s\n\t\t",r.opcode,skipped ? "(" : "",EightThirtyTwoMnemonic(r.opcode),skipped ? ")" : "");
+	printf("Temp: %x, ",r.temp);
+	for(int j=0;j<7;++j)
+		printf("r%d: %x, ",j,r.regs[j]);
+	printf("Z: %d, C: %d, Cond: %d%s\n",(r.flags&TRACEFLAG_ZERO)!=0,(r.flags&TRACEFLAG_CARRY)!=0,(r.flags&TRACEFLAG_COND)!=0,
+		(r.flags&TRACEFLAG_THREAD2) ? ", Thread: 2" : "");
+	if(r.memflags)
+	{
+		printf("\t\t%s %s %x: %x",r.memflags&TRACEMEM_WRITE ? "Write" : "Read",
+			sizenames[r.memflags&TRACEMEM_SIZEMASK],r.memaddr,r.memvalue);
+		if(!symbols.IsEmpty())
+			printf(" <%s>",symbols.Describe(r.memaddr).c_str());
+		printf("\n");
+	}
+}
+
+
+void usage(const char *name)
+{
+	printf("Usage: %s [options] tracefile\n",name);
+	printf("    -h --help\t  display this message\n");
+	printf("    -m --map\t  read symbols from a map file written by 832l -m or -M\n");
+	printf("    -p --pc\t  only show instructions within an address range, given as start,end\n");
+	printf("\t\t  or as a single function name.  Addresses may be symbols or numbers\n");
+	printf("    -s --seek\t  start decoding at the specified instruction number\n");
+	printf("    -n --count\t  stop after the specified number of instructions\n");
+	printf("    -i --info\t  show a summary of the trace file\n");
+}
+
+
+int main(int argc,char **argv)
+{
+	static struct option long_options[] =
+	{
+		{"help",no_argument,NULL,'h'},
+		{"map",required_argument,NULL,'m'},
+		{"pc",required_argument,NULL,'p'},
+		{"seek",required_argument,NULL,'s'},
+		{"count",required_argument,NULL,'n'},
+		{"info",no_argument,NULL,'i'},
+		{0, 0, 0, 0}
+	};
+
+	try
+	{
+		Debug.SetLevel(WARN);
+		EightThirtyTwoSymbolMap symbols;
+		const char *range=0;
+		unsigned int seek=0;
+		long long count=-1;
+		bool info=false;
+
+		while(1)
+		{
+			int c=getopt_long(argc,argv,"hm:p:s:n:i",long_options,NULL);
+			if(c==-1)
+				break;
+			switch(c)
+			{
+				case 'h':
+					usage(argv[0]);
+					return(0);
+				case 'm':
+					symbols.Load(optarg);
+					break;
+				case 'p':
+					range=optarg;
+					break;
+				case 's':
+					seek=strtoul(optarg,0,0);
+					break;
+				case 'n':
+					count=strtoll(optarg,0,0);
+					break;
+				case 'i':
+					info=true;
+					break;
+			}
+		}
+
+		if(optind>=argc)
+		{
+			usage(argv[0]);
+			return(1);
+		}
+
+		unsigned int low=0;
+		unsigned int high=0xffffffff;
+		if(range)
+		{
+			std::string r=range;
+			size_t comma=r.find(',');
+			if(comma!=std::string::npos)
+			{
+				if(!symbols.Resolve(r.substr(0,comma).c_str(),low) || !symbols.Resolve(r.substr(comma+1).c_str(),high))
+					throw "Can't resolve address range";
+			}
+			else
+			{
+				int idx=symbols.Find(range);
+				if(idx<0)
+					throw "Can't find function in map file";
+				low=symbols[idx].address;
+				high=symbols.FunctionEnd(idx);
+			}
+		}
+
+		EightThirtyTwoTraceReader reader(argv[optind]);
+		if(info)
+		{
+			printf("Keyframe interval: %u\n",reader.GetKeyframeInterval());
+			printf("Blocks: %d\n",reader.GetBlockCount());
+		}
+
+		if(!reader.Seek(seek))
+			throw "Seek position is beyond the end of the trace";
+
+		EightThirtyTwoTraceRecord r;
+		unsigned int total=0;
+		while(count && reader.Next(r))
+		{
+			++total;
+			if(r.pc>=low && r.pc<high)
+			{
+				if(!info)
+					print_record(r,symbols);
+				if(count>0)
+					--count;
+			}
+		}
+		if(info)
+			printf("Instructions from %u: %u\n",seek,total);
+	}
+	catch(const char *err)
+	{
+		std::cerr << "Error: " << err << std::endl;
+		return(1);
+	}
+	return(0);
+}
+
@@ -7,22 +7,29 @@
 #include <cstring>
 #include "debug.h"
 
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
+
 #include "util.h"
 
 // Class to handle the loading of a binary blob from a file, taking care of such tedious details as
 // determining the filesize, and translating the filename from UTF8 to wchar_t if on Windows.
+// Other than on Windows, files are mapped copy-on-write rather than read, so the data costs
+// nothing until it's touched, instances loading the same file share physical pages, and
+// writes stay private to the blob.
 
 class BinaryBlob
 {
 	public:
-	BinaryBlob() : pointer(NULL), size(0), owned(false)
+	BinaryBlob() : pointer(NULL), size(0), owned(false), mapped(false)
 	{
 	}
-	BinaryBlob(const char *filename) : pointer(NULL), size(0), owned(false)
+	BinaryBlob(const char *filename) : pointer(NULL), size(0), owned(false), mapped(false)
 	{
 		Load(filename);
 	}
-	BinaryBlob(const char *buffer,int bufsize) : pointer(NULL), size(bufsize), owned(false)
+	BinaryBlob(const char *buffer,int bufsize) : pointer(NULL), size(bufsize), owned(false), mapped(false)
 	{
 		pointer=(unsigned char *)malloc(size);
 		memcpy(pointer,buffer,size);
@@ -30,14 +37,11 @@ class BinaryBlob
 	}
 	virtual ~BinaryBlob()
 	{
-		if(owned && pointer)
-			free(pointer);
+		Free();
 	}
 	virtual unsigned char *Load(const char *filename)
 	{
-		if(owned && pointer)
-			free(pointer);
-		pointer=NULL;
+		Free();
 
 		FILE *f;
 		if(!(f = FOpenUTF8(filename, "rb")))
@@ -49,6 +53,23 @@ class BinaryBlob
 
 		Debug[TRACE] << "Loading binary blob " << filename << " of size: " << size << std::endl;
 
+#ifndef WIN32
+		// The mapping is zero-filled to the end of its last host page, so the rounding
+		// up to a longword below holds for it too.  Fall back to reading the file if
+		// it's empty or can't be mapped.
+		if(size)
+		{
+			void *p=mmap(NULL,size,PROT_READ|PROT_WRITE,MAP_PRIVATE,fileno(f),0);
+			if(p!=MAP_FAILED)
+			{
+				fclose(f);
+				pointer=(unsigned char *)p;
+				owned=mapped=true;
+				return(pointer);
+			}
+		}
+#endif
+
 		pointer=(unsigned char *)malloc((size+3)&~3); 		// HACK - round up to the nearest longword boundary.
 		owned=true;
 		size_t readlen = fread(pointer, 1, size, f);
@@ -85,17 +106,42 @@ class BinaryBlob
 	// free()ing the data when done with it;
 	unsigned char *Relinquish()
 	{
+		if(mapped)
+		{
+			unsigned char *copy=(unsigned char *)malloc((size+3)&~3);
+			memcpy(copy,pointer,size);
+			Free();
+			pointer=copy;
+		}
 		owned=false;
 		return(pointer);
 	}
+	// True if the data is a copy-on-write mapping of the file.
+	bool IsMapped()
+	{
+		return(mapped);
+	}
 	unsigned char &operator[](int idx)
 	{
 		return(pointer[idx]);
 	}
 	protected:
+	void Free()
+	{
+#ifndef WIN32
+		if(mapped)
+			munmap(pointer,size);
+		else
+#endif
+		if(owned && pointer)
+			free(pointer);
+		pointer=NULL;
+		owned=mapped=false;
+	}
 	unsigned char *pointer;
 	size_t size;
 	bool owned;
+	bool mapped;
 };
 
 #endif
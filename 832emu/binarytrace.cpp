@@ -0,0 +1,414 @@
+#include <cstdio>
+#include <cstring>
+
+#include "debug.h"
+#include "util.h"
+#include "binarytrace.h"
+
+
+static inline void put_varint(std::vector<unsigned char> &buf,unsigned int v)
+{
+	while(v>=0x80)
+	{
+		buf.push_back((v&0x7f)|0x80);
+		v>>=7;
+	}
+	buf.push_back(v);
+}
+
+
+static inline void put_zigzag(std::vector<unsigned char> &buf,unsigned int v)
+{
+	int s=v;
+	put_varint(buf,(s<<1)^(s>>31));
+}
+
+
+static inline unsigned int get_varint(const std::vector<unsigned char> &buf,unsigned int &cursor)
+{
+	unsigned int result=0;
+	int shift=0;
+	unsigned char c;
+	do
+	{
+		if(cursor>=buf.size())
+			throw "Truncated trace block";
+		c=buf[cursor++];
+		result|=(c&0x7f)<<shift;
+		shift+=7;
+	} while(c&0x80);
+	return(result);
+}
+
+
+static inline unsigned int get_zigzag(const std::vector<unsigned char> &buf,unsigned int &cursor)
+{
+	unsigned int v=get_varint(buf,cursor);
+	return((v>>1)^(-(v&1)));
+}
+
+
+static void put_state(std::vector<unsigned char> &buf,const EightThirtyTwoTraceState &state)
+{
+	put_varint(buf,state.tick);
+	put_varint(buf,state.nextpc);
+	for(int i=0;i<8;++i)
+		put_varint(buf,state.regs[i]);
+	buf.push_back(state.flags);
+	put_varint(buf,state.memaddr);
+}
+
+
+static void get_state(const std::vector<unsigned char> &buf,unsigned int &cursor,EightThirtyTwoTraceState &state)
+{
+	state.tick=get_varint(buf,cursor);
+	state.nextpc=get_varint(buf,cursor);
+	for(int i=0;i<8;++i)
+		state.regs[i]=get_varint(buf,cursor);
+	if(cursor>=buf.size())
+		throw "Truncated trace block";
+	state.flags=buf[cursor++];
+	state.memaddr=get_varint(buf,cursor);
+}
+
+
+static void write_varint(FILE *f,unsigned int v,unsigned int &offset)
+{
+	while(v>=0x80)
+	{
+		fputc((v&0x7f)|0x80,f);
+		v>>=7;
+		++offset;
+	}
+	fputc(v,f);
+	++offset;
+}
+
+
+static unsigned int read_varint(FILE *f)
+{
+	unsigned int result=0;
+	int shift=0;
+	int c;
+	do
+	{
+		if((c=fgetc(f))==EOF)
+			throw "Truncated trace file";
+		result|=(c&0x7f)<<shift;
+		shift+=7;
+	} while(c&0x80);
+	return(result);
+}
+
+
+EightThirtyTwoBinaryTrace::EightThirtyTwoBinaryTrace(const char *filename,int keyframeinterval,int buffersize)
+	: EightThirtyTwoTrace(buffersize), out(0), keyframeinterval(keyframeinterval), blockcount(0), offset(0), ended(false)
+{
+	if(!(out=FOpenUTF8(filename,"wb")))
+		throw "Can't open trace file";
+	if(this->keyframeinterval<1)
+		this->keyframeinterval=1;
+
+	fwrite("832T",1,4,out);
+	fputc(BINARYTRACE_VERSION,out);
+	offset=5;
+	write_varint(out,this->keyframeinterval,offset);
+
+	memset(&state,0,sizeof(state));
+	keyframe=state;
+}
+
+
+EightThirtyTwoBinaryTrace::~EightThirtyTwoBinaryTrace()
+{
+	if(!ended)
+		End(state.tick);
+	if(out)
+		fclose(out);
+}
+
+
+void EightThirtyTwoBinaryTrace::Write(const EightThirtyTwoTraceRecord *records,int count)
+{
+	for(int i=0;i<count;++i)
+	{
+		const EightThirtyTwoTraceRecord &r=records[i];
+		if(!blockcount)
+		{
+			state.tick=r.tick;
+			keyframe=state;
+			block.clear();
+		}
+
+		unsigned int regs[8];
+		regs[0]=r.temp;
+		for(int j=0;j<7;++j)
+			regs[j+1]=r.regs[j];
+		unsigned char flags=r.flags&(TRACEFLAG_ZERO|TRACEFLAG_CARRY|TRACEFLAG_COND|TRACEFLAG_THREAD2);
+
+		unsigned int header=0;
+		if(r.pc!=state.nextpc)
+			header|=BTREC_PCJUMP;
+		if(r.flags&TRACEFLAG_SKIPPED)
+			header|=BTREC_SKIPPED;
+		if(r.memflags)
+			header|=BTREC_MEM;
+		if(flags!=state.flags)
+			header|=BTREC_FLAGS;
+		for(int j=0;j<8;++j)
+		{
+			if(regs[j]!=state.regs[j])
+				header|=1<<(BTREC_REGSHIFT+j);
+		}
+
+		put_varint(block,header);
+		block.push_back(r.opcode);
+		if(header&BTREC_PCJUMP)
+			put_zigzag(block,r.pc-state.nextpc);
+		if(header&BTREC_FLAGS)
+			block.push_back(flags);
+		for(int j=0;j<8;++j)
+		{
+			if(header&(1<<(BTREC_REGSHIFT+j)))
+				put_zigzag(block,regs[j]-state.regs[j]);
+		}
+		if(header&BTREC_MEM)
+		{
+			block.push_back(r.memflags);
+			put_zigzag(block,r.memaddr-state.memaddr);
+			put_varint(block,r.memvalue);
+			state.memaddr=r.memaddr;
+		}
+
+		state.nextpc=r.pc+1;
+		state.flags=flags;
+		for(int j=0;j<8;++j)
+			state.regs[j]=regs[j];
+		state.tick=r.tick+1;
+
+		if(++blockcount>=keyframeinterval)
+			WriteBlock();
+	}
+}
+
+
+void EightThirtyTwoBinaryTrace::WriteBlock()
+{
+	if(!blockcount)
+		return;
+
+	std::vector<unsigned char> header;
+	put_state(header,keyframe);
+	put_varint(header,blockcount);
+
+	indexticks.push_back(keyframe.tick);
+	indexoffsets.push_back(offset);
+
+	fputc(BINARYTRACE_BLOCK,out);
+	++offset;
+	write_varint(out,header.size()+block.size(),offset);
+	fwrite(&header[0],1,header.size(),out);
+	fwrite(&block[0],1,block.size(),out);
+	offset+=header.size()+block.size();
+
+	blockcount=0;
+	block.clear();
+}
+
+
+void EightThirtyTwoBinaryTrace::End(unsigned int ticks)
+{
+	if(ended)
+		return;
+	Flush();
+	WriteBlock();
+
+	unsigned int indexoffset=offset;
+	fputc(BINARYTRACE_INDEX,out);
+	++offset;
+	write_varint(out,indexticks.size(),offset);
+	for(unsigned int i=0;i<indexticks.size();++i)
+	{
+		write_varint(out,indexticks[i],offset);
+		write_varint(out,indexoffsets[i],offset);
+	}
+	for(int i=0;i<4;++i)
+		fputc((indexoffset>>(i*8))&255,out);
+	fwrite("832I",1,4,out);
+	fflush(out);
+	ended=true;
+	Debug[COMMENT] << "Binary trace: " << std::dec << ticks << " steps in " << offset+8 << " bytes" << std::hex << std::endl;
+}
+
+
+EightThirtyTwoTraceReader::EightThirtyTwoTraceReader(const char *filename)
+	: in(0), keyframeinterval(0), cursor(0), remaining(0), currentblock(-1)
+{
+	if(!(in=FOpenUTF8(filename,"rb")))
+		throw "Can't open trace file";
+
+	char magic[4];
+	if(fread(magic,1,4,in)!=4 || strncmp(magic,"832T",4)!=0)
+		throw "Not an 832 trace file";
+	if(fgetc(in)!=BINARYTRACE_VERSION)
+		throw "Unsupported trace file version";
+	keyframeinterval=read_varint(in);
+	unsigned int start=ftell(in);
+
+	// Use the index if the trace was completed, otherwise scan the blocks.
+	unsigned char trailer[8];
+	bool indexed=false;
+	if(fseek(in,-8,SEEK_END)==0 && fread(trailer,1,8,in)==8 && strncmp((char *)trailer+4,"832I",4)==0)
+	{
+		unsigned int indexoffset=trailer[0]|(trailer[1]<<8)|(trailer[2]<<16)|(trailer[3]<<24);
+		if(fseek(in,indexoffset,SEEK_SET)==0 && fgetc(in)==BINARYTRACE_INDEX)
+		{
+			unsigned int count=read_varint(in);
+			for(unsigned int i=0;i<count;++i)
+			{
+				indexticks.push_back(read_varint(in));
+				indexoffsets.push_back(read_varint(in));
+			}
+			indexed=true;
+		}
+	}
+	if(!indexed)
+	{
+		Debug[WARN] << "Trace file has no index - scanning blocks" << std::endl;
+		BuildIndex(start);
+	}
+	Seek(0);
+}
+
+
+EightThirtyTwoTraceReader::~EightThirtyTwoTraceReader()
+{
+	if(in)
+		fclose(in);
+}
+
+
+void EightThirtyTwoTraceReader::BuildIndex(unsigned int start)
+{
+	fseek(in,start,SEEK_SET);
+	int c;
+	while((c=fgetc(in))==BINARYTRACE_BLOCK)
+	{
+		unsigned int offset=ftell(in)-1;
+		unsigned int len;
+		try
+		{
+			len=read_varint(in);
+			unsigned int payload=ftell(in);
+			unsigned int tick=read_varint(in);
+			indexticks.push_back(tick);
+			indexoffsets.push_back(offset);
+			if(fseek(in,payload+len,SEEK_SET))
+				break;
+		}
+		catch(const char *err)
+		{
+			break;
+		}
+	}
+}
+
+
+bool EightThirtyTwoTraceReader::LoadBlock(int idx)
+{
+	if(idx<0 || idx>=(int)indexoffsets.size())
+		return(false);
+	fseek(in,indexoffsets[idx],SEEK_SET);
+	if(fgetc(in)!=BINARYTRACE_BLOCK)
+		throw "Corrupt trace index";
+	unsigned int len=read_varint(in);
+	block.resize(len);
+	if(fread(&block[0],1,len,in)!=len)
+		return(false);
+	cursor=0;
+	get_state(block,cursor,state);
+	remaining=get_varint(block,cursor);
+	currentblock=idx;
+	return(true);
+}
+
+
+bool EightThirtyTwoTraceReader::Seek(unsigned int tick)
+{
+	if(indexticks.empty())
+		return(false);
+	// Binary search for the last block starting at or before tick.
+	int lo=0;
+	int hi=indexticks.size();
+	while(lo<hi)
+	{
+		int mid=(lo+hi)/2;
+		if(indexticks[mid]<=tick)
+			lo=mid+1;
+		else
+			hi=mid;
+	}
+	if(!LoadBlock(lo>0 ? lo-1 : 0))
+		return(false);
+	EightThirtyTwoTraceRecord r;
+	while(state.tick<tick)
+	{
+		if(!Next(r))
+			return(false);
+	}
+	return(true);
+}
+
+
+bool EightThirtyTwoTraceReader::Next(EightThirtyTwoTraceRecord &r)
+{
+	while(!remaining)
+	{
+		if(!LoadBlock(currentblock+1))
+			return(false);
+	}
+
+	unsigned int header=get_varint(block,cursor);
+	r.opcode=block[cursor++];
+	r.tick=state.tick;
+	r.pc=state.nextpc;
+	if(header&BTREC_PCJUMP)
+		r.pc+=get_zigzag(block,cursor);
+	if(header&BTREC_FLAGS)
+		state.flags=block[cursor++];
+	for(int j=0;j<8;++j)
+	{
+		if(header&(1<<(BTREC_REGSHIFT+j)))
+			state.regs[j]+=get_zigzag(block,cursor);
+	}
+	r.memflags=0;
+	if(header&BTREC_MEM)
+	{
+		r.memflags=block[cursor++];
+		state.memaddr+=get_zigzag(block,cursor);
+		r.memaddr=state.memaddr;
+		r.memvalue=get_varint(block,cursor);
+	}
+	r.temp=state.regs[0];
+	for(int j=0;j<7;++j)
+		r.regs[j]=state.regs[j+1];
+	r.flags=state.flags | ((header&BTREC_SKIPPED) ? TRACEFLAG_SKIPPED : 0);
+
+	state.nextpc=r.pc+1;
+	++state.tick;
+	--remaining;
+	return(true);
+}
+
+
+int EightThirtyTwoTraceReader::GetBlockCount()
+{
+	return(indexticks.size());
+}
+
+
+unsigned int EightThirtyTwoTraceReader::GetKeyframeInterval()
+{
+	return(keyframeinterval);
+}
+
@@ -0,0 +1,92 @@
+#ifndef BINARYTRACE_H
+#define BINARYTRACE_H
+
+#include <cstdio>
+#include <vector>
+
+#include "trace.h"
+
+// Compact binary execution trace.
+//
+// The file begins with the magic "832T", a version byte and the keyframe interval.
+// Records are grouped into blocks, each of which begins with a keyframe holding the
+// full machine state, so that a reader can start decoding at any block.
+// Within a block each record holds only what changed since the previous one:
+// a varint header flagging what follows, the opcode byte, then zigzag-varint deltas
+// for the PC (if execution wasn't sequential), each changed register and the
+// memory address, if the instruction accessed memory.
+// The file ends with an index of block start ticks and offsets, followed by
+// the index offset and the magic "832I", so a reader can seek without scanning.
+
+#define BINARYTRACE_VERSION 1
+#define BINARYTRACE_BLOCK 'K'
+#define BINARYTRACE_INDEX 'I'
+
+// Record header bits
+#define BTREC_PCJUMP 1
+#define BTREC_SKIPPED 2
+#define BTREC_MEM 4
+#define BTREC_FLAGS 8
+#define BTREC_REGSHIFT 4	// Changed-register mask: temp, then r0 - r6
+
+
+// Running state shared by the encoder and decoder.
+
+struct EightThirtyTwoTraceState
+{
+	unsigned int tick;
+	unsigned int nextpc;
+	unsigned int regs[8];	// temp, r0 - r6
+	unsigned int memaddr;
+	unsigned char flags;
+};
+
+
+class EightThirtyTwoBinaryTrace : public EightThirtyTwoTrace
+{
+	public:
+	EightThirtyTwoBinaryTrace(const char *filename,int keyframeinterval=4096,int buffersize=65536);
+	virtual ~EightThirtyTwoBinaryTrace();
+	virtual void End(unsigned int ticks);
+	protected:
+	virtual void Write(const EightThirtyTwoTraceRecord *records,int count);
+	void WriteBlock();
+	FILE *out;
+	int keyframeinterval;
+	EightThirtyTwoTraceState state;
+	EightThirtyTwoTraceState keyframe;
+	std::vector<unsigned char> block;
+	int blockcount;
+	std::vector<unsigned int> indexticks;
+	std::vector<unsigned int> indexoffsets;
+	unsigned int offset;
+	bool ended;
+};
+
+
+class EightThirtyTwoTraceReader
+{
+	public:
+	EightThirtyTwoTraceReader(const char *filename);
+	~EightThirtyTwoTraceReader();
+	// Positions the reader so the next record returned is the one for the given tick.
+	bool Seek(unsigned int tick);
+	bool Next(EightThirtyTwoTraceRecord &record);
+	int GetBlockCount();
+	unsigned int GetKeyframeInterval();
+	protected:
+	bool LoadBlock(int idx);
+	void BuildIndex(unsigned int start);
+	FILE *in;
+	unsigned int keyframeinterval;
+	std::vector<unsigned int> indexticks;
+	std::vector<unsigned int> indexoffsets;
+	std::vector<unsigned char> block;
+	unsigned int cursor;
+	int remaining;
+	int currentblock;
+	EightThirtyTwoTraceState state;
+};
+
+#endif
+
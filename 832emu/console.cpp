@@ -0,0 +1,131 @@
+#include <cstdio>
+#include <cstring>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+
+#include "console.h"
+
+
+EightThirtyTwoConsole::EightThirtyTwoConsole() : infd(0), ownfd(false), ended(false), outlen(0), inpos(0), inlen(0)
+{
+	terminal=isatty(1);
+}
+
+
+EightThirtyTwoConsole::~EightThirtyTwoConsole()
+{
+	Flush();
+	if(ownfd)
+		close(infd);
+}
+
+
+// Opening a FIFO waits for a writer, as reading from it would.
+
+void EightThirtyTwoConsole::SetInput(const char *filename)
+{
+	int fd=open(filename,O_RDONLY);
+	if(fd<0)
+		throw "Can't open the UART input";
+	if(ownfd)
+		close(infd);
+	infd=fd;
+	ownfd=true;
+	ended=false;
+	inpos=inlen=0;
+}
+
+
+void EightThirtyTwoConsole::Write(const char *buf,unsigned int len)
+{
+	if(outlen+len>CONSOLE_BUFSIZE)
+		Flush();
+	if(len>CONSOLE_BUFSIZE)
+	{
+		fwrite(buf,1,len,stdout);
+		fflush(stdout);
+		return;
+	}
+	memcpy(outbuf+outlen,buf,len);
+	outlen+=len;
+	if(terminal && memchr(buf,'\n',len))
+		Flush();
+}
+
+
+// Goes through stdio, so it stays in order with anything else written to stdout.
+
+void EightThirtyTwoConsole::Flush()
+{
+	if(!outlen)
+		return;
+	fwrite(outbuf,1,outlen,stdout);
+	fflush(stdout);
+	outlen=0;
+}
+
+
+// Reads whatever has arrived into the empty input buffer, waiting up to timeout
+// milliseconds for it, or indefinitely if timeout is negative.  Returns true if
+// there's input to take.
+
+bool EightThirtyTwoConsole::Fill(int timeout)
+{
+	if(inpos<inlen)
+		return(true);
+	if(ended)
+		return(false);
+	while(1)
+	{
+		struct pollfd p;
+		p.fd=infd;
+		p.events=POLLIN;
+		p.revents=0;
+		int r=poll(&p,1,timeout);
+		ssize_t n=r>0 ? read(infd,inbuf,CONSOLE_BUFSIZE) : -1;
+		if(n>0)
+		{
+			inpos=0;
+			inlen=n;
+			return(true);
+		}
+		if(n==0 || (r<0 && errno!=EINTR) || (r>0 && errno!=EINTR && errno!=EAGAIN))
+		{
+			ended=true;
+			return(false);
+		}
+		if(timeout>=0)
+			return(false);
+	}
+}
+
+
+int EightThirtyTwoConsole::Get()
+{
+	if(!Fill(0))
+	{
+		// The program may be waiting for a reply to what it's written.
+		Flush();
+		return(-1);
+	}
+	return((unsigned char)inbuf[inpos++]);
+}
+
+
+unsigned int EightThirtyTwoConsole::GetLine(char *buf,unsigned int len)
+{
+	Flush();
+	unsigned int n=0;
+	while(n<len && Fill(-1))
+	{
+		char c=inbuf[inpos++];
+		buf[n++]=c;
+		if(c=='\n')
+			break;
+	}
+	return(n);
+}
+
@@ -0,0 +1,51 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+// The host side of the console UART.  Output collects in a buffer which is
+// written to stdout in large blocks - when it fills, when emulation stops,
+// before waiting for input, and at each newline if stdout is a terminal.
+// Input comes from stdin, or from a file, FIFO or terminal given with
+// SetInput(), and is read in blocks as it arrives: Get() never waits, so a
+// program polling the UART keeps running while there's nothing to read.
+
+#define CONSOLE_BUFSIZE 65536
+
+class EightThirtyTwoConsole
+{
+	public:
+	EightThirtyTwoConsole();
+	~EightThirtyTwoConsole();
+	void SetInput(const char *filename);
+	inline void Put(char c)
+	{
+		outbuf[outlen++]=c;
+		if(outlen==CONSOLE_BUFSIZE || (c=='\n' && terminal))
+			Flush();
+	}
+	void Write(const char *buf,unsigned int len);
+	void Flush();
+	// Returns the next byte of input, or -1 if none has arrived yet.
+	int Get();
+	// Waits for input, and takes up to len bytes of it, stopping after a newline.
+	// Returns zero at the end of input.
+	unsigned int GetLine(char *buf,unsigned int len);
+	// True once the input has ended and everything read has been taken.
+	bool AtEnd()
+	{
+		return(ended && inpos==inlen);
+	}
+	protected:
+	bool Fill(int timeout);
+	int infd;
+	bool ownfd;	// Opened by SetInput(), rather than stdin
+	bool ended;
+	bool terminal;	// stdout is a terminal
+	unsigned int outlen;
+	unsigned int inpos;
+	unsigned int inlen;
+	char outbuf[CONSOLE_BUFSIZE];
+	char inbuf[CONSOLE_BUFSIZE];
+};
+
+#endif
+
@@ -0,0 +1,219 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "util.h"
+#include "coverage.h"
+
+
+EightThirtyTwoCoverage::EightThirtyTwoCoverage() : pages(0)
+{
+	pages=new unsigned char *[COVERAGE_PAGES];
+	memset(pages,0,sizeof(unsigned char *)*COVERAGE_PAGES);
+}
+
+
+EightThirtyTwoCoverage::~EightThirtyTwoCoverage()
+{
+	Clear();
+	delete[] pages;
+}
+
+
+void EightThirtyTwoCoverage::Clear()
+{
+	for(int i=0;i<COVERAGE_PAGES;++i)
+	{
+		if(pages[i])
+			delete[] pages[i];
+		pages[i]=0;
+	}
+}
+
+
+unsigned char *EightThirtyTwoCoverage::AllocPage(unsigned int pc)
+{
+	unsigned char *page=new unsigned char[COVERAGE_PAGESIZE/8];
+	memset(page,0,COVERAGE_PAGESIZE/8);
+	pages[(pc>>COVERAGE_PAGEBITS)&(COVERAGE_PAGES-1)]=page;
+	return(page);
+}
+
+
+bool EightThirtyTwoCoverage::IsCovered(unsigned int addr)
+{
+	unsigned char *page=pages[(addr>>COVERAGE_PAGEBITS)&(COVERAGE_PAGES-1)];
+	addr&=COVERAGE_PAGESIZE-1;
+	return(page && (page[addr>>3]&(1<<(addr&7))));
+}
+
+
+// Addresses beyond the program counter's range are never covered.
+
+unsigned int EightThirtyTwoCoverage::Count(unsigned int start,unsigned int end)
+{
+	if(end>1U<<COVERAGE_ADDRBITS)
+		end=1U<<COVERAGE_ADDRBITS;
+	unsigned int count=0;
+	while(start<end)
+	{
+		unsigned char *page=pages[start>>COVERAGE_PAGEBITS];
+		unsigned int pageend=(start|(COVERAGE_PAGESIZE-1))+1;
+		if(pageend>end)
+			pageend=end;
+		for(;page && start<pageend;++start)
+		{
+			unsigned int a=start&(COVERAGE_PAGESIZE-1);
+			if(page[a>>3]&(1<<(a&7)))
+				++count;
+		}
+		start=pageend;
+	}
+	return(count);
+}
+
+
+unsigned int EightThirtyTwoCoverage::LastCovered(unsigned int start,unsigned int end)
+{
+	if(end>1U<<COVERAGE_ADDRBITS)
+		end=1U<<COVERAGE_ADDRBITS;
+	unsigned int last=start;
+	while(start<end)
+	{
+		unsigned char *page=pages[start>>COVERAGE_PAGEBITS];
+		unsigned int pageend=(start|(COVERAGE_PAGESIZE-1))+1;
+		if(pageend>end)
+			pageend=end;
+		for(;page && start<pageend;++start)
+		{
+			unsigned int a=start&(COVERAGE_PAGESIZE-1);
+			if(page[a>>3]&(1<<(a&7)))
+				last=start;
+		}
+		start=pageend;
+	}
+	return(last);
+}
+
+
+void EightThirtyTwoCoverage::Save(const char *filename)
+{
+	FILE *f;
+	if(!(f=FOpenUTF8(filename,"wb")))
+		throw "Can't create coverage file";
+	fwrite("832C",1,4,f);
+	fputc(COVERAGE_VERSION,f);
+	for(int i=0;i<COVERAGE_PAGES;++i)
+	{
+		if(!pages[i])
+			continue;
+		unsigned char header[4]={(unsigned char)i,(unsigned char)(i>>8),(unsigned char)(i>>16),(unsigned char)(i>>24)};
+		if(fwrite(header,1,4,f)!=4 || fwrite(pages[i],1,COVERAGE_PAGESIZE/8,f)!=COVERAGE_PAGESIZE/8)
+		{
+			fclose(f);
+			throw "Can't write coverage file";
+		}
+	}
+	fclose(f);
+}
+
+
+void EightThirtyTwoCoverage::Load(const char *filename)
+{
+	FILE *f;
+	if(!(f=FOpenUTF8(filename,"rb")))
+		throw "Can't open coverage file";
+	char magic[4];
+	if(fread(magic,1,4,f)!=4 || strncmp(magic,"832C",4)!=0)
+	{
+		fclose(f);
+		throw "Not an 832 coverage file";
+	}
+	if(fgetc(f)!=COVERAGE_VERSION)
+	{
+		fclose(f);
+		throw "Unsupported coverage file version";
+	}
+	unsigned char header[4];
+	unsigned char bits[COVERAGE_PAGESIZE/8];
+	while(fread(header,1,4,f)==4)
+	{
+		unsigned int p=header[0]|(header[1]<<8)|(header[2]<<16)|(header[3]<<24);
+		if(p>=COVERAGE_PAGES || fread(bits,1,COVERAGE_PAGESIZE/8,f)!=COVERAGE_PAGESIZE/8)
+		{
+			fclose(f);
+			throw "Coverage file is truncated";
+		}
+		unsigned char *page=pages[p];
+		if(!page)
+			page=AllocPage(p<<COVERAGE_PAGEBITS);
+		for(int i=0;i<COVERAGE_PAGESIZE/8;++i)
+			page[i]|=bits[i];
+	}
+	fclose(f);
+}
+
+
+bool EightThirtyTwoCoverage::IsCoverageFile(const char *filename)
+{
+	FILE *f;
+	if(!(f=FOpenUTF8(filename,"rb")))
+		return(false);
+	char magic[4];
+	bool result=fread(magic,1,4,f)==4 && strncmp(magic,"832C",4)==0;
+	fclose(f);
+	return(result);
+}
+
+
+// A function runs until the next function or the end of its section.  If
+// neither is known it's taken to end after the last byte covered.
+// Maps without sections are assumed to hold nothing but code.
+
+void EightThirtyTwoCoverage::Report(FILE *out,EightThirtyTwoSymbolMap &symbols)
+{
+	struct Entry
+	{
+		int symbol;
+		unsigned int bytes;
+		unsigned int covered;
+	};
+	std::vector<Entry> entries;
+	unsigned int bytes=0;
+	unsigned int covered=0;
+	int reached=0;
+	for(int i=0;i<symbols.GetCount();++i)
+	{
+		const EightThirtyTwoSymbol &sym=symbols[i];
+		if(sym.local || (sym.section>=0 && !symbols.IsCode(sym.section)))
+			continue;
+		// Where several functions share an address, report the first.
+		if(!entries.empty() && symbols[entries.back().symbol].address==sym.address)
+			continue;
+		unsigned int end=symbols.FunctionEnd(i);
+		if(sym.section>=0 && symbols.SectionEnd(sym.section)<end)
+			end=symbols.SectionEnd(sym.section);
+		if(end==0xffffffff)
+			end=LastCovered(sym.address,end)+1;
+		Entry e;
+		e.symbol=i;
+		e.bytes=end-sym.address;
+		e.covered=Count(sym.address,end);
+		entries.push_back(e);
+		bytes+=e.bytes;
+		covered+=e.covered;
+		if(e.covered)
+			++reached;
+	}
+
+	fprintf(out,"\nCoverage: %u of %u bytes of code reached (%.2f%%), in %d of %d functions\n",
+		covered,bytes,bytes ? 100.0*covered/bytes : 0.0,reached,int(entries.size()));
+	fprintf(out,"\n %%cover     reached       bytes  function\n");
+	for(unsigned int i=0;i<entries.size();++i)
+	{
+		const Entry &e=entries[i];
+		fprintf(out,"%7.2f  %10u  %10u  %s\n",e.bytes ? 100.0*e.covered/e.bytes : 0.0,e.covered,e.bytes,
+			symbols[e.symbol].name.c_str());
+	}
+}
+
@@ -0,0 +1,57 @@
+#ifndef COVERAGE_H
+#define COVERAGE_H
+
+#include <cstdio>
+
+#include "mapfile.h"
+
+// Code coverage: one bit for each byte of code, set once the CPU has reached
+// it, whether or not cond let it execute.  The emulator marks code as it's
+// decoded, which happens once per byte unless the code is overwritten, so
+// collecting coverage costs nothing once a program's code has been seen.
+// Bits are kept in pages covering the 30-bit program counter space, which are
+// allocated the first time code is reached in them.
+//
+// The file begins with the magic "832C" and a version byte, followed by each
+// page with any bits set: its number as a 32-bit little-endian value, then
+// COVERAGE_PAGESIZE/8 bytes of bits, the lowest address in bit 0 of the first.
+
+#define COVERAGE_VERSION 1
+#define COVERAGE_PAGEBITS 12
+#define COVERAGE_PAGESIZE (1<<COVERAGE_PAGEBITS)
+#define COVERAGE_ADDRBITS 30
+#define COVERAGE_PAGES (1<<(COVERAGE_ADDRBITS-COVERAGE_PAGEBITS))
+
+class EightThirtyTwoCoverage
+{
+	public:
+	EightThirtyTwoCoverage();
+	~EightThirtyTwoCoverage();
+	void Clear();
+	inline void Mark(unsigned int pc)
+	{
+		unsigned char *page=pages[(pc>>COVERAGE_PAGEBITS)&(COVERAGE_PAGES-1)];
+		if(!page)
+			page=AllocPage(pc);
+		pc&=COVERAGE_PAGESIZE-1;
+		page[pc>>3]|=1<<(pc&7);
+	}
+	bool IsCovered(unsigned int addr);
+	// The number of bytes covered from start up to, but not including, end.
+	unsigned int Count(unsigned int start,unsigned int end);
+	// The highest address covered below end, or start if there's none.
+	unsigned int LastCovered(unsigned int start,unsigned int end);
+	void Save(const char *filename);
+	// Merges the bitmap in a file written by Save() with this one.
+	void Load(const char *filename);
+	// True if the file starts with a coverage bitmap's magic.
+	static bool IsCoverageFile(const char *filename);
+	// Prints the bytes covered in each function in a code section, in address order.
+	void Report(FILE *out,EightThirtyTwoSymbolMap &symbols);
+	protected:
+	unsigned char *AllocPage(unsigned int pc);
+	unsigned char **pages;
+};
+
+#endif
+
@@ -33,6 +33,12 @@ DebugLevel DebugStream::SetLevel(enum DebugLevel lvl)
 }
 
 
+DebugLevel DebugStream::GetLevel()
+{
+	return(level);
+}
+
+
 void DebugStream::PushLevel(enum DebugLevel lvl)
 {
 	levelstack.push(level);
@@ -60,5 +66,5 @@ ostream &DebugStream::operator[](int idx)
 		return(cerr);
 }
 
-DebugStream Debug;
+thread_local DebugStream Debug;
 
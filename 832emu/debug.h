@@ -37,6 +37,7 @@ class DebugStream
 	virtual ~DebugStream();
 	virtual void SetLogFile(std::string filename);
 	virtual	DebugLevel SetLevel(enum DebugLevel lvl);  // returns the old level
+	virtual DebugLevel GetLevel();
 	virtual void PushLevel(enum DebugLevel lvl);	// Use PushLevel() and PopLevel() if you want to change
 	virtual void PopLevel();						// the debug level for a specific section of code, and restore afterwards.
 	virtual std::ostream &operator[](int idx);
@@ -47,7 +48,8 @@ class DebugStream
 	hack_ostream logfile;
 };
 
-extern DebugStream Debug;
+// Each thread has its own, so that emulators can run in parallel.
+extern thread_local DebugStream Debug;
 
 
 class DebugTracer	// A tracer using RAII semantics; the debug level will be restored when this goes out of scope.
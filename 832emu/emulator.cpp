@@ -0,0 +1,83 @@
+#include "emulator.h"
+
+
+const EightThirtyTwoOp EightThirtyTwoExecute[HANDLER_COUNT]=
+{
+	EightThirtyTwoEmu::Op_decode,
+	EightThirtyTwoEmu::Op_li,
+	EightThirtyTwoEmu::Op_hlf,
+	EightThirtyTwoEmu::Op_byt,
+	EightThirtyTwoEmu::Op_sgn,
+	EightThirtyTwoEmu::Op_ldt,
+	EightThirtyTwoEmu::Op_sig,
+	EightThirtyTwoEmu::Op_break,
+	EightThirtyTwoEmu::Op_lichain,
+	EightThirtyTwoEmu::Op_lijump,
+	EightThirtyTwoEmu::Op_liaddt,
+	EightThirtyTwoEmu::Op_lildt,
+	EightThirtyTwoEmu::Op_cond,
+	EightThirtyTwoEmu::Op_exg,
+	EightThirtyTwoEmu::Op_ldbinc,
+	EightThirtyTwoEmu::Op_stdec,
+	EightThirtyTwoEmu::Op_ldinc,
+	EightThirtyTwoEmu::Op_shr,
+	EightThirtyTwoEmu::Op_shl,
+	EightThirtyTwoEmu::Op_ror,
+	EightThirtyTwoEmu::Op_stinc,
+	EightThirtyTwoEmu::Op_mr,
+	EightThirtyTwoEmu::Op_stbinc,
+	EightThirtyTwoEmu::Op_stmpdec,
+	EightThirtyTwoEmu::Op_ldidx,
+	EightThirtyTwoEmu::Op_ld,
+	EightThirtyTwoEmu::Op_mt,
+	EightThirtyTwoEmu::Op_st,
+	EightThirtyTwoEmu::Op_add,
+	EightThirtyTwoEmu::Op_sub,
+	EightThirtyTwoEmu::Op_mul,
+	EightThirtyTwoEmu::Op_and,
+	EightThirtyTwoEmu::Op_addt,
+	EightThirtyTwoEmu::Op_cmp,
+	EightThirtyTwoEmu::Op_or,
+	EightThirtyTwoEmu::Op_xor
+};
+
+const EightThirtyTwoOp EightThirtyTwoSkip[HANDLER_COUNT]=
+{
+	EightThirtyTwoEmu::Op_decode,
+	EightThirtyTwoEmu::Op_skip,	// li
+	EightThirtyTwoEmu::Op_skip,	// hlf
+	EightThirtyTwoEmu::Op_skip,	// byt
+	EightThirtyTwoEmu::Op_skip,	// sgn
+	EightThirtyTwoEmu::Op_skip,	// ldt
+	EightThirtyTwoEmu::Op_skip,	// sig
+	EightThirtyTwoEmu::Op_break,
+	EightThirtyTwoEmu::Op_skip,	// li chain
+	EightThirtyTwoEmu::Op_skip,	// li, add r7
+	EightThirtyTwoEmu::Op_skip,	// li, addt r7
+	EightThirtyTwoEmu::Op_skip,	// li, ldt
+	EightThirtyTwoEmu::Op_skipcond,
+	EightThirtyTwoEmu::Op_skipr7,	// exg
+	EightThirtyTwoEmu::Op_skip,	// ldbinc
+	EightThirtyTwoEmu::Op_skip,	// stdec
+	EightThirtyTwoEmu::Op_skip,	// ldinc
+	EightThirtyTwoEmu::Op_skip,	// shr
+	EightThirtyTwoEmu::Op_skip,	// shl
+	EightThirtyTwoEmu::Op_skip,	// ror
+	EightThirtyTwoEmu::Op_skip,	// stinc
+	EightThirtyTwoEmu::Op_skipr7,	// mr
+	EightThirtyTwoEmu::Op_skip,	// stbinc
+	EightThirtyTwoEmu::Op_skip,	// stmpdec
+	EightThirtyTwoEmu::Op_skip,	// ldidx
+	EightThirtyTwoEmu::Op_skip,	// ld
+	EightThirtyTwoEmu::Op_skip,	// mt
+	EightThirtyTwoEmu::Op_skip,	// st
+	EightThirtyTwoEmu::Op_skipr7,	// add
+	EightThirtyTwoEmu::Op_skipr7,	// sub
+	EightThirtyTwoEmu::Op_skip,	// mul
+	EightThirtyTwoEmu::Op_skip,	// and
+	EightThirtyTwoEmu::Op_skipr7,	// addt
+	EightThirtyTwoEmu::Op_skip,	// cmp
+	EightThirtyTwoEmu::Op_skip,	// or
+	EightThirtyTwoEmu::Op_skip	// xor
+};
+
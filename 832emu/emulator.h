@@ -0,0 +1,1984 @@
+#ifndef EMULATOR_H
+#define EMULATOR_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <set>
+#include <climits>
+#include <cstring>
+
+#include "debug.h"
+#include "memorymap.h"
+
+#include "832opcodes.h"
+#include "predecode.h"
+#include "trace.h"
+#include "binarytrace.h"
+#include "jit.h"
+#include "pipeline.h"
+#include "mapfile.h"
+#include "profile.h"
+#include "stats.h"
+#include "coverage.h"
+#include "history.h"
+
+/* Note: Emulator is not currently useful since I'm using the CPU in little-endian mode and the
+   emulator only supports big-endian mode! */
+
+#define STACKSIZE 1024
+#define STACKTOP 0x800000	// Initial stack pointer, relative to the stack offset
+
+#define CHECKPOINT_MAGIC 0x33384b43	// "CK83"
+#define CHECKPOINT_VERSION 1
+
+#define SKIP_MAXLOOP 64	// The longest loop, in bytes, checked for busy-waiting
+#define SKIP_MISSES 8	// Iterations in a row which weren't idle before a loop is no longer checked
+
+// Register numbers for GetRegister() and SetRegister(), following r0 - r7.
+#define EMU_REG_TMP 8
+#define EMU_REG_ZERO 9
+#define EMU_REG_CARRY 10
+#define EMU_REG_COND 11
+#define EMU_REG_COUNT 12
+
+
+// The architectural state of a thread, swapped in and out of the emulator in dual-thread mode.
+
+struct EightThirtyTwoContext
+{
+	unsigned int regfile[8];
+	unsigned int temp;
+	int zero;
+	int carry;
+	int cond;
+	bool immediate_continuation;
+	enum e32size sizemod;
+	bool sign_mod;
+};
+
+
+class EightThirtyTwoEmu;
+
+// Instruction handlers, indexed by EightThirtyTwoHandler.  One table is used
+// when execution is enabled, the other when instructions are being skipped by cond.
+typedef void (*EightThirtyTwoOp)(EightThirtyTwoEmu &emu,int operand);
+extern const EightThirtyTwoOp EightThirtyTwoExecute[HANDLER_COUNT];
+extern const EightThirtyTwoOp EightThirtyTwoSkip[HANDLER_COUNT];
+
+
+class EightThirtyTwoEmu : public EightThirtyTwoClock
+{
+	public:
+	EightThirtyTwoEmu() : initpc(0), steps(-1), endian(LITTLEENDIAN), prg(0), trace(0), memorymap(0), stackoffset(0), jit(0), usejit(false), usefusion(true), useskip(true), skipidle(false), dualthread(false), timed(false), thread(0), frequency(100), uartbaud(0), uartfifo(1), exited(false), exitstatus(0), profile(0), callgraph(0), callgraphfile(0), stats(0), statsfile(0), coverage(0), coveragefile(0), history(0), replaying(false), checkpointfile(0), restorefile(0), stopat(0), breaking(false), resuming(false), resumepc(0), watchstopped(false)
+	{
+		temp=0;
+		regfile[0]=0;
+		regfile[1]=0;
+		regfile[2]=0;
+		regfile[3]=0;
+		regfile[4]=0;
+		regfile[5]=0;
+		regfile[6]=0;
+	}
+
+	virtual ~EightThirtyTwoEmu()
+	{
+		if(jit)
+			delete jit;
+		if(trace)
+			delete trace;
+		if(profile)
+			delete profile;
+		if(callgraph)
+			delete callgraph;
+		if(stats)
+			delete stats;
+		if(coverage)
+			delete coverage;
+		if(history)
+			delete history;
+	}
+
+	int GetOpcode(EightThirtyTwoMemory &prg, int pc)
+	{
+		return(prg.Peek(pc));
+	}
+
+
+	// Puts the CPU into its reset state, ready to run the program in prg.
+
+	void Reset(EightThirtyTwoMemory &prg)
+	{
+		for(int i=0;i<7;++i)
+			regfile[i]=0;
+		regfile[7]=initpc;
+		regfile[6]=stackoffset+STACKTOP;
+		zero=0; carry=0;
+		cond=1;
+
+		this->prg=&prg;
+		prg.SetClock(this,frequency*1000000);
+		prg.SetUARTTiming(uartbaud,uartfifo);
+		idle=0;
+		paused=false;
+		exited=false;
+		exitstatus=0;
+		interrupting=false;
+		watching=false;
+		interrupts=0;
+		limit=INT_MAX;
+		stores=0;
+		skipped=0;
+		loophead=~0U;
+		loopmisses=0;
+		backedge=~0U;
+		spinning=false;
+		codecache.Clear();
+		if(jit)
+		{
+			delete jit;
+			jit=0;
+		}
+		immediate_continuation=false;
+		sizemod=WORD;
+		sign_mod=false;
+		tick=0;
+		// Traces record every instruction, and the pipeline model needs each
+		// instruction's opcode, so don't fuse them.
+		pipelined=dualthread || timed;
+		fuse=usefusion && !trace && !pipelined && !profile && !stats;
+		profilenext[0]=profilenext[1]=initpc;
+		if(profile)
+			profile->Clear();
+		if(stats)
+			stats->Clear();
+		if(coverage)
+			coverage->Clear();
+		if(history)
+		{
+			if(trace || pipelined || profile || stats)
+				throw "Reverse execution isn't supported with tracing, profiling, statistics or the pipeline model";
+			history->Clear();
+		}
+		for(int i=0;i<HANDLER_FULL-HANDLER_FUSED;++i)
+			fused[i]=0;
+
+		if(dualthread && (checkpointfile || restorefile || stopat))
+			throw "Checkpoints aren't supported in dual-thread mode";
+		stopping=stopat!=0;
+		if(stopat && !symbols.Resolve(stopat,stopaddr))
+			throw "Can't find the stop address - use -m to read symbols";
+		// Breakpoints are flags in the decode cache, which has just been cleared.
+		breakpoints.clear();
+		breaking=false;
+		resuming=false;
+		if(stopping)
+			SetBreakpoint(stopaddr);
+		for(unsigned int i=0;i<breakat.size();++i)
+		{
+			unsigned int addr;
+			if(!symbols.Resolve(breakat[i],addr))
+				throw "Can't find the breakpoint address - use -m to read symbols";
+			SetBreakpoint(addr);
+		}
+		prg.ClearWatchpoints();
+		for(unsigned int i=0;i<watchat.size();++i)
+			AddWatchpoint(watchat[i]);
+		restoredcycles=0;
+		if(restorefile)
+			RestoreCheckpoint(restorefile);
+	}
+
+	// Runs up to count instructions, for embedding - see lib832emu.h.  Returns the
+	// number executed, which is fewer if the CPU pauses with nothing to wake it.
+
+	int Advance(int count)
+	{
+		// Move the instruction count into the idle time before it can overflow,
+		// leaving emulated time unchanged.
+		if(tick>INT_MAX/2 && !pipelined)
+		{
+			idle+=tick;
+			tick=0;
+		}
+		if(count>INT_MAX-tick)
+			count=INT_MAX-tick;
+		int start=tick;
+		steps=tick+count;
+		Execute();
+		return(tick-start);
+	}
+
+	// Registers are numbered as in EMU_REG_*.
+
+	unsigned int GetRegister(int r)
+	{
+		switch(r)
+		{
+			case EMU_REG_TMP:
+				return(temp);
+			case EMU_REG_ZERO:
+				return(zero);
+			case EMU_REG_CARRY:
+				return(carry);
+			case EMU_REG_COND:
+				return(cond);
+			default:
+				return(regfile[r&7]);
+		}
+	}
+
+	void SetRegister(int r,unsigned int v)
+	{
+		if(history)
+			history->Clear();
+		switch(r)
+		{
+			case EMU_REG_TMP:
+				temp=v;
+				break;
+			case EMU_REG_ZERO:
+				zero=v!=0;
+				break;
+			case EMU_REG_CARRY:
+				carry=v!=0;
+				break;
+			case EMU_REG_COND:
+				cond=v!=0;
+				break;
+			default:
+				regfile[r&7]=v;
+				break;
+		}
+	}
+
+	// Breakpoints stop execution before the instruction at an address is reached,
+	// whether or not cond lets it execute.  Each is a flag in the decode cache
+	// which makes the address decode as HANDLER_BREAK, so the run loops pay
+	// nothing for them until one is hit.  Reset() replaces any breakpoints with
+	// those given by the options.
+
+	void SetBreakpoint(unsigned int addr)
+	{
+		addr&=PC_MASK;
+		breakpoints.insert(addr);
+		breaking=true;
+		codecache[addr].flags|=DECODEFLAG_BREAK;
+		InvalidateCode(addr,1);
+	}
+
+	void ClearBreakpoint(unsigned int addr)
+	{
+		addr&=PC_MASK;
+		if(!breakpoints.erase(addr))
+			return;
+		breaking=!breakpoints.empty();
+		codecache[addr].flags&=~DECODEFLAG_BREAK;
+		InvalidateCode(addr,1);
+	}
+
+	// Watches a range given as start[,end][:r|w|rw], where either address may be
+	// a symbol.  The end isn't included; without one, a word is watched.  Writes
+	// are watched unless the suffix says otherwise.
+
+	void AddWatchpoint(const char *spec)
+	{
+		std::string range=spec;
+		int flags=WATCH_WRITE;
+		size_t colon=range.find(':');
+		if(colon!=std::string::npos)
+		{
+			std::string access=range.substr(colon+1);
+			range=range.substr(0,colon);
+			if(access=="r")
+				flags=WATCH_READ;
+			else if(access=="rw")
+				flags=WATCH_READ|WATCH_WRITE;
+			else if(access!="w")
+				throw "Watchpoint access must be r, w or rw";
+		}
+		unsigned int start,end;
+		size_t comma=range.find(',');
+		if(!symbols.Resolve(range.substr(0,comma).c_str(),start))
+			throw "Can't find the watchpoint address - use -m to read symbols";
+		end=start+4;
+		if(comma!=std::string::npos && !symbols.Resolve(range.substr(comma+1).c_str(),end))
+			throw "Can't find the watchpoint address - use -m to read symbols";
+		prg->AddWatchpoint(start,end,flags);
+	}
+
+	// True if the last Execute() or Advance() ended at a breakpoint or watchpoint.
+	bool IsStopped()
+	{
+		return(stopped);
+	}
+
+	// Returns true, and fills in hit, if it ended at a watchpoint.
+	bool GetWatchStop(EightThirtyTwoWatchHit &hit)
+	{
+		hit=lastwatch;
+		return(watchstopped);
+	}
+
+	// Discards code decoded or translated from memory which has been changed
+	// other than by the CPU, and the history, which no longer leads here.
+
+	void MemoryChanged(unsigned int addr,unsigned int len)
+	{
+		if(history)
+			history->Clear();
+		InvalidateCode(addr,len);
+	}
+
+	e32endian GetEndian()
+	{
+		return(endian);
+	}
+
+	void SetEndian(e32endian e)
+	{
+		endian=e;
+	}
+
+	void SetJIT(bool enable)
+	{
+		usejit=enable;
+	}
+
+	// The clock frequency in MHz, for the timers.  Takes effect at the next Reset().
+	void SetClock(int mhz)
+	{
+		frequency=mhz;
+	}
+
+	// Translated code doesn't return to the interpreter after each memory access,
+	// so watchpoints are left to the interpreter.  Coverage is too, since the
+	// translator decodes code ahead of its execution, and so is recording history.
+
+	void Execute()
+	{
+		stopped=false;
+		watchstopped=false;
+		spinning=false;
+		loophead=~0U;
+		backedge=~0U;
+		if(resuming && (regfile[7]&PC_MASK)!=resumepc)
+			resuming=false;
+		// Busy-wait loops are only skipped by the fast loops and the pipeline model,
+		// and never while there are breakpoints or watchpoints, so a debugger sees
+		// every iteration.
+		skipidle=useskip && !trace && !history && !profile && !stats
+			&& !breaking && !prg->HasWatchpoints();
+		if(pipelined)
+			RunPipelined();
+		else if(trace)
+			RunTraced();
+		else if(history)
+			RunRecorded();
+		else if(profile || stats)
+			RunInstrumented();
+		else if(usejit && !prg->HasWatchpoints() && !coverage)
+		{
+			if(!jit)
+				CreateJIT();
+			if(jit->IsAvailable())
+				RunJIT();
+			else
+				RunFast();
+		}
+		else
+			RunFast();
+		prg->FlushUART();
+	}
+
+	void CreateJIT()
+	{
+		EightThirtyTwoJITLayout layout;
+		layout.regfile=(char *)regfile-(char *)this;
+		layout.temp=(char *)&temp-(char *)this;
+		layout.zero=(char *)&zero-(char *)this;
+		layout.carry=(char *)&carry-(char *)this;
+		layout.cond=(char *)&cond-(char *)this;
+		layout.tick=(char *)&tick-(char *)this;
+		layout.sizemod=(char *)&sizemod-(char *)this;
+		layout.sign_mod=(char *)&sign_mod-(char *)this;
+		layout.immediate_continuation=(char *)&immediate_continuation-(char *)this;
+		layout.read=JITRead;
+		layout.write=JITWrite;
+		jit=new EightThirtyTwoJIT(layout,*prg,codecache);
+	}
+
+	inline void Step()
+	{
+		unsigned int pc=regfile[7]&PC_MASK;
+		EightThirtyTwoDecoded &d=codecache[pc];
+		regfile[7]=pc+1;
+
+		if(cond) // is execution enabled?
+		{
+			if(d.handler>=HANDLER_FULL)
+				immediate_continuation=false;
+			EightThirtyTwoExecute[d.handler](*this,d.operand);
+		}
+		else
+			EightThirtyTwoSkip[d.handler](*this,d.operand);
+	}
+
+	// Emulated time, for the timers.  Unless the pipeline is modelled each
+	// instruction takes a cycle, plus any time spent paused waiting for an interrupt.
+
+	virtual unsigned long long GetCycles()
+	{
+		if(pipelined)
+			return(pipeline.GetCycles());
+		return(idle+(unsigned int)tick);
+	}
+
+	// A device needs attention sooner than expected, so return to Service()
+	// after the current instruction.
+	virtual void Reschedule()
+	{
+		limit=0;
+	}
+
+	// Memory filled by a host call is treated like memory changed by the debugger.
+	virtual void HostCall(unsigned int addr,unsigned int len)
+	{
+		MemoryChanged(addr,len);
+		limit=0;
+	}
+
+	virtual void Exit(int status)
+	{
+		Debug[COMMENT] << std::endl << "Program exited with status " << std::dec << status << std::hex << std::endl;
+		exited=true;
+		exitstatus=status;
+		limit=0;
+	}
+
+	// True once the program has ended through the semihosting exit call.
+	bool HasExited()
+	{
+		return(exited);
+	}
+
+	int GetExitStatus()
+	{
+		return(exitstatus);
+	}
+
+	// Called between runs of instructions: updates devices whose events are due,
+	// takes interrupts, waits for an interrupt while paused by cond NEX, and sets
+	// limit to the tick at which to return here.  Returns false when emulation
+	// should stop - at the step limit, a breakpoint or watchpoint, when paused
+	// with nothing to wake the CPU, once the program has exited, or once it's
+	// stuck in a loop which nothing can end.
+
+	bool Service()
+	{
+		if(stopped || Watched() || exited || spinning)
+			return(false);
+		while(steps<0 || tick<steps)
+		{
+			if(prg->IsScheduled() && prg->GetNextEvent()<=GetCycles())
+				prg->Update();
+			bool irq=prg->GetInterrupt();
+			if(!irq)
+				interrupting=false;
+			else
+			{
+				paused=false;
+				if(!interrupting && watching && watchcond && cond
+						&& Interruptible(GetOpcode(*prg,watchpc),GetOpcode(*prg,regfile[7]&PC_MASK)))
+				{
+					TakeInterrupt();
+					++idle;
+				}
+			}
+			if(paused)
+			{
+				if(!prg->IsScheduled())
+				{
+					Debug[COMMENT] << "CPU paused with no interrupt pending" << std::endl;
+					return(false);
+				}
+				idle+=prg->GetNextEvent()-GetCycles();
+				continue;
+			}
+			limit=steps<0 ? INT_MAX : steps;
+			watching=false;
+			if(irq && !interrupting)
+			{
+				// Check before every instruction until the interrupt can be taken.
+				watching=true;
+				watchpc=regfile[7]&PC_MASK;
+				watchcond=cond;
+				limit=tick+1;
+			}
+			else if(prg->IsScheduled())
+			{
+				unsigned long long wait=prg->GetNextEvent()-GetCycles();
+				if(wait<(unsigned int)(limit-tick))
+					limit=tick+wait;
+			}
+			// Devices may have changed, so a busy-wait loop has to be seen anew.
+			loophead=~0U;
+			return(true);
+		}
+		return(false);
+	}
+
+	// The CPU replaces an instruction with the interrupt only if it's mt or li,
+	// which don't need the old contents of tmp, and the previous instruction was
+	// executed and wasn't li, cond or a write to r7.
+
+	static bool Interruptible(int prev,int next)
+	{
+		if((next&0xc0)!=opc_li && (next&0xf8)!=opc_mt)
+			return(false);
+		if((prev&0xc0)==opc_li || (prev&0xf8)==opc_cond)
+			return(false);
+		if((prev&7)==7 && ((prev&0xf8)<=opc_stbinc || (prev&0xf8)==opc_add || (prev&0xf8)==opc_sub))
+			return(false);
+		return(true);
+	}
+
+	// The interrupt xors r7 with itself: the PC goes to tmp, with the flags in its
+	// top two bits, execution continues from zero and the zero flag is set.  The
+	// handler returns to tmp-1, re-executing the replaced instruction.
+
+	void TakeInterrupt()
+	{
+		temp=((regfile[7]&PC_MASK)+1)|(zero<<31)|(carry<<30);
+		regfile[7]=0;
+		zero=1;
+		interrupting=true;
+		watching=false;
+		++interrupts;
+		Debug[COMMENT] << std::endl << "Interrupt, returning to " << (temp&PC_MASK)-1 << std::endl;
+	}
+
+	// The untraced loop does nothing beyond executing instructions and counting steps.
+
+	void RunFast()
+	{
+		while(Service())
+		{
+			do
+			{
+				Step();
+				++tick;
+			} while(tick<limit);
+		}
+	}
+
+	// Translated blocks are only looked up where control has been transferred,
+	// or where a previous block left off, and only if the block can start
+	// from the default state - see jit.h.
+
+	void RunJIT()
+	{
+		bool boundary=true;
+		while(Service())
+		{
+			do
+			{
+				unsigned int pc=regfile[7]&PC_MASK;
+				if(boundary && cond && !immediate_continuation && sizemod==WORD && !sign_mod)
+				{
+					EightThirtyTwoJITBlock *b=jit->Lookup(pc);
+					if(b && tick+b->maxticks<=limit)
+					{
+						b->code(this);
+						if(skipidle && (regfile[7]&PC_MASK)==pc)
+							LoopBack(pc,tick);
+						continue;
+					}
+				}
+				Step();
+				++tick;
+				boundary=regfile[7]!=pc+1;
+			} while(tick<limit);
+		}
+	}
+
+	void RunTraced()
+	{
+		while(Service())
+		{
+			do
+			{
+				unsigned int pc=regfile[7]&PC_MASK;
+				if(AtBreakpoint(pc))
+				{
+					Break(pc);
+					trace->End(tick);
+					return;
+				}
+				if(stats)
+					Statistics(pc);
+				TracedStep(0);
+				if(profile)
+					Profile(pc,1);
+				++tick;
+			} while(tick<limit);
+		}
+		trace->End(tick);
+	}
+
+	// Records each instruction's address, with snapshots taken between
+	// instructions, before Service() - so that restoring one and calling
+	// Service() again does just what was done the first time.  The stores log
+	// the bytes they overwrite themselves, so other instructions cost only an
+	// entry in the address log.  A superinstruction logs every byte of its li
+	// chain; it's never used across the step limit, so replaying can still stop
+	// partway through one.  Instructions being run again after moving back
+	// through the history don't repeat the UART's output.
+
+	void RunRecorded()
+	{
+		if(history->SnapshotDue())
+			SaveSnapshot(history->AddSnapshot());
+		while(Service())
+		{
+			bool replay=history->Replaying();
+			prg->SetReplaying(replay);
+			if(replay && history->GetFrontier()-history->GetPosition()<(unsigned int)(limit-tick))
+				limit=tick+(history->GetFrontier()-history->GetPosition());
+			do
+			{
+				unsigned int pc=regfile[7]&PC_MASK;
+				if(AtBreakpoint(pc))
+				{
+					Break(pc);
+					break;
+				}
+				int start=tick;
+				Step();
+				for(int i=0;i<=tick-start;++i)
+					history->Record(pc+i);
+				++tick;
+				if(history->SnapshotDue())
+					SaveSnapshot(history->AddSnapshot());
+			} while(tick<limit);
+		}
+		prg->SetReplaying(false);
+	}
+
+	// Profiling and statistics need to see every instruction.  Without the
+	// pipeline model each instruction is counted as a cycle.
+
+	void RunInstrumented()
+	{
+		while(Service())
+		{
+			do
+			{
+				unsigned int pc=regfile[7]&PC_MASK;
+				if(AtBreakpoint(pc))
+				{
+					Break(pc);
+					return;
+				}
+				if(stats)
+					Statistics(pc);
+				Step();
+				if(profile)
+					Profile(pc,1);
+				++tick;
+			} while(tick<limit);
+		}
+	}
+
+	// Each cycle the pipeline model picks the thread to issue from, or inserts a
+	// bubble; the chosen thread's state is swapped in and it executes a single
+	// instruction.  Emulation ends when both threads are paused by cond NEX, with
+	// no interrupt to come.  Interrupts go to the first thread, but wake both.
+	// Without -d the second thread never runs, leaving just the timing model.
+
+	void RunPipelined()
+	{
+		pipeline.SetTiming(timing);
+		pipeline.Reset(dualthread ? 2 : 1);
+		pipeline.Wait(restoredcycles);
+		threadticks[0]=threadticks[1]=0;
+		// The second thread starts at the same address with the carry flag set,
+		// which is how the startup code tells the threads apart.
+		thread=0;
+		SaveContext(context[0]);
+		carry=1;
+		SaveContext(context[1]);
+		LoadContext(context[0]);
+
+		int lastopcode=opc_cond|7;	// The first thread's previous instruction, if executed
+		// For the profile, each instruction is charged with the cycles since the
+		// previous one issued, apart from time spent with both threads paused.
+		unsigned long long issued=0;
+		do
+		{
+			if(prg->IsScheduled() && prg->GetNextEvent()<=pipeline.GetCycles())
+				prg->Update();
+			bool irq=prg->GetInterrupt();
+			if(!irq)
+				interrupting=false;
+			else
+				pipeline.Wake();
+
+			int opcode[2];
+			unsigned int pc[2];
+			for(int t=0;t<2;++t)
+			{
+				pc[t]=(t==thread ? regfile[7] : context[t].regfile[7])&PC_MASK;
+				opcode[t]=GetOpcode(*prg,pc[t]);
+			}
+			int t=pipeline.Choose(opcode[0],pc[0],opcode[1],pc[1]);
+			if(t<0)
+			{
+				if(pipeline.Idle())
+				{
+					if(!prg->IsScheduled())
+					{
+						Debug[COMMENT] << (dualthread ? "Both threads paused" : "CPU paused with no interrupt pending") << std::endl;
+						break;
+					}
+					pipeline.Wait(prg->GetNextEvent()-pipeline.GetCycles());
+					issued=pipeline.GetCycles();
+				}
+				else
+					pipeline.Bubble();
+				continue;
+			}
+			if(t!=thread)
+			{
+				SaveContext(context[thread]);
+				thread=t;
+				LoadContext(context[thread]);
+			}
+			if(AtBreakpoint(pc[t]))
+			{
+				Break(pc[t]);
+				break;
+			}
+			if(t==0 && irq && !interrupting && cond && Interruptible(lastopcode,opcode[0]))
+			{
+				TakeInterrupt();
+				pipeline.Issue(0,opc_exg|7,false);	// Near enough - both write r7 and tmp
+				lastopcode=opc_exg|7;
+				continue;
+			}
+			bool skipped=!cond;
+			int size;
+			unsigned int operand=PipelineOperand(opcode[t],size);
+			if(stats)
+				Statistics(pc[t]);
+			if(trace)
+				TracedStep(t ? TRACEFLAG_THREAD2 : 0);
+			else
+				Step();
+			pipeline.Issue(t,opcode[t],skipped,operand,size);
+			if(profile)
+				Profile(pc[t],pipeline.GetCycles()-issued);
+			issued=pipeline.GetCycles();
+			if(t==0)
+				lastopcode=skipped ? opc_cond : opcode[0];
+			++threadticks[t];
+			++tick;
+			if(backedge!=~0U)
+			{
+				unsigned int head=backedge;
+				backedge=~0U;
+				if(PipelinedLoopBack(head,lastopcode))
+					break;
+			}
+			if(Watched())
+				break;
+		} while(!exited && (steps<0 || tick<steps));
+		if(trace)
+			trace->End(tick);
+	}
+
+	// True if execution should stop before the instruction at pc.  Resuming from
+	// a breakpoint executes the instruction there before breakpoints take effect again.
+	inline bool AtBreakpoint(unsigned int pc)
+	{
+		return(breaking && (codecache[pc].flags&DECODEFLAG_BREAK) && !(resuming && pc==resumepc));
+	}
+
+	void Break(unsigned int pc)
+	{
+		stopped=true;
+		resuming=true;
+		resumepc=pc;
+		limit=0;
+		if(stopping && pc==stopaddr)
+			Debug[WARN] << "Stopped at " << stopat << " (0x" << stopaddr << ")" << std::endl;
+		else
+		{
+			Debug[WARN] << std::hex << std::endl << "Breakpoint at " << DescribePC(pc) << std::endl;
+			DumpRegs(WARN);
+		}
+	}
+
+	// The function and offset, followed by the address, or just the address without symbols.
+	std::string DescribePC(unsigned int pc)
+	{
+		char buf[16];
+		snprintf(buf,sizeof(buf),"0x%x",pc);
+		std::string where=symbols.Describe(pc);
+		if(where==buf)
+			return(where);
+		return(where+" ("+buf+")");
+	}
+
+	// Returns true, having reported it, if the previous instruction hit a watchpoint.
+	inline bool Watched()
+	{
+		EightThirtyTwoWatchHit hit;
+		if(!prg->TakeWatchHit(hit) || replaying)
+			return(false);
+		WatchStop(hit,"stopped before");
+		return(true);
+	}
+
+	void WatchStop(const EightThirtyTwoWatchHit &hit,const char *where)
+	{
+		stopped=true;
+		watchstopped=true;
+		lastwatch=hit;
+		unsigned int pc=regfile[7]&PC_MASK;
+		Debug[WARN] << std::hex << std::endl << "Watchpoint: " << (hit.flags==WATCH_WRITE ? "write of 0x" : "read of 0x") << hit.value
+			<< (hit.size==WORD ? "" : (hit.size==HALFWORD ? " (halfword)" : " (byte)")) << " at 0x" << hit.addr
+			<< ", " << where << " " << DescribePC(pc) << std::endl;
+		DumpRegs(WARN);
+	}
+
+	// Reverse execution.  With a history, StepBack() moves back the given number
+	// of instructions, and ReverseContinue() back to the last instruction at a
+	// breakpoint, or which wrote to a range watched for writes.  Each stops
+	// before the instruction executes, and returns false if it reached the
+	// start of the history first, leaving the emulator there.
+
+	void SetHistory(unsigned int megabytes)
+	{
+		if(history)
+			delete history;
+		history=new EightThirtyTwoHistory(megabytes);
+	}
+
+	bool HasHistory()
+	{
+		return(history!=0);
+	}
+
+	bool StepBack(unsigned long long count)
+	{
+		stopped=false;
+		watchstopped=false;
+		history->Remember();
+		unsigned long long start=history->GetStart();
+		unsigned long long pos=history->GetPosition();
+		if(pos==start)
+			return(false);
+		bool reached=pos-start>=count;
+		GoTo(reached ? pos-count : start);
+		return(reached);
+	}
+
+	bool ReverseContinue()
+	{
+		stopped=false;
+		watchstopped=false;
+		history->Remember();
+		unsigned long long start=history->GetStart();
+		unsigned long long pos=history->GetPosition();
+		unsigned long long target=start;
+		bool found=false;
+		bool watched=false;
+		for(unsigned long long p=pos;breaking && p-->start;)
+		{
+			if(codecache[history->GetPC(p)].flags&DECODEFLAG_BREAK)
+			{
+				target=p;
+				found=true;
+				break;
+			}
+		}
+		// A later write, or one made by the instruction at the breakpoint, is reported instead.
+		for(unsigned long long n=history->GetUndoCount();prg->HasWatchpoints() && n-->history->GetUndoStart();)
+		{
+			const EightThirtyTwoUndo &u=history->GetUndo(n);
+			if(u.position<target || u.position<start)
+				break;
+			if(prg->IsWatched(u.addr,u.addr+u.size,WATCH_WRITE))
+			{
+				target=u.position;
+				found=watched=true;
+				break;
+			}
+		}
+		if(target!=pos)
+			GoTo(target);
+		if(!found)
+			return(false);
+		unsigned int pc=regfile[7]&PC_MASK;
+		if(watched)
+		{
+			EightThirtyTwoTraceRecord r;
+			TraceMemAccess(EightThirtyTwoDecode(GetOpcode(*prg,pc)),r);
+			EightThirtyTwoWatchHit hit;
+			hit.addr=r.memaddr;
+			hit.value=r.memvalue;
+			hit.size=e32size(r.memflags&TRACEMEM_SIZEMASK);
+			hit.flags=WATCH_WRITE;
+			WatchStop(hit,"made by");
+		}
+		else
+			Break(pc);
+		return(true);
+	}
+
+	// Checkpoints hold the architectural state of the CPU - a single thread - and
+	// emulated time, then the memory and devices.  The instruction count restarts
+	// from zero, as do the pipeline model's stages.
+
+	void SaveCheckpoint(const char *filename)
+	{
+		FILE *f;
+		if(!(f=FOpenUTF8(filename,"wb")))
+			throw "Can't create checkpoint file";
+		std::vector<unsigned long long> state;
+		state.push_back(CHECKPOINT_MAGIC);
+		state.push_back(CHECKPOINT_VERSION);
+		for(int i=0;i<8;++i)
+			state.push_back(regfile[i]);
+		state.push_back(temp);
+		state.push_back(zero);
+		state.push_back(carry);
+		state.push_back(cond);
+		state.push_back(immediate_continuation);
+		state.push_back(sizemod);
+		state.push_back(sign_mod);
+		state.push_back(endian);
+		state.push_back(GetCycles());
+		state.push_back(paused);
+		state.push_back(interrupting);
+		try
+		{
+			EightThirtyTwoWriteState(f,state);
+			prg->SaveState(f);
+		}
+		catch(const char *err)
+		{
+			fclose(f);
+			throw;
+		}
+		fclose(f);
+		Debug[COMMENT] << "Saved checkpoint to " << filename << std::endl;
+	}
+
+	void RestoreCheckpoint(const char *filename)
+	{
+		FILE *f;
+		if(!(f=FOpenUTF8(filename,"rb")))
+			throw "Can't open checkpoint file";
+		std::vector<unsigned long long> state;
+		try
+		{
+			EightThirtyTwoReadState(f,state);
+			if(state.size()<21 || state[0]!=CHECKPOINT_MAGIC || state[1]!=CHECKPOINT_VERSION)
+				throw "Not a checkpoint file, or from a different version of 832e";
+			const unsigned long long *s=&state[2];
+			for(int i=0;i<8;++i)
+				regfile[i]=*s++;
+			temp=*s++;
+			zero=*s++;
+			carry=*s++;
+			cond=*s++;
+			immediate_continuation=*s++;
+			sizemod=e32size(*s++);
+			sign_mod=*s++;
+			endian=e32endian(*s++);
+			restoredcycles=*s++;
+			paused=*s++;
+			interrupting=*s++;
+			idle=pipelined ? 0 : restoredcycles;
+			prg->RestoreState(f);
+		}
+		catch(const char *err)
+		{
+			fclose(f);
+			throw;
+		}
+		fclose(f);
+		profilenext[0]=regfile[7]&PC_MASK;
+		Debug[COMMENT] << "Restored checkpoint from " << filename << std::endl;
+	}
+
+	// Called before the instruction at pc executes.
+	inline void Statistics(unsigned int pc)
+	{
+		int opcode=GetOpcode(*prg,pc);
+		EightThirtyTwoTraceRecord r;
+		TraceMemAccess(EightThirtyTwoDecode(opcode),r);
+		stats->Count(thread,opcode,!cond,r.memflags);
+	}
+
+	inline void Profile(unsigned int pc,unsigned int cycles)
+	{
+		bool entered=pc!=profilenext[thread];
+		profile->Count(pc,entered,cycles);
+		if(callgraph)
+			callgraph->Count(thread,pc,entered,profilenext[thread],cycles);
+		profilenext[thread]=pc+1;
+	}
+
+	void ReportTiming()
+	{
+		unsigned long long cycles=pipeline.GetCycles()-restoredcycles;
+		Debug[WARN] << std::dec << cycles << " cycles";
+		if(tick)
+			Debug[WARN] << " (" << double(cycles)/tick << " cycles per instruction)";
+		Debug[WARN] << std::endl << "Stalls: " << pipeline.GetStalls(PIPE_STALL_HAZARD) << " hazard, "
+			<< pipeline.GetStalls(PIPE_STALL_MEMORY) << " load / store, "
+			<< pipeline.GetStalls(PIPE_STALL_FETCH) << " fetch, "
+			<< pipeline.GetStalls(PIPE_STALL_ALU) << " ALU" << std::endl;
+		if(pipeline.GetMissingMultiplies())
+			Debug[ERROR] << "mul executed " << pipeline.GetMissingMultiplies() << " times without a multiplier" << std::endl;
+		Debug[WARN] << std::hex;
+	}
+
+	void DumpRegs(DebugLevel level=TRACE)
+	{
+		Debug[level] << std::hex << "Temp: " << temp << ", ";
+		for(int i=0;i<8;++i)
+		{
+			Debug[level] << "r" << i << ": " << regfile[i] << ", ";
+		}
+		Debug[level] << "Z: " << zero << ", C: " << carry << ", Cond: " << cond << std::endl;
+	}
+
+	// Instruction handlers - see EightThirtyTwoExecute and EightThirtyTwoSkip below.
+
+	static void Op_decode(EightThirtyTwoEmu &e,int operand)
+	{
+		unsigned int pc=e.regfile[7]-1;
+		EightThirtyTwoDecoded &d=e.codecache[pc];
+		if(d.flags&DECODEFLAG_BREAK)
+		{
+			d.handler=HANDLER_BREAK;
+			Op_break(e,operand);
+			return;
+		}
+		int flags=d.flags;
+		d=EightThirtyTwoDecode(e.GetOpcode(*e.prg,pc));
+		d.flags=flags;
+		if(e.coverage)
+			e.coverage->Mark(pc);
+		if(d.handler==HANDLER_LI && e.fuse)
+			e.Fuse(pc,d);
+		if(e.cond)
+		{
+			if(d.handler>=HANDLER_FULL)
+				e.immediate_continuation=false;
+			EightThirtyTwoExecute[d.handler](e,d.operand);
+		}
+		else
+			EightThirtyTwoSkip[d.handler](e,d.operand);
+	}
+
+	// Used whether or not cond is set.  If execution is resuming from the
+	// breakpoint, the instruction is decoded afresh and executed.
+
+	static void Op_break(EightThirtyTwoEmu &e,int operand)
+	{
+		unsigned int pc=e.regfile[7]-1;
+		if(e.AtBreakpoint(pc))
+		{
+			// Leave the instruction unexecuted and uncounted.
+			e.regfile[7]=pc;
+			--e.tick;
+			e.Break(pc);
+			return;
+		}
+		e.resuming=false;
+		if(e.coverage)
+			e.coverage->Mark(pc);
+		EightThirtyTwoDecoded d=EightThirtyTwoDecode(e.GetOpcode(*e.prg,pc));
+		if(e.cond)
+		{
+			if(d.handler>=HANDLER_FULL)
+				e.immediate_continuation=false;
+			EightThirtyTwoExecute[d.handler](e,d.operand);
+		}
+		else
+			EightThirtyTwoSkip[d.handler](e,d.operand);
+	}
+
+	static void Op_li(EightThirtyTwoEmu &e,int operand)
+	{
+		if(e.immediate_continuation)
+		{
+			e.temp<<=6;
+			e.temp|=operand;
+		}
+		else
+		{
+			e.temp=operand;
+			if(operand&0x20)
+				e.temp|=0xffffffc0;
+			e.immediate_continuation=true;
+		}
+	}
+
+	// Superinstructions - see EightThirtyTwoFuse().  Each behaves exactly like the
+	// sequence it replaces, falling back to a single li if entered mid-chain, or
+	// if the run loop has to stop within the sequence - at the step limit, or
+	// for a device event or interrupt.
+
+	static void Op_lichain(EightThirtyTwoEmu &e,int operand)
+	{
+		if(!e.BeginFused())
+			Op_li(e,operand);
+	}
+
+	static void Op_lijump(EightThirtyTwoEmu &e,int operand)
+	{
+		if(e.BeginFused())
+		{
+			e.immediate_continuation=false;
+			Op_add(e,7);
+		}
+		else
+			Op_li(e,operand);
+	}
+
+	static void Op_liaddt(EightThirtyTwoEmu &e,int operand)
+	{
+		if(e.BeginFused())
+		{
+			e.immediate_continuation=false;
+			Op_addt(e,7);
+		}
+		else
+			Op_li(e,operand);
+	}
+
+	static void Op_lildt(EightThirtyTwoEmu &e,int operand)
+	{
+		if(e.BeginFused())
+			Op_ldt(e,0);
+		else
+			Op_li(e,operand);
+	}
+
+	// Overloaded (zero-operand) opcodes.  The modifiers are cleared
+	// by the next instruction that could use them.
+
+	static void Op_hlf(EightThirtyTwoEmu &e,int operand)
+	{
+		e.sizemod=HALFWORD;
+	}
+
+	static void Op_byt(EightThirtyTwoEmu &e,int operand)
+	{
+		e.sizemod=BYTE;
+	}
+
+	static void Op_sgn(EightThirtyTwoEmu &e,int operand)
+	{
+		e.sign_mod=true;
+	}
+
+	static void Op_ldt(EightThirtyTwoEmu &e,int operand)
+	{
+		e.temp=e.prg->Read(e.temp,e.endian,e.sizemod);
+		e.sizemod=WORD;
+	}
+
+	// sig wakes a thread paused by cond NEX, which is handled by the pipeline model.
+
+	static void Op_sig(EightThirtyTwoEmu &e,int operand)
+	{
+	}
+
+	// Control flow:
+
+	static void Op_cond(EightThirtyTwoEmu &e,int operand)
+	{
+		// cond NEX pauses the thread until it's woken, leaving the condition flag alone.
+		// When the pipeline is modelled it takes care of it.
+		if(!operand)
+		{
+			if(!e.pipelined)
+			{
+				e.paused=true;
+				e.limit=0;
+			}
+			return;
+		}
+		Op_skipcond(e,operand);
+	}
+
+	// Register
+
+	static void Op_mt(EightThirtyTwoEmu &e,int operand)
+	{
+		e.temp=e.regfile[operand];
+	}
+
+	static void Op_mr(EightThirtyTwoEmu &e,int operand)
+	{
+		e.regfile[operand]=e.temp;
+		if(operand==7)
+		{
+			e.WritePC(e.temp);
+			e.cond=1; // cancel cond on write to r7
+		}
+	}
+
+	static void Op_exg(EightThirtyTwoEmu &e,int operand)
+	{
+		int t=e.regfile[operand];
+		e.regfile[operand]=e.temp;
+		if(operand==7)
+		{
+			e.WritePC(e.temp);
+			e.cond=1; // cancel cond on write to r7
+		}
+		e.temp=t;
+	}
+
+	// Memory
+
+	static void Op_ld(EightThirtyTwoEmu &e,int operand)
+	{
+		e.temp=e.prg->Read(e.regfile[operand],e.endian,e.sizemod);
+		e.zero=(e.temp==0);
+		e.carry=(e.temp&0x80000000)!=0;
+		e.sizemod=WORD;
+	}
+
+	static void Op_ldinc(EightThirtyTwoEmu &e,int operand)
+	{
+		e.temp=e.prg->Read(e.regfile[operand],e.endian,e.sizemod);
+		e.regfile[operand]+=4;
+		e.zero=(e.temp==0);
+		e.carry=(e.temp&0x80000000)!=0;
+		e.sizemod=WORD;
+	}
+
+	static void Op_ldbinc(EightThirtyTwoEmu &e,int operand)
+	{
+		e.temp=e.prg->Read(e.regfile[operand],e.endian,BYTE);
+		e.regfile[operand]++;
+		e.zero=(e.temp==0);
+		e.carry=0;
+		e.sizemod=WORD;
+	}
+
+	static void Op_ldidx(EightThirtyTwoEmu &e,int operand)
+	{
+		e.temp=e.prg->Read(e.temp+e.regfile[operand],e.endian,e.sizemod);
+		e.sizemod=WORD;
+		e.zero=(e.temp==0);
+		e.carry=(e.temp&0x80000000)!=0;
+	}
+
+	static void Op_st(EightThirtyTwoEmu &e,int operand)
+	{
+		e.Store(e.regfile[operand],e.temp);
+	}
+
+	static void Op_stdec(EightThirtyTwoEmu &e,int operand)
+	{
+		e.regfile[operand]-=4;
+		e.Store(e.regfile[operand],e.temp);
+		if(operand==7)
+			e.WritePC(e.regfile[7]);
+	}
+
+	static void Op_stmpdec(EightThirtyTwoEmu &e,int operand)
+	{
+		e.temp-=4;
+		e.Store(e.temp,e.regfile[operand]);
+	}
+
+	static void Op_stbinc(EightThirtyTwoEmu &e,int operand)
+	{
+		if(e.history)
+			e.RecordStore(e.regfile[operand],1);
+		if(!e.skipidle || !e.prg->Holds(e.regfile[operand],e.temp,e.endian,BYTE))
+			++e.stores;
+		e.prg->Write(e.regfile[operand],e.temp,e.endian,BYTE);
+		e.InvalidateCode(e.regfile[operand],1);
+		e.regfile[operand]++;
+		e.sizemod=WORD;
+		if(operand==7)
+			e.WritePC(e.regfile[7]);
+	}
+
+	static void Op_stinc(EightThirtyTwoEmu &e,int operand)
+	{
+		e.Store(e.regfile[operand],e.temp);
+		e.regfile[operand]+=4;
+		if(operand==7)
+			e.WritePC(e.regfile[7]);
+	}
+
+	// Arithmetic
+
+	static void Op_add(EightThirtyTwoEmu &e,int operand)
+	{
+		long long t2=e.regfile[operand];
+		t2+=e.temp;
+		if(operand==7)
+		{
+			e.cond=1; // cancel cond on write to r7
+			e.temp=e.regfile[operand];	// For r7, previous value goes to temp
+			e.WritePC(t2);	// and the flags come from the result
+			if(e.skipidle && e.temp-e.regfile[7]-1<SKIP_MAXLOOP)
+				e.LoopBack(e.regfile[7],e.tick+1);
+			return;
+		}
+		e.carry=(t2>>32)&1;
+		e.zero=(t2&0xffffffff)==0;
+		e.regfile[operand]=t2;
+	}
+
+	static void Op_addt(EightThirtyTwoEmu &e,int operand)
+	{
+		long long t2=e.regfile[operand];
+		t2+=e.temp;
+		e.carry=(t2>>32)&1;
+		e.zero=(t2&0xffffffff)==0;
+		if(operand==7)
+			e.cond=1; // cancel cond on write to r7
+		e.temp=t2; // result goes to temp.
+	}
+
+	static void Op_cmp(EightThirtyTwoEmu &e,int operand) // FIXME - heed then clear sign modifier.
+	{
+		e.sign_mod=(e.sign_mod) and (((e.regfile[operand]>>31)&1) xor ((e.temp>>31)&1));
+		long long t2=e.regfile[operand];
+		t2-=e.temp;
+		e.carry=(t2>>32)&1;
+		e.carry^=e.sign_mod;
+		e.sign_mod=0;
+		e.zero=(t2&0xffffffff)==0;
+	}
+
+	static void Op_sub(EightThirtyTwoEmu &e,int operand) // FIXME - heed then clear sign modifier.
+	{
+		e.sign_mod=(not e.sign_mod) and (((e.regfile[operand]>>31)&1) xor ((e.temp>>31)&1));
+		long long t2=e.regfile[operand];
+		t2-=e.temp;
+		e.carry=(t2>>32)&1;
+		e.carry^=e.sign_mod;
+		e.sign_mod=0;
+		e.regfile[operand]=t2;
+		e.zero=(t2&0xffffffff)==0;
+		if(operand==7)
+			e.cond=1; // cancel cond on write to r7
+	}
+
+	static void Op_mul(EightThirtyTwoEmu &e,int operand)
+	{
+		// 32 x 32 -> 64 bit multiply, signed if the sgn modifier is set.
+		// The upper 32 bits go to temp, the lower 32 bits to the register.
+		long long t2;
+		if(e.sign_mod)
+			t2=(long long)(int)e.regfile[operand] * (long long)(int)e.temp;
+		else
+			t2=(long long)((unsigned long long)e.regfile[operand] * (unsigned long long)e.temp);
+		e.carry=e.sign_mod && t2<0;
+		e.sign_mod=false;
+		e.regfile[operand]=t2;
+		e.temp=t2>>32;
+		e.zero=e.regfile[operand]==0;
+	}
+
+	// Logical
+
+	static void Op_and(EightThirtyTwoEmu &e,int operand)
+	{
+		e.regfile[operand]&=e.temp;
+		e.carry=0;
+		e.zero=e.regfile[operand]==0;
+	}
+
+	static void Op_or(EightThirtyTwoEmu &e,int operand)
+	{
+		e.regfile[operand]|=e.temp;
+		e.carry=0;
+		e.zero=e.regfile[operand]==0;
+	}
+
+	static void Op_xor(EightThirtyTwoEmu &e,int operand)
+	{
+		e.regfile[operand]^=e.temp;
+		e.carry=0;
+		e.zero=e.regfile[operand]==0;
+	}
+
+	static void Op_shl(EightThirtyTwoEmu &e,int operand)
+	{
+		long long t2=e.regfile[operand]<<(e.temp-1);
+		e.carry=t2>>32;
+		e.regfile[operand]<<=e.temp;
+		e.zero=e.regfile[operand]==0;
+	}
+
+	static void Op_shr(EightThirtyTwoEmu &e,int operand) // asr FIXME heed sign bit
+	{
+		e.carry=e.regfile[operand]>>(e.temp-1);
+		e.carry&=1;
+		if(e.sign_mod)
+		{
+			int t=e.regfile[operand];
+			t>>=e.temp;
+			e.regfile[operand]=t;
+		}
+		else
+			e.regfile[operand]>>=e.temp;
+		e.sign_mod=false;
+		e.zero=e.regfile[operand]==0;
+	}
+
+	static void Op_ror(EightThirtyTwoEmu &e,int operand)
+	{
+		e.carry=e.regfile[operand]>>(e.temp-1);
+		e.carry&=1;
+		int t=e.regfile[operand]<<(32-e.temp);
+		e.regfile[operand]=(e.regfile[operand]>>e.temp)|t;
+	}
+
+	// Execution disabled by cond - only cond itself and writes to r7 have any effect.
+
+	static void Op_skip(EightThirtyTwoEmu &e,int operand)
+	{
+	}
+
+	static void Op_skipcond(EightThirtyTwoEmu &e,int operand)
+	{
+		int t=((e.zero&e.carry)<<3)|((!e.zero&e.carry)<<2)|((e.zero&!e.carry)<<1)|(!e.zero&!e.carry);
+		operand|=(operand&2)<<2;
+		e.cond=(operand&t)>0;
+	}
+
+	static void Op_skipr7(EightThirtyTwoEmu &e,int operand)
+	{
+		if(operand==7)
+			e.cond=1;
+	}
+
+	protected:
+	// Instructions which write r7 without setting the flags themselves take them
+	// from the top two bits - see PC_MASK.  Others are masked when fetching.
+	inline void WritePC(unsigned int v)
+	{
+		regfile[7]=v&PC_MASK;
+		zero=(v>>31)&1;
+		carry=(v>>30)&1;
+	}
+	void SaveContext(EightThirtyTwoContext &c)
+	{
+		for(int i=0;i<8;++i)
+			c.regfile[i]=regfile[i];
+		c.temp=temp;
+		c.zero=zero;
+		c.carry=carry;
+		c.cond=cond;
+		c.immediate_continuation=immediate_continuation;
+		c.sizemod=sizemod;
+		c.sign_mod=sign_mod;
+	}
+	static bool SameContext(const EightThirtyTwoContext &a,const EightThirtyTwoContext &b)
+	{
+		for(int i=0;i<8;++i)
+		{
+			if(a.regfile[i]!=b.regfile[i])
+				return(false);
+		}
+		return(a.temp==b.temp && a.zero==b.zero && a.carry==b.carry && a.cond==b.cond
+			&& a.immediate_continuation==b.immediate_continuation && a.sizemod==b.sizemod && a.sign_mod==b.sign_mod);
+	}
+	bool SameContext(const EightThirtyTwoContext &c)
+	{
+		for(int i=0;i<8;++i)
+		{
+			if(c.regfile[i]!=regfile[i])
+				return(false);
+		}
+		return(c.temp==temp && c.zero==zero && c.carry==carry && c.cond==cond
+			&& c.immediate_continuation==immediate_continuation && c.sizemod==sizemod && c.sign_mod==sign_mod);
+	}
+	void LoadContext(const EightThirtyTwoContext &c)
+	{
+		for(int i=0;i<8;++i)
+			regfile[i]=c.regfile[i];
+		temp=c.temp;
+		zero=c.zero;
+		carry=c.carry;
+		cond=c.cond;
+		immediate_continuation=c.immediate_continuation;
+		sizemod=c.sizemod;
+		sign_mod=c.sign_mod;
+	}
+	// Executes one instruction, appending a record to the trace.
+	void TracedStep(int flags)
+	{
+		unsigned int pc=regfile[7]&PC_MASK;
+		int opcode=GetOpcode(*prg,pc);
+		bool skipped=!cond;
+		EightThirtyTwoTraceRecord &r=trace->Append();
+		TraceMemAccess(EightThirtyTwoDecode(opcode),r);
+
+		Step();
+
+		if(r.memflags&TRACEMEM_READ)
+			r.memvalue=temp;
+		r.tick=tick;
+		r.pc=pc;
+		r.opcode=opcode;
+		r.temp=temp;
+		for(int i=0;i<7;++i)
+			r.regs[i]=regfile[i];
+		r.flags=flags | (zero ? TRACEFLAG_ZERO : 0) | (carry ? TRACEFLAG_CARRY : 0)
+			| (cond ? TRACEFLAG_COND : 0) | (skipped ? TRACEFLAG_SKIPPED : 0);
+	}
+	// The shift distance, or the address and size of a load or store, which
+	// opcode is about to use - for the pipeline model.
+	unsigned int PipelineOperand(int opcode,int &size)
+	{
+		EightThirtyTwoTraceRecord r;
+		TraceMemAccess(EightThirtyTwoDecode(opcode),r);
+		size=4;
+		if(!r.memflags)
+			return(temp);
+		int s=r.memflags&TRACEMEM_SIZEMASK;
+		size=s==BYTE ? 1 : (s==HALFWORD ? 2 : 4);
+		return(r.memaddr);
+	}
+	// Works out the memory access an instruction is about to make, from the state before it executes.
+	void TraceMemAccess(const EightThirtyTwoDecoded &d,EightThirtyTwoTraceRecord &r)
+	{
+		unsigned int reg=regfile[d.operand];
+		r.memaddr=0;
+		r.memvalue=0;
+		r.memflags=0;
+		if(!cond)
+			return;
+		switch(d.handler)
+		{
+			case HANDLER_LDT:
+				r.memaddr=temp;
+				r.memflags=TRACEMEM_READ|sizemod;
+				break;
+			case HANDLER_LD:
+			case HANDLER_LDINC:
+				r.memaddr=reg;
+				r.memflags=TRACEMEM_READ|sizemod;
+				break;
+			case HANDLER_LDBINC:
+				r.memaddr=reg;
+				r.memflags=TRACEMEM_READ|BYTE;
+				break;
+			case HANDLER_LDIDX:
+				r.memaddr=temp+reg;
+				r.memflags=TRACEMEM_READ|sizemod;
+				break;
+			case HANDLER_ST:
+			case HANDLER_STINC:
+				r.memaddr=reg;
+				r.memvalue=temp;
+				r.memflags=TRACEMEM_WRITE|sizemod;
+				break;
+			case HANDLER_STDEC:
+				r.memaddr=reg-4;
+				r.memvalue=temp;
+				r.memflags=TRACEMEM_WRITE|sizemod;
+				break;
+			case HANDLER_STMPDEC:
+				r.memaddr=temp-4;
+				r.memvalue=reg;
+				r.memflags=TRACEMEM_WRITE|sizemod;
+				break;
+			case HANDLER_STBINC:
+				r.memaddr=reg;
+				r.memvalue=temp&0xff;
+				r.memflags=TRACEMEM_WRITE|BYTE;
+				break;
+		}
+	}
+	void Fuse(unsigned int pc,EightThirtyTwoDecoded &d)
+	{
+		unsigned char code[FUSE_MAXLENGTH];
+		for(int i=0;i<FUSE_MAXLENGTH;++i)
+			code[i]=GetOpcode(*prg,pc+i);
+		// End the sequence before any breakpoint - cond never extends an li chain.
+		for(int i=1;breaking && i<FUSE_MAXLENGTH;++i)
+		{
+			if(codecache[pc+i].flags&DECODEFLAG_BREAK)
+			{
+				code[i]=opc_cond;
+				break;
+			}
+		}
+		int len=EightThirtyTwoFuse(d,code);
+		// The rest of the sequence won't be decoded, so counts as reached now.
+		for(int i=1;i<len;++i)
+		{
+			codecache[pc+i].flags|=DECODEFLAG_FUSED;
+			if(coverage)
+				coverage->Mark(pc+i);
+		}
+	}
+	// Executes the li chain of a superinstruction, leaving r7 pointing past the
+	// whole sequence, or returns NULL if the superinstruction can't be used.
+	inline const EightThirtyTwoDecoded *BeginFused()
+	{
+		unsigned int pc=regfile[7]-1;
+		const EightThirtyTwoDecoded &d=codecache[pc];
+		if(immediate_continuation || tick+d.length>limit)
+			return(0);
+		++fused[d.handler-HANDLER_FUSED];
+		tick+=d.length-1;
+		regfile[7]=pc+d.length;
+		temp=d.value;
+		immediate_continuation=true;
+		return(&d);
+	}
+	// Called before a store overwrites memory, while history is being recorded.
+	void RecordStore(unsigned int addr,int size)
+	{
+		unsigned int old=0;
+		for(int i=size-1;i>=0;--i)
+			old=(old<<8)|prg->Peek(addr+i);
+		history->Store(addr,old,size);
+	}
+	// Snapshots hold the state Service() works from as well as the CPU's, and emulated time.
+	void SaveSnapshot(EightThirtyTwoSnapshot &s)
+	{
+		std::vector<unsigned long long> &state=s.state;
+		for(int i=0;i<8;++i)
+			state.push_back(regfile[i]);
+		state.push_back(temp);
+		state.push_back(zero);
+		state.push_back(carry);
+		state.push_back(cond);
+		state.push_back(immediate_continuation);
+		state.push_back(sizemod);
+		state.push_back(sign_mod);
+		state.push_back(tick);
+		state.push_back(idle);
+		state.push_back(paused);
+		state.push_back(interrupting);
+		state.push_back(watching);
+		state.push_back(watchpc);
+		state.push_back(watchcond);
+		state.push_back(interrupts);
+		prg->SaveDevices(s.devices);
+	}
+	void RestoreSnapshot(EightThirtyTwoSnapshot &s)
+	{
+		const unsigned long long *p=&s.state[0];
+		for(int i=0;i<8;++i)
+			regfile[i]=*p++;
+		temp=*p++;
+		zero=*p++;
+		carry=*p++;
+		cond=*p++;
+		immediate_continuation=*p++;
+		sizemod=e32size(*p++);
+		sign_mod=*p++;
+		tick=*p++;
+		idle=*p++;
+		paused=*p++;
+		interrupting=*p++;
+		watching=*p++;
+		watchpc=*p++;
+		watchcond=*p++;
+		interrupts=*p++;
+		prg->RestoreDevices(s.devices);
+	}
+	// Returns to the state before the instruction at position target executed:
+	// undoes the stores since the snapshot before it, restores the snapshot, and
+	// replays the instructions in between with breakpoints and watchpoints disabled.
+	void GoTo(unsigned long long target)
+	{
+		EightThirtyTwoSnapshot &s=history->Rewind(target);
+		EightThirtyTwoUndo u;
+		while(history->Undo(u))
+		{
+			for(int i=0;i<u.size;++i)
+				prg->Poke(u.addr+i,u.value>>(i*8));
+			InvalidateCode(u.addr,u.size);
+		}
+		RestoreSnapshot(s);
+		bool b=breaking;
+		breaking=false;
+		replaying=true;
+		stopped=false;
+		steps=tick+int(target-history->GetPosition());
+		RunRecorded();
+		breaking=b;
+		replaying=false;
+		stopped=false;
+		watchstopped=false;
+		resuming=true;
+		resumepc=regfile[7]&PC_MASK;
+		if(history->GetPosition()!=target)
+			throw "Replaying the history went astray";
+	}
+	void Store(unsigned int addr,unsigned int v)
+	{
+		if(history)
+			RecordStore(addr,sizemod==WORD ? 4 : (sizemod==HALFWORD ? 2 : 1));
+		// Writing back what memory already holds, as a loop spilling a register
+		// to the stack does, doesn't stop the loop being idle.
+		if(!skipidle || !prg->Holds(addr,v,endian,sizemod))
+			++stores;
+		prg->Write(addr,v,endian,sizemod);
+		InvalidateCode(addr,sizemod==WORD ? 4 : (sizemod==HALFWORD ? 2 : 1));
+		sizemod=WORD;
+	}
+	// Called when a short loop branches back to its head, which is reached at
+	// tick now.  If the last iteration made no stores, read nothing which could
+	// change before the next one, and came back to exactly the state it started
+	// from, every iteration until then would do the same, so the count skips
+	// ahead over as many as fit before the next event, the step limit or the next
+	// change in what was read.  A loop which keeps failing the test is marked
+	// so it's no longer checked.
+	void LoopBack(unsigned int head,int now)
+	{
+		if(codecache[head].flags&DECODEFLAG_NOSKIP)
+			return;
+		if(pipelined)
+		{
+			backedge=head;	// Checked once the branch has issued
+			return;
+		}
+		if(head==loophead)
+		{
+			unsigned long long cycles=idle+(unsigned int)now;
+			unsigned long long quiet=prg->GetQuietUntil();
+			if(stores==loopstores && quiet>cycles && SameContext(loopcontext))
+			{
+				loopmisses=0;
+				// Not if the loop paused the CPU, or a device asked for attention.
+				if(limit>now)
+				{
+					if(steps<0 && quiet==~0ULL && !prg->IsScheduled())
+					{
+						Debug[COMMENT] << std::endl << "CPU stuck in a loop at " << head << " with nothing to end it" << std::endl;
+						spinning=true;
+						limit=0;
+						return;
+					}
+					int period=now-looptick;
+					int n=(limit-now)/period;
+					if((quiet-cycles)/period<(unsigned long long)n)
+						n=(quiet-cycles)/period;
+					tick+=n*period;
+					now+=n*period;
+					skipped+=(unsigned long long)n*period;
+				}
+			}
+			else if(++loopmisses>=SKIP_MISSES)
+			{
+				codecache[head].flags|=DECODEFLAG_NOSKIP;
+				loophead=~0U;
+				return;
+			}
+		}
+		else
+			loopmisses=0;
+		loophead=head;
+		loopstores=stores;
+		looptick=now;
+		SaveContext(loopcontext);
+		prg->BeginQuiet();
+	}
+
+	// As LoopBack(), under the pipeline model, once the branch back to head has
+	// issued.  The state of both threads and of the pipeline is compared with
+	// that after the thread's previous branch there, so a loop is skipped while
+	// the other thread is paused, or is waiting in a loop which comes back to the
+	// same state along with it.  The other thread's branches are ignored while
+	// the first is being checked, and only misses while it's paused count towards
+	// giving up on the loop.  Returns true if nothing could ever end the loop.
+	bool PipelinedLoopBack(unsigned int head,int lastopcode)
+	{
+		int other=thread^1;
+		if(head==loophead && thread==loopthread)
+		{
+			unsigned long long cycles=pipeline.GetCycles();
+			unsigned long long quiet=prg->GetQuietUntil();
+			if(stores==loopstores && quiet>cycles && !prg->GetInterrupt()
+				&& lastopcode==looplastopcode && interrupting==loopinterrupting
+				&& SameContext(loopcontext) && SameContext(context[other],loopother) && pipeline.Repeats())
+			{
+				loopmisses=0;
+				unsigned long long until=quiet;
+				if(prg->IsScheduled() && prg->GetNextEvent()<until)
+					until=prg->GetNextEvent();
+				if(steps<0 && until==~0ULL)
+				{
+					Debug[COMMENT] << std::endl << "CPU stuck in a loop at " << head << " with nothing to end it" << std::endl;
+					return(true);
+				}
+				int period=tick-looptick;
+				unsigned long long n=(until-cycles)/(cycles-loopcycles);
+				if((unsigned long long)(INT_MAX-tick)/period<n)
+					n=(INT_MAX-tick)/period;
+				if(steps>=0 && (unsigned long long)(steps-tick)/period<n)
+					n=(steps-tick)/period;
+				tick+=n*period;
+				for(int t=0;t<2;++t)
+					threadticks[t]+=n*(threadticks[t]-loopthreadticks[t]);
+				skipped+=n*period;
+				pipeline.Repeat(n);
+			}
+			else if((!dualthread || pipeline.IsPaused(other)) && ++loopmisses>=SKIP_MISSES)
+			{
+				codecache[head].flags|=DECODEFLAG_NOSKIP;
+				loophead=~0U;
+				return(false);
+			}
+		}
+		else if(loophead!=~0U && loopthread!=thread && tick-looptick<SKIP_MAXLOOP*4)
+			return(false);
+		else
+			loopmisses=0;
+		loophead=head;
+		loopthread=thread;
+		loopstores=stores;
+		looptick=tick;
+		loopcycles=pipeline.GetCycles();
+		looplastopcode=lastopcode;
+		loopinterrupting=interrupting;
+		loopthreadticks[0]=threadticks[0];
+		loopthreadticks[1]=threadticks[1];
+		SaveContext(loopcontext);
+		loopother=context[other];
+		pipeline.Mark();
+		prg->BeginQuiet();
+		return(false);
+	}
+	// Returns true if the store hit translated code, discarding all translations.
+	inline bool InvalidateCode(unsigned int addr,int len)
+	{
+		if(codecache.Invalidate(addr,len)&DECODEFLAG_JIT)
+		{
+			if(jit)
+				jit->Flush();
+			return(true);
+		}
+		return(false);
+	}
+	// Memory access callbacks for translated code.
+	static unsigned int JITRead(void *emu,unsigned int addr,int size)
+	{
+		EightThirtyTwoEmu &e=*(EightThirtyTwoEmu *)emu;
+		return(e.prg->Read(addr,e.endian,e32size(size)));
+	}
+	static int JITWrite(void *emu,unsigned int addr,unsigned int v,int size)
+	{
+		EightThirtyTwoEmu &e=*(EightThirtyTwoEmu *)emu;
+		if(!e.skipidle || !e.prg->Holds(addr,v,e.endian,e32size(size)))
+			++e.stores;
+		e.prg->Write(addr,v,e.endian,e32size(size));
+		return(e.InvalidateCode(addr,size==WORD ? 4 : (size==HALFWORD ? 2 : 1)) || !e.limit);
+	}
+	unsigned int regfile[8];
+	int cond;
+	unsigned int temp;
+	int zero;
+	int carry;
+	int initpc;
+	int steps;
+	int tick;
+	enum e32endian endian;
+
+	EightThirtyTwoMemory *prg;
+	EightThirtyTwoDecodeCache codecache;
+	bool immediate_continuation;
+	enum e32size sizemod;
+	bool sign_mod;
+	EightThirtyTwoTrace *trace;
+	const char *memorymap;
+	unsigned int stackoffset;
+	EightThirtyTwoJIT *jit;
+	bool usejit;
+	bool usefusion;
+	bool useskip;	// Skip ahead through busy-wait loops - see LoopBack()
+	bool skipidle;	// and do so in this run
+	unsigned int stores;	// Made by the CPU, so a loop can tell whether it changed memory
+	unsigned long long skipped;	// Instructions skipped
+	unsigned int loophead;	// The loop being checked for busy-waiting
+	unsigned int loopstores;
+	int looptick;
+	int loopmisses;	// Consecutive iterations which weren't idle
+	EightThirtyTwoContext loopcontext;	// The state at the start of its last iteration
+	unsigned int backedge;	// Under the pipeline model, a loop's head once its branch issues
+	int loopthread;	// The thread running it
+	unsigned long long loopcycles;
+	int looplastopcode;
+	bool loopinterrupting;
+	unsigned int loopthreadticks[2];
+	EightThirtyTwoContext loopother;	// The other thread's state
+	bool spinning;	// Stuck in a loop which nothing can end
+	bool fuse;
+	unsigned int fused[HANDLER_FULL-HANDLER_FUSED];	// Times each superinstruction was executed
+	bool dualthread;
+	bool timed;	// Model the pipeline's timing
+	bool pipelined;	// Run through the pipeline model - with either of the above
+	EightThirtyTwoTiming timing;
+	int thread;	// The thread whose state is currently loaded
+	EightThirtyTwoContext context[2];	// Saved state of each thread, while the other is running
+	EightThirtyTwoPipeline pipeline;
+	unsigned int threadticks[2];
+	int frequency;	// MHz
+	int uartbaud;	// Zero for the untimed UART
+	int uartfifo;
+	int limit;	// Tick at which the run loops return to Service()
+	unsigned long long idle;	// Cycles spent paused
+	bool paused;
+	bool exited;	// Through the semihosting exit call
+	int exitstatus;
+	bool interrupting;	// An interrupt has been taken, and the signal is still high
+	bool watching;	// Waiting to take an interrupt - see Service()
+	unsigned int watchpc;
+	int watchcond;
+	unsigned int interrupts;
+	EightThirtyTwoSymbolMap symbols;
+	EightThirtyTwoProfile *profile;
+	EightThirtyTwoCallGraph *callgraph;
+	const char *callgraphfile;
+	EightThirtyTwoStats *stats;
+	const char *statsfile;
+	EightThirtyTwoCoverage *coverage;
+	const char *coveragefile;
+	EightThirtyTwoHistory *history;
+	bool replaying;	// Running forward to a point in the history
+	const char *checkpointfile;
+	const char *restorefile;
+	const char *stopat;	// Address or symbol given to -X
+	bool stopping;
+	bool stopped;	// Reached a breakpoint or watchpoint, rather than the end of the program
+	unsigned int stopaddr;
+	std::vector<const char *> breakat;	// Addresses or symbols given to -a
+	std::vector<const char *> watchat;	// Ranges given to -W
+	std::set<unsigned int> breakpoints;
+	bool breaking;	// There are breakpoints
+	bool resuming;	// Stopped at the breakpoint at resumepc, and not yet past it
+	unsigned int resumepc;
+	bool watchstopped;
+	EightThirtyTwoWatchHit lastwatch;
+	unsigned long long restoredcycles;
+	unsigned int profilenext[2];	// Address following each thread's previous instruction
+};
+
+#endif
+
@@ -0,0 +1,543 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "debug.h"
+#include "gdbstub.h"
+
+
+static int gdb_hexdigit(int c)
+{
+	if(c>='0' && c<='9')
+		return(c-'0');
+	if(c>='a' && c<='f')
+		return(c-'a'+10);
+	if(c>='A' && c<='F')
+		return(c-'A'+10);
+	return(-1);
+}
+
+
+// Parses hex digits, leaving p at the first character which isn't one.
+
+static unsigned int gdb_hexvalue(const char *&p)
+{
+	unsigned int v=0;
+	int d;
+	while((d=gdb_hexdigit(*p))>=0)
+	{
+		v=(v<<4)|d;
+		++p;
+	}
+	return(v);
+}
+
+
+EightThirtyTwoGDBStub::EightThirtyTwoGDBStub(EightThirtyTwoEmu &emu,EightThirtyTwoMemory &memory)
+	: emu(emu), memory(memory), listener(-1), sock(-1), noack(false), exited(false), detached(false), killed(false),
+	laststop("S05"), inpos(0), inlen(0)
+{
+}
+
+
+EightThirtyTwoGDBStub::~EightThirtyTwoGDBStub()
+{
+	if(sock>=0)
+		close(sock);
+	if(listener>=0)
+		close(listener);
+}
+
+
+void EightThirtyTwoGDBStub::Listen(int port)
+{
+	if((listener=socket(AF_INET,SOCK_STREAM,0))<0)
+		throw "Can't create socket";
+	int on=1;
+	setsockopt(listener,SOL_SOCKET,SO_REUSEADDR,&on,sizeof(on));
+	struct sockaddr_in addr;
+	memset(&addr,0,sizeof(addr));
+	addr.sin_family=AF_INET;
+	addr.sin_port=htons(port);
+	addr.sin_addr.s_addr=htonl(INADDR_LOOPBACK);
+	if(bind(listener,(struct sockaddr *)&addr,sizeof(addr))<0 || listen(listener,1)<0)
+		throw "Can't listen on the GDB port";
+	Debug[WARN] << std::dec << "Waiting for GDB on port " << port << std::hex << std::endl;
+	if((sock=accept(listener,0,0))<0)
+		throw "Can't accept GDB connection";
+	close(listener);
+	listener=-1;
+	// Replies are small and each one is waited for.
+	setsockopt(sock,IPPROTO_TCP,TCP_NODELAY,&on,sizeof(on));
+	Debug[WARN] << "GDB connected" << std::endl;
+}
+
+
+bool EightThirtyTwoGDBStub::Serve(int port)
+{
+	Listen(port);
+	std::string packet;
+	while(!detached && !killed && ReceivePacket(packet))
+	{
+		std::string reply=Handle(packet);
+		if(packet!="k")
+			SendPacket(reply);
+		// The reply to QStartNoAckMode is still acknowledged.
+		if(packet=="QStartNoAckMode")
+			noack=true;
+	}
+	close(sock);
+	sock=-1;
+	Debug[WARN] << (detached ? "GDB detached" : "GDB disconnected") << std::endl;
+	return(detached && !exited);
+}
+
+
+// Returns the next byte from the debugger, or -1 if it has gone.
+
+int EightThirtyTwoGDBStub::GetChar()
+{
+	if(inpos>=inlen)
+	{
+		inpos=0;
+		inlen=recv(sock,inbuf,sizeof(inbuf),0);
+		if(inlen<=0)
+		{
+			inlen=0;
+			return(-1);
+		}
+	}
+	return((unsigned char)inbuf[inpos++]);
+}
+
+
+// Packets are $data#checksum, acknowledged with + (or - to ask for it again)
+// unless the debugger has turned acknowledgements off.
+
+bool EightThirtyTwoGDBStub::ReceivePacket(std::string &packet)
+{
+	while(1)
+	{
+		int c;
+		while((c=GetChar())!='$')
+		{
+			if(c<0)
+				return(false);
+		}
+		packet.clear();
+		unsigned char sum=0;
+		while((c=GetChar())!='#')
+		{
+			if(c<0)
+				return(false);
+			packet+=(char)c;
+			sum+=c;
+		}
+		int hi=gdb_hexdigit(GetChar());
+		int lo=gdb_hexdigit(GetChar());
+		if(noack)
+			return(true);
+		bool ok=hi>=0 && lo>=0 && ((hi<<4)|lo)==sum;
+		if(send(sock,ok ? "+" : "-",1,MSG_NOSIGNAL)<0)
+			return(false);
+		if(ok)
+			return(true);
+	}
+}
+
+
+void EightThirtyTwoGDBStub::SendPacket(const std::string &packet)
+{
+	static const char hex[]="0123456789abcdef";
+	unsigned char sum=0;
+	for(unsigned int i=0;i<packet.size();++i)
+		sum+=packet[i];
+	std::string out="$"+packet+"#";
+	out+=hex[sum>>4];
+	out+=hex[sum&15];
+	while(1)
+	{
+		if(send(sock,out.c_str(),out.size(),MSG_NOSIGNAL)<0)
+			return;
+		if(noack)
+			return;
+		int c;
+		while((c=GetChar())!='+' && c!='-')
+		{
+			if(c<0)
+				return;
+		}
+		if(c=='+')
+			return;
+	}
+}
+
+
+// Checks, without waiting, whether the debugger has sent an interrupt (^C).
+
+bool EightThirtyTwoGDBStub::Interrupted()
+{
+	while(inpos<inlen)
+	{
+		if(inbuf[inpos++]==3)
+			return(true);
+	}
+	struct pollfd p;
+	p.fd=sock;
+	p.events=POLLIN;
+	p.revents=0;
+	if(poll(&p,1,0)<=0)
+		return(false);
+	if(GetChar()<0)
+	{
+		killed=true;
+		return(true);
+	}
+	--inpos;
+	return(Interrupted());
+}
+
+
+std::string EightThirtyTwoGDBStub::HexWord(unsigned int v)
+{
+	char buf[16];
+	if(emu.GetEndian()==BIGENDIAN)
+		snprintf(buf,sizeof(buf),"%08x",v);
+	else
+		snprintf(buf,sizeof(buf),"%02x%02x%02x%02x",v&0xff,(v>>8)&0xff,(v>>16)&0xff,v>>24);
+	return(buf);
+}
+
+
+std::string EightThirtyTwoGDBStub::ReadRegisters()
+{
+	std::string result;
+	for(int i=0;i<EMU_REG_COUNT;++i)
+		result+=HexWord(emu.GetRegister(i));
+	return(result);
+}
+
+
+std::string EightThirtyTwoGDBStub::ReadMemory(unsigned int addr,unsigned int len)
+{
+	static const char hex[]="0123456789abcdef";
+	if(len>GDBSTUB_PACKETSIZE/2)
+		len=GDBSTUB_PACKETSIZE/2;
+	std::string result(len*2,'0');
+	for(unsigned int i=0;i<len;++i)
+	{
+		unsigned char b=memory.Peek(addr+i);
+		result[i*2]=hex[b>>4];
+		result[i*2+1]=hex[b&15];
+	}
+	return(result);
+}
+
+
+std::string EightThirtyTwoGDBStub::WriteMemory(unsigned int addr,const std::string &data)
+{
+	try
+	{
+		memory.LoadImage(addr,(const unsigned char *)data.data(),data.size());
+	}
+	catch(const char *err)
+	{
+		return("E14");	// EFAULT
+	}
+	emu.MemoryChanged(addr,data.size());
+	return("OK");
+}
+
+
+// Z / z type,addr,kind - types 0 and 1 are breakpoints, 2 - 4 watch writes,
+// reads and both, covering kind bytes.
+
+std::string EightThirtyTwoGDBStub::Breakpoint(const std::string &packet)
+{
+	const char *p=packet.c_str()+1;
+	bool insert=packet[0]=='Z';
+	int type=gdb_hexvalue(p);
+	if(*p++!=',')
+		return("E01");
+	unsigned int addr=gdb_hexvalue(p);
+	if(*p++!=',')
+		return("E01");
+	unsigned int len=gdb_hexvalue(p);
+	switch(type)
+	{
+		case 0:
+		case 1:
+			if(insert)
+				emu.SetBreakpoint(addr);
+			else
+				emu.ClearBreakpoint(addr);
+			return("OK");
+		case 2:
+		case 3:
+		case 4:
+		{
+			int flags=type==2 ? WATCH_WRITE : (type==3 ? WATCH_READ : WATCH_READ|WATCH_WRITE);
+			if(!len)
+				return("E01");
+			if(insert)
+				memory.AddWatchpoint(addr,addr+len,flags);
+			else
+				memory.RemoveWatchpoint(addr,addr+len,flags);
+			return("OK");
+		}
+	}
+	return("");
+}
+
+
+std::string EightThirtyTwoGDBStub::StopReply()
+{
+	EightThirtyTwoWatchHit hit;
+	if(emu.GetWatchStop(hit))
+	{
+		char buf[32];
+		snprintf(buf,sizeof(buf),"T05%s:%x;",hit.flags==WATCH_WRITE ? "watch" : "rwatch",hit.addr);
+		return(buf);
+	}
+	if(emu.IsStopped())
+		return("T05swbreak:;");
+	return("S05");
+}
+
+
+// The status given to the semihosting exit call, or zero if the program ended
+// by pausing.
+
+std::string EightThirtyTwoGDBStub::ExitReply()
+{
+	char buf[8];
+	snprintf(buf,sizeof(buf),"W%02x",emu.GetExitStatus()&0xff);
+	return(buf);
+}
+
+
+// Runs in slices until the program stops, ends or is interrupted.  The program
+// has ended when the CPU pauses with nothing to wake it, or exits.
+
+std::string EightThirtyTwoGDBStub::Resume(bool step)
+{
+	if(exited)
+		return(ExitReply());
+	int count=step ? 1 : GDBSTUB_SLICE;
+	while(1)
+	{
+		int executed=emu.Advance(count);
+		if(emu.IsStopped())
+			return(StopReply());
+		if(executed<count)
+		{
+			exited=true;
+			return(ExitReply());
+		}
+		if(step)
+			return("S05");
+		if(Interrupted())
+			return("S02");
+	}
+}
+
+
+// Steps back an instruction, or runs back to the last breakpoint or write to a
+// watched range.  Running out of history is reported as the start of the log.
+
+std::string EightThirtyTwoGDBStub::Reverse(bool step)
+{
+	if(exited)
+		return(ExitReply());
+	if(!(step ? emu.StepBack(1) : emu.ReverseContinue()))
+		return("T05replaylog:begin;");
+	return(step ? "S05" : StopReply());
+}
+
+
+std::string EightThirtyTwoGDBStub::Handle(const std::string &packet)
+{
+	const char *p=packet.c_str()+1;
+	switch(packet[0])
+	{
+		case '?':
+			return(laststop);
+
+		case 'g':
+			return(ReadRegisters());
+
+		case 'G':
+		{
+			// Nothing is written unless every word is eight hex digits.
+			unsigned int v[EMU_REG_COUNT];
+			int n=0;
+			for(;n<EMU_REG_COUNT && strlen(p)>=8;++n)
+			{
+				std::string word(p,8);
+				const char *w=word.c_str();
+				v[n]=gdb_hexvalue(w);
+				if(w!=word.c_str()+8)
+					return("E01");
+				if(emu.GetEndian()==LITTLEENDIAN)
+					v[n]=(v[n]>>24)|((v[n]>>8)&0xff00)|((v[n]<<8)&0xff0000)|(v[n]<<24);
+				p+=8;
+			}
+			for(int i=0;i<n;++i)
+				emu.SetRegister(i,v[i]);
+			return("OK");
+		}
+
+		case 'p':
+		{
+			unsigned int r=gdb_hexvalue(p);
+			if(r>=EMU_REG_COUNT)
+				return("E01");
+			return(HexWord(emu.GetRegister(r)));
+		}
+
+		case 'P':
+		{
+			unsigned int r=gdb_hexvalue(p);
+			if(r>=EMU_REG_COUNT || *p++!='=')
+				return("E01");
+			unsigned int v=gdb_hexvalue(p);
+			if(emu.GetEndian()==LITTLEENDIAN)
+				v=(v>>24)|((v>>8)&0xff00)|((v<<8)&0xff0000)|(v<<24);
+			emu.SetRegister(r,v);
+			return("OK");
+		}
+
+		case 'm':
+		{
+			unsigned int addr=gdb_hexvalue(p);
+			if(*p++!=',')
+				return("E01");
+			return(ReadMemory(addr,gdb_hexvalue(p)));
+		}
+
+		case 'M':
+		case 'X':
+		{
+			unsigned int addr=gdb_hexvalue(p);
+			if(*p++!=',')
+				return("E01");
+			unsigned int len=gdb_hexvalue(p);
+			if(*p++!=':')
+				return("E01");
+			const char *end=packet.c_str()+packet.size();
+			std::string data;
+			data.reserve(len);
+			if(packet[0]=='M')
+			{
+				while(p+1<end && data.size()<len)
+				{
+					int hi=gdb_hexdigit(p[0]);
+					int lo=gdb_hexdigit(p[1]);
+					if(hi<0 || lo<0)
+						return("E01");
+					data+=(char)((hi<<4)|lo);
+					p+=2;
+				}
+			}
+			else
+			{
+				// Binary data, with '#', '$', '}' and '*' escaped as '}' followed by the byte xor 0x20.
+				while(p<end && data.size()<len)
+				{
+					if(*p=='}' && p+1<end)
+					{
+						data+=(char)(p[1]^0x20);
+						p+=2;
+					}
+					else
+						data+=*p++;
+				}
+			}
+			if(data.size()!=len)
+				return("E01");
+			if(!len)
+				return("OK");
+			return(WriteMemory(addr,data));
+		}
+
+		case 'c':
+		case 's':
+			if(*p)
+				emu.SetRegister(7,gdb_hexvalue(p));
+			laststop=Resume(packet[0]=='s');
+			return(laststop);
+
+		case 'b':
+			if(!emu.HasHistory() || (packet!="bs" && packet!="bc"))
+				return("");
+			laststop=Reverse(packet=="bs");
+			return(laststop);
+
+		case 'Z':
+		case 'z':
+			return(Breakpoint(packet));
+
+		case 'H':
+		case 'T':
+			return("OK");
+
+		case 'k':
+			killed=true;
+			return("");
+
+		case 'D':
+			detached=true;
+			return("OK");
+
+		case 'v':
+			if(packet=="vCont?")
+				return("vCont;c;C;s;S");
+			if(packet.compare(0,6,"vCont;")==0)
+			{
+				// Only one thread, so the first action applies.
+				laststop=Resume(packet[6]=='s' || packet[6]=='S');
+				return(laststop);
+			}
+			if(packet.compare(0,5,"vKill")==0)
+			{
+				killed=true;
+				return("OK");
+			}
+			return("");
+
+		case 'q':
+			if(packet.compare(0,10,"qSupported")==0)
+			{
+				char buf[64];
+				snprintf(buf,sizeof(buf),"PacketSize=%x;QStartNoAckMode+;swbreak+;hwbreak+",GDBSTUB_PACKETSIZE);
+				if(emu.HasHistory())
+					return(std::string(buf)+";ReverseStep+;ReverseContinue+");
+				return(buf);
+			}
+			if(packet=="qAttached")
+				return("1");
+			if(packet=="qC")
+				return("QC1");
+			if(packet=="qfThreadInfo")
+				return("m1");
+			if(packet=="qsThreadInfo")
+				return("l");
+			if(packet.compare(0,7,"qSymbol")==0)
+				return("OK");
+			return("");
+
+		case 'Q':
+			if(packet=="QStartNoAckMode")
+				return("OK");
+			return("");
+	}
+	return("");
+}
+
@@ -0,0 +1,67 @@
+#ifndef GDBSTUB_H
+#define GDBSTUB_H
+
+#include <string>
+
+#include "emulator.h"
+
+// GDB remote serial protocol server.  The emulator listens on a local TCP port
+// and serves a single debugger, which can read and write registers and memory,
+// set breakpoints and watchpoints, continue and single step.
+//
+// Registers are numbered as in EMU_REG_*: r0 - r6, the PC (r7), tmp, and the
+// zero, carry and cond flags as 0 or 1, each a 32-bit value in the target's
+// byte order.  Memory reads see RAM and ROM directly, without side effects, so
+// peripheral registers read as zero; writes go to RAM and ROM only, bypassing
+// write protection.  Packets of up to GDBSTUB_PACKETSIZE bytes are accepted, so
+// large images load in a few round trips with X.
+// Breakpoints and watchpoints are the emulator's own, so none of them costs
+// anything until it's hit.  While the program runs, the socket is checked for
+// an interrupt from the debugger every GDBSTUB_SLICE instructions.
+// If the emulator is keeping a history, the debugger can also step and continue
+// backwards, stopping at breakpoints and writes to watched ranges.
+
+#define GDBSTUB_PACKETSIZE 0x20000
+#define GDBSTUB_SLICE 100000
+
+class EightThirtyTwoGDBStub
+{
+	public:
+	EightThirtyTwoGDBStub(EightThirtyTwoEmu &emu,EightThirtyTwoMemory &memory);
+	~EightThirtyTwoGDBStub();
+	// Waits for a debugger to connect to port on the loopback interface, then serves
+	// it.  Returns true if the debugger detached, leaving the program to carry on,
+	// or false if it killed the program or disconnected.
+	bool Serve(int port);
+	protected:
+	void Listen(int port);
+	int GetChar();
+	bool ReceivePacket(std::string &packet);
+	void SendPacket(const std::string &packet);
+	bool Interrupted();
+	std::string Handle(const std::string &packet);
+	std::string Resume(bool step);
+	std::string Reverse(bool step);
+	std::string StopReply();
+	std::string ExitReply();
+	std::string ReadRegisters();
+	std::string ReadMemory(unsigned int addr,unsigned int len);
+	std::string WriteMemory(unsigned int addr,const std::string &data);
+	std::string Breakpoint(const std::string &packet);
+	std::string HexWord(unsigned int v);
+	EightThirtyTwoEmu &emu;
+	EightThirtyTwoMemory &memory;
+	int listener;
+	int sock;
+	bool noack;
+	bool exited;
+	bool detached;
+	bool killed;
+	std::string laststop;
+	char inbuf[4096];
+	int inpos;
+	int inlen;
+};
+
+#endif
+
@@ -0,0 +1,114 @@
+#include "history.h"
+
+
+EightThirtyTwoHistory::EightThirtyTwoHistory(unsigned int megabytes) : pcs(0), undo(0), position(0), undocount(0), frontier(0), undohigh(0)
+{
+	unsigned long long bytes=(unsigned long long)megabytes<<19;	// Half for each log
+	pcmask=1;
+	while((pcmask<<1)*sizeof(unsigned int)<=bytes)
+		pcmask<<=1;
+	undomask=1;
+	while((undomask<<1)*sizeof(EightThirtyTwoUndo)<=bytes)
+		undomask<<=1;
+	pcs=new unsigned int[pcmask];
+	undo=new EightThirtyTwoUndo[undomask];
+	--pcmask;
+	--undomask;
+	Clear();
+}
+
+
+EightThirtyTwoHistory::~EightThirtyTwoHistory()
+{
+	delete[] pcs;
+	delete[] undo;
+}
+
+
+void EightThirtyTwoHistory::Clear()
+{
+	snapshots.clear();
+	frontier=position;
+	undohigh=undocount;
+	nextsnapshot=position;
+	nextundo=undocount;
+}
+
+
+// Several snapshots should stay in reach however the logs fill, so they're
+// taken at least eight times per pass through either.
+
+void EightThirtyTwoHistory::ScheduleSnapshot(unsigned long long undostart)
+{
+	unsigned long long interval=(pcmask+1)/8;
+	if(interval>HISTORY_INTERVAL)
+		interval=HISTORY_INTERVAL;
+	nextsnapshot=position+interval;
+	nextundo=undostart+(undomask+1)/8;
+}
+
+
+EightThirtyTwoSnapshot &EightThirtyTwoHistory::AddSnapshot()
+{
+	ScheduleSnapshot(undocount);
+	snapshots.push_back(EightThirtyTwoSnapshot());
+	EightThirtyTwoSnapshot &s=snapshots.back();
+	s.position=position;
+	s.undo=undocount;
+	Prune();
+	return(s);
+}
+
+
+// Drops snapshots whose instructions or stores have since been overwritten.
+// Having moved back, entries up to the furthest point reached may have been.
+
+void EightThirtyTwoHistory::Prune()
+{
+	unsigned long long high=position>frontier ? position : frontier;
+	while(!snapshots.empty() && (snapshots.front().position+pcmask+1<high
+			|| snapshots.front().undo<GetUndoStart()))
+		snapshots.pop_front();
+}
+
+
+unsigned long long EightThirtyTwoHistory::GetStart()
+{
+	Prune();
+	return(snapshots.empty() ? position : snapshots.front().position);
+}
+
+
+unsigned long long EightThirtyTwoHistory::GetUndoStart()
+{
+	unsigned long long high=undocount>undohigh ? undocount : undohigh;
+	return(high>undomask+1 ? high-undomask-1 : 0);
+}
+
+
+EightThirtyTwoSnapshot &EightThirtyTwoHistory::Rewind(unsigned long long target)
+{
+	Prune();
+	if(snapshots.empty() || snapshots.front().position>target)
+		throw "The history doesn't reach that far back";
+	while(snapshots.back().position>target)
+		snapshots.pop_back();
+	EightThirtyTwoSnapshot &s=snapshots.back();
+	position=s.position;
+	ScheduleSnapshot(s.undo);
+	return(s);
+}
+
+
+bool EightThirtyTwoHistory::Undo(EightThirtyTwoUndo &u)
+{
+	if(undocount==GetUndoStart())
+		return(false);
+	const EightThirtyTwoUndo &last=undo[(undocount-1)&undomask];
+	if(last.position<position)
+		return(false);
+	u=last;
+	--undocount;
+	return(true);
+}
+
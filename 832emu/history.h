@@ -0,0 +1,135 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+
+// Execution history, for running a program backwards.  The address of each
+// instruction executed goes into one ring buffer, and the bytes each store
+// overwrote into another, with a snapshot of the CPU and peripherals taken
+// every HISTORY_INTERVAL instructions.  Moving back to an earlier instruction
+// puts back the bytes stored since the last snapshot before it, restores the
+// snapshot and replays the instructions in between - so registers needn't be
+// logged, and the peripherals' state comes out right.  Searching backwards for
+// a breakpoint or a write to a watched range needs only the logs.
+//
+// Each log takes half of the memory allowed, rounded down to a power of two.
+// A snapshot is also taken once the stores since the last fill an eighth of
+// the undo log.  As the logs wrap, snapshots whose instructions or stores have
+// been overwritten are dropped, so the history reaches back to the oldest
+// snapshot left.
+
+#define HISTORY_INTERVAL 65536
+
+struct EightThirtyTwoUndo
+{
+	unsigned long long position;	// The instruction which made the store
+	unsigned int addr;
+	unsigned int value;	// The bytes overwritten, the lowest address in the low byte
+	int size;	// In bytes
+};
+
+
+struct EightThirtyTwoSnapshot
+{
+	unsigned long long position;	// The instruction about to execute
+	unsigned long long undo;	// Stores recorded before it was taken
+	std::vector<unsigned long long> state;	// The emulator's
+	std::map<std::string,std::vector<unsigned long long> > devices;	// By name
+};
+
+
+class EightThirtyTwoHistory
+{
+	public:
+	EightThirtyTwoHistory(unsigned int megabytes);
+	~EightThirtyTwoHistory();
+	// Forgets everything, leaving a snapshot due before the next instruction.
+	void Clear();
+	// Called before each instruction executes.
+	inline void Record(unsigned int pc)
+	{
+		pcs[position&pcmask]=pc;
+		++position;
+	}
+	// Called before an instruction stores, with the bytes it will overwrite.
+	inline void Store(unsigned int addr,unsigned int value,int size)
+	{
+		EightThirtyTwoUndo &u=undo[undocount&undomask];
+		u.position=position;
+		u.addr=addr;
+		u.value=value;
+		u.size=size;
+		++undocount;
+	}
+	inline bool SnapshotDue()
+	{
+		return(position>=nextsnapshot || undocount>=nextundo);
+	}
+	// Returns a new snapshot at the current position, for the emulator to fill in.
+	EightThirtyTwoSnapshot &AddSnapshot();
+	unsigned long long GetPosition()
+	{
+		return(position);
+	}
+	// The earliest instruction which can be returned to.
+	unsigned long long GetStart();
+	// True while instructions which have already been run once are run again.
+	bool Replaying()
+	{
+		return(position<frontier);
+	}
+	unsigned long long GetFrontier()
+	{
+		return(frontier);
+	}
+	// Marks the current position as the furthest reached, before moving back.
+	void Remember()
+	{
+		if(position>frontier)
+			frontier=position;
+		if(undocount>undohigh)
+			undohigh=undocount;
+	}
+	// Discards the snapshots after target, and returns the one to replay from.
+	// The position moves back to the snapshot's.
+	EightThirtyTwoSnapshot &Rewind(unsigned long long target);
+	// Takes back the latest store made at or after the current position, returning
+	// false once there are none.
+	bool Undo(EightThirtyTwoUndo &u);
+	// Within the history, from GetStart() up to the current position.
+	unsigned int GetPC(unsigned long long pos)
+	{
+		return(pcs[pos&pcmask]);
+	}
+	// Stores are numbered from zero as they're recorded; those still held run
+	// from GetUndoStart() up to, but not including, GetUndoCount().
+	unsigned long long GetUndoCount()
+	{
+		return(undocount);
+	}
+	unsigned long long GetUndoStart();
+	const EightThirtyTwoUndo &GetUndo(unsigned long long n)
+	{
+		return(undo[n&undomask]);
+	}
+	protected:
+	void ScheduleSnapshot(unsigned long long undostart);
+	void Prune();
+	unsigned int *pcs;
+	unsigned long long pcmask;
+	EightThirtyTwoUndo *undo;
+	unsigned long long undomask;
+	unsigned long long position;	// Instructions recorded
+	unsigned long long undocount;	// Stores recorded
+	unsigned long long frontier;	// The furthest position reached
+	unsigned long long undohigh;	// and the most stores recorded, as of the last Remember()
+	unsigned long long nextsnapshot;	// Take a snapshot once position reaches this
+	unsigned long long nextundo;	// or undocount reaches this
+	std::deque<EightThirtyTwoSnapshot> snapshots;	// Oldest first
+};
+
+#endif
+
@@ -0,0 +1,848 @@
+#include <cstdio>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <sys/mman.h>
+#endif
+
+#include "debug.h"
+#include "jit.h"
+
+#define JIT_THRESHOLD 16	// Visits before a block is translated
+#define JIT_MAXINSTRUCTIONS 128
+#define JIT_MAXSKIP 32	// How far a failed cond's stub looks for the end of the skipped code
+#define JIT_CODESIZE (32*1024*1024)
+#define JIT_RESERVE (1024*1024)	// Comfortably more than the largest possible block
+
+// x86-64 registers, condition codes and opcodes used by the translator.
+// rbx holds the emulator pointer throughout; eax, ecx, edx and esi are scratch.
+#define EAX 0
+#define ECX 1
+#define EDX 2
+#define ESI 6
+
+#define CC_C 2
+#define CC_NC 3
+#define CC_Z 4
+#define CC_NZ 5
+#define CC_ALWAYS -1
+
+#define OP_ADD_MR 0x01	// mem += reg
+#define OP_OR_MR 0x09
+#define OP_AND_MR 0x21
+#define OP_XOR_MR 0x31
+#define OP_ADD_RM 0x03	// reg += mem
+#define OP_SUB_RM 0x2b
+#define OP_XOR_RM 0x33
+#define OP_CMP_RM 0x3b
+#define OP_TEST 0x85
+#define OP_XOR 0x31
+
+#define EXT_ADD 0
+#define EXT_OR 1
+#define EXT_AND 4
+#define EXT_SUB 5
+#define EXT_ROR 1
+#define EXT_SHL 4
+#define EXT_SHR 5
+#define EXT_SAR 7
+
+
+EightThirtyTwoJIT::EightThirtyTwoJIT(const EightThirtyTwoJITLayout &layout,EightThirtyTwoMemory &memory,EightThirtyTwoDecodeCache &codecache)
+	: layout(layout), memory(memory), codecache(codecache), code(0), codesize(0), codeptr(0), maxticks(0), translated(0), flushes(0)
+{
+	memset(cache,0,sizeof(cache));
+#if defined(__x86_64__)
+	void *p=mmap(0,JIT_CODESIZE,PROT_READ|PROT_WRITE|PROT_EXEC,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+	if(p!=MAP_FAILED)
+	{
+		code=(unsigned char *)p;
+		codesize=JIT_CODESIZE;
+	}
+	else
+		Debug[WARN] << "Can't allocate memory for the JIT - falling back to the interpreter" << std::endl;
+#else
+	Debug[WARN] << "The JIT requires an x86-64 host - falling back to the interpreter" << std::endl;
+#endif
+}
+
+
+EightThirtyTwoJIT::~EightThirtyTwoJIT()
+{
+#if defined(__x86_64__)
+	if(code)
+		munmap(code,codesize);
+#endif
+}
+
+
+bool EightThirtyTwoJIT::IsAvailable()
+{
+	return(code!=0);
+}
+
+
+void EightThirtyTwoJIT::Flush()
+{
+	blocks.clear();
+	memset(cache,0,sizeof(cache));
+	codeptr=0;
+	codecache.ClearFlags(DECODEFLAG_JIT);
+	++flushes;
+}
+
+
+void EightThirtyTwoJIT::ReportStats()
+{
+	Debug[COMMENT] << std::dec << "JIT: " << translated << " blocks translated, "
+		<< codeptr << " bytes of code, " << flushes << " flushes" << std::hex << std::endl;
+}
+
+
+EightThirtyTwoJITBlock *EightThirtyTwoJIT::SlowLookup(unsigned int pc)
+{
+	if(!code)
+		return(0);
+	EightThirtyTwoJITBlock &b=blocks[pc];
+	if(!b.attempted)
+	{
+		if(++b.count<JIT_THRESHOLD)
+			return(0);
+		if(codesize-codeptr<JIT_RESERVE)
+		{
+			Flush();
+			return(0);
+		}
+		b.attempted=true;
+		Translate(pc,b);
+	}
+	CacheEntry &c=cache[pc&(JIT_CACHESIZE-1)];
+	c.pc=pc;
+	c.block=&b;
+	return(b.code ? &b : 0);
+}
+
+
+// Decodes through the interpreter's cache, so both see the same code.
+
+EightThirtyTwoDecoded EightThirtyTwoJIT::Fetch(unsigned int pc)
+{
+	EightThirtyTwoDecoded &d=codecache[pc];
+	if(d.handler==HANDLER_DECODE)
+	{
+		int flags=d.flags;
+		d=EightThirtyTwoDecode(memory.Peek(pc));
+		d.flags=flags;
+		if(flags&DECODEFLAG_BREAK)
+			d.handler=HANDLER_BREAK;
+	}
+	d.flags|=DECODEFLAG_JIT;
+	EightThirtyTwoDecoded result=d;
+	// The translator builds li chains itself.
+	if(result.handler>=HANDLER_FUSED && result.handler<HANDLER_FULL)
+		result.handler=HANDLER_LI;
+	return(result);
+}
+
+
+bool EightThirtyTwoJIT::Translate(unsigned int pc,EightThirtyTwoJITBlock &block)
+{
+	int start=codeptr;
+	stubs.clear();
+	maxticks=0;
+
+	// push rbx; mov rbx,rdi
+	Byte(0x53);
+	Byte(0x48); Byte(0x89); Byte(0xfb);
+
+	State s;
+	s.sizemod=WORD;
+	s.sign_mod=false;
+	s.immediate_continuation=false;
+	s.tempknown=false;
+	s.tempval=0;
+
+	int count=0;
+	while(1)
+	{
+		EightThirtyTwoDecoded d=Fetch(pc);
+		// cond NEX halts the emulator, as do breakpoints, so leave them to the interpreter.
+		if((d.handler==HANDLER_COND && !d.operand) || d.handler==HANDLER_BREAK)
+		{
+			if(!count)
+			{
+				codeptr=start;
+				return(false);
+			}
+			EmitExit(pc,count,s);
+			break;
+		}
+		if(count>=JIT_MAXINSTRUCTIONS)
+		{
+			EmitExit(pc,count,s);
+			break;
+		}
+		++count;
+		if(!EmitInstruction(pc,d,s,count))
+			break;
+		++pc;
+	}
+
+	for(unsigned int i=0;i<stubs.size();++i)
+	{
+		Patch(stubs[i].patch);
+		if(stubs[i].skip)
+			EmitSkip(stubs[i]);
+		else
+			EmitExit(stubs[i].pc,stubs[i].count,stubs[i].state);
+	}
+
+	block.code=(EightThirtyTwoJITCode)(code+start);
+	block.maxticks=maxticks;
+	++translated;
+	return(true);
+}
+
+
+// Emits code for a single instruction, executed with cond set.
+// Returns false if the instruction writes to r7, ending the block.
+
+bool EightThirtyTwoJIT::EmitInstruction(unsigned int pc,EightThirtyTwoDecoded d,State &s,int count)
+{
+	int r=layout.regfile+4*d.operand;
+	int r7=(d.operand==7);
+
+	if(d.handler>=HANDLER_FULL)
+	{
+		s.immediate_continuation=false;
+		s.tempknown=false;
+		// Reads of r7 see the address of the next instruction.
+		if(r7 && d.handler!=HANDLER_COND)
+			StoreImm(layout.regfile+28,pc+1);
+	}
+
+	switch(d.handler)
+	{
+		case HANDLER_LI:
+			if(s.immediate_continuation)
+			{
+				if(s.tempknown)
+				{
+					s.tempval=(s.tempval<<6)|d.operand;
+					StoreImm(layout.temp,s.tempval);
+				}
+				else
+				{
+					Load(EAX,layout.temp);
+					ShiftImm(EXT_SHL,EAX,6);
+					AluImm(EXT_OR,EAX,d.operand);
+					Store(layout.temp,EAX);
+				}
+			}
+			else
+			{
+				s.tempval=d.operand;
+				if(d.operand&0x20)
+					s.tempval|=0xffffffc0;
+				s.tempknown=true;
+				s.immediate_continuation=true;
+				StoreImm(layout.temp,s.tempval);
+			}
+			return(true);
+
+		case HANDLER_HLF:
+			s.sizemod=HALFWORD;
+			return(true);
+
+		case HANDLER_BYT:
+			s.sizemod=BYTE;
+			return(true);
+
+		case HANDLER_SGN:
+			s.sign_mod=true;
+			return(true);
+
+		case HANDLER_SIG:	// Only affects the other thread
+			return(true);
+
+		case HANDLER_LDT:
+			Load(ESI,layout.temp);
+			EmitRead(s.sizemod);
+			Store(layout.temp,EAX);
+			s.sizemod=WORD;
+			s.tempknown=false;
+			return(true);
+
+		case HANDLER_COND:
+			if(EmitCondTest(d.operand))
+			{
+				Stub stub;
+				stub.patch=Branch(CC_NC);
+				stub.pc=pc;
+				stub.count=count;
+				stub.state=s;
+				stub.skip=true;
+				stubs.push_back(stub);
+			}
+			return(true);
+
+		case HANDLER_MT:
+			Load(EAX,r);
+			Store(layout.temp,EAX);
+			return(true);
+
+		case HANDLER_MR:
+			Load(EAX,layout.temp);
+			Store(r,EAX);
+			if(r7)
+				EmitPCFlags();
+			break;
+
+		case HANDLER_EXG:
+			Load(EAX,r);
+			Load(ECX,layout.temp);
+			Store(r,ECX);
+			Store(layout.temp,EAX);
+			if(r7)
+				EmitPCFlags();
+			break;
+
+		case HANDLER_LD:
+		case HANDLER_LDINC:
+		case HANDLER_LDIDX:
+			Load(ESI,r);
+			if(d.handler==HANDLER_LDIDX)
+				Alu(OP_ADD_RM,ESI,layout.temp);
+			EmitRead(s.sizemod);
+			Store(layout.temp,EAX);
+			if(d.handler==HANDLER_LDINC)
+				AddImm(r,4);
+			RegReg(OP_TEST,EAX,EAX);
+			SetCC(CC_Z,EDX);
+			Movzx(EDX);
+			Store(layout.zero,EDX);
+			ShiftImm(EXT_SHR,EAX,31);
+			Store(layout.carry,EAX);
+			s.sizemod=WORD;
+			if(d.handler!=HANDLER_LDINC)
+				return(true);
+			break;
+
+		case HANDLER_LDBINC:
+			Load(ESI,r);
+			EmitRead(BYTE);
+			Store(layout.temp,EAX);
+			AddImm(r,1);
+			RegReg(OP_TEST,EAX,EAX);
+			SetCC(CC_Z,EDX);
+			Movzx(EDX);
+			Store(layout.zero,EDX);
+			StoreImm(layout.carry,0);
+			s.sizemod=WORD;
+			break;
+
+		case HANDLER_ST:
+			Load(ESI,r);
+			Load(EDX,layout.temp);
+			EmitWrite(s.sizemod);
+			s.sizemod=WORD;
+			EmitStoreCheck(pc,count,s);
+			return(true);
+
+		case HANDLER_STDEC:
+			AddImm(r,-4);
+			Load(ESI,r);
+			Load(EDX,layout.temp);
+			EmitWrite(s.sizemod);
+			s.sizemod=WORD;
+			if(r7)
+			{
+				EmitPCFlags();
+				break;
+			}
+			EmitStoreCheck(pc,count,s);
+			return(true);
+
+		case HANDLER_STMPDEC:
+			AddImm(layout.temp,-4);
+			Load(ESI,layout.temp);
+			Load(EDX,r);
+			EmitWrite(s.sizemod);
+			s.sizemod=WORD;
+			EmitStoreCheck(pc,count,s);
+			return(true);
+
+		case HANDLER_STBINC:
+		case HANDLER_STINC:
+			Load(ESI,r);
+			Load(EDX,layout.temp);
+			EmitWrite(d.handler==HANDLER_STBINC ? BYTE : s.sizemod);
+			AddImm(r,d.handler==HANDLER_STBINC ? 1 : 4);
+			s.sizemod=WORD;
+			if(r7)
+			{
+				EmitPCFlags();
+				break;
+			}
+			EmitStoreCheck(pc,count,s);
+			return(true);
+
+		case HANDLER_ADD:
+		case HANDLER_ADDT:
+			Load(EAX,r);
+			Alu(OP_ADD_RM,EAX,layout.temp);
+			if(d.handler==HANDLER_ADDT)
+			{
+				EmitFlags();
+				Store(layout.carry,ECX);
+				Store(layout.zero,EDX);
+				Store(layout.temp,EAX);
+				return(true);
+			}
+			if(r7)	// For r7, the previous value goes to temp and the flags come from the result
+			{
+				Load(ESI,r);
+				Store(layout.temp,ESI);
+				Store(r,EAX);
+				EmitPCFlags();
+				break;
+			}
+			EmitFlags();
+			Store(layout.carry,ECX);
+			Store(layout.zero,EDX);
+			Store(r,EAX);
+			break;
+
+		case HANDLER_CMP:
+		case HANDLER_SUB:
+			Load(EAX,r);
+			Alu(d.handler==HANDLER_CMP ? OP_CMP_RM : OP_SUB_RM,EAX,layout.temp);
+			EmitFlags();
+			// The interpreter's sign handling differs between cmp and sub.
+			if(s.sign_mod==(d.handler==HANDLER_CMP))
+			{
+				Load(ESI,r);
+				Alu(OP_XOR_RM,ESI,layout.temp);
+				ShiftImm(EXT_SHR,ESI,31);
+				RegReg(OP_XOR,ECX,ESI);
+			}
+			Store(layout.carry,ECX);
+			Store(layout.zero,EDX);
+			s.sign_mod=false;
+			if(d.handler==HANDLER_CMP)
+				return(true);
+			Store(r,EAX);
+			break;
+
+		case HANDLER_MUL:
+			if(s.sign_mod)
+			{
+				// movsxd rax,[r]; movsxd rcx,[temp]
+				Byte(0x48); Byte(0x63); ModRM(EAX,r);
+				Byte(0x48); Byte(0x63); ModRM(ECX,layout.temp);
+			}
+			else
+			{
+				Load(EAX,r);
+				Load(ECX,layout.temp);
+			}
+			// imul rax,rcx
+			Byte(0x48); Byte(0x0f); Byte(0xaf); Byte(0xc1);
+			Store(r,EAX);
+			if(s.sign_mod)
+			{
+				// bt rax,63
+				Byte(0x48); Byte(0x0f); Byte(0xba); Byte(0xe0); Byte(63);
+				SetCC(CC_C,ECX);
+				Movzx(ECX);
+			}
+			else
+				RegReg(OP_XOR,ECX,ECX);
+			Store(layout.carry,ECX);
+			// mov rdx,rax; shr rdx,32
+			Byte(0x48); Byte(0x89); Byte(0xc2);
+			Byte(0x48); Byte(0xc1); Byte(0xea); Byte(32);
+			Store(layout.temp,EDX);
+			RegReg(OP_TEST,EAX,EAX);
+			SetCC(CC_Z,EDX);
+			Movzx(EDX);
+			Store(layout.zero,EDX);
+			s.sign_mod=false;
+			break;
+
+		case HANDLER_AND:
+		case HANDLER_OR:
+		case HANDLER_XOR:
+			Load(EAX,layout.temp);
+			Alu(d.handler==HANDLER_AND ? OP_AND_MR : (d.handler==HANDLER_OR ? OP_OR_MR : OP_XOR_MR),EAX,r);
+			SetCC(CC_Z,EDX);
+			Movzx(EDX);
+			Store(layout.zero,EDX);
+			StoreImm(layout.carry,0);
+			break;
+
+		case HANDLER_SHL:
+			Load(ECX,layout.temp);
+			Load(EAX,r);
+			Shift(EXT_SHL,EAX);
+			Store(r,EAX);
+			RegReg(OP_TEST,EAX,EAX);
+			SetCC(CC_Z,EDX);
+			Movzx(EDX);
+			Store(layout.zero,EDX);
+			StoreImm(layout.carry,0);
+			break;
+
+		case HANDLER_SHR:
+		case HANDLER_ROR:
+			// Carry is the last bit shifted out.
+			Load(EAX,r);
+			Load(ECX,layout.temp);
+			AluImm(EXT_SUB,ECX,1);
+			Shift(EXT_SHR,EAX);
+			AluImm(EXT_AND,EAX,1);
+			Store(layout.carry,EAX);
+			Load(EAX,r);
+			Load(ECX,layout.temp);
+			if(d.handler==HANDLER_ROR)
+			{
+				Shift(EXT_ROR,EAX);
+				Store(r,EAX);
+				break;
+			}
+			Shift(s.sign_mod ? EXT_SAR : EXT_SHR,EAX);
+			Store(r,EAX);
+			RegReg(OP_TEST,EAX,EAX);
+			SetCC(CC_Z,EDX);
+			Movzx(EDX);
+			Store(layout.zero,EDX);
+			s.sign_mod=false;
+			break;
+	}
+
+	// Instructions which fall through to here have modified a register,
+	// so end the block if that register was r7.
+	if(r7)
+	{
+		EmitExit(0,count,s,false);
+		return(false);
+	}
+	return(true);
+}
+
+
+// Tests the condition for a cond instruction, leaving the result in the carry flag.
+// Returns false, emitting nothing, if the condition is always true.
+
+bool EightThirtyTwoJIT::EmitCondTest(int operand)
+{
+	operand|=(operand&2)<<2;
+	if((operand&15)==15)
+		return(false);
+	// The interpreter's condition mask is indexed by zero + 2*carry.
+	Load(ECX,layout.carry);
+	RegReg(OP_ADD_MR,ECX,ECX);
+	Alu(OP_ADD_RM,ECX,layout.zero);
+	MovImm(EAX,operand);
+	// bt eax,ecx
+	Byte(0x0f); Byte(0xa3); Byte(0xc8);
+	return(true);
+}
+
+
+// A failed cond: skip until an instruction writes r7 or another cond passes.
+
+void EightThirtyTwoJIT::EmitSkip(const Stub &stub)
+{
+	unsigned int pc=stub.pc+1;
+	int count=stub.count;
+	for(int i=0;i<JIT_MAXSKIP;++i)
+	{
+		EightThirtyTwoDecoded d=Fetch(pc);
+		if(d.handler==HANDLER_BREAK)
+			break;
+		++count;
+		switch(d.handler)
+		{
+			case HANDLER_EXG:
+			case HANDLER_MR:
+			case HANDLER_ADD:
+			case HANDLER_SUB:
+			case HANDLER_ADDT:
+				if(d.operand==7)
+				{
+					EmitExit(pc+1,count,stub.state);
+					return;
+				}
+				break;
+			case HANDLER_COND:
+				if(d.operand)
+				{
+					if(!EmitCondTest(d.operand))
+					{
+						EmitExit(pc+1,count,stub.state);
+						return;
+					}
+					int p=Branch(CC_NC);
+					EmitExit(pc+1,count,stub.state);
+					Patch(p);
+				}
+				break;
+		}
+		++pc;
+	}
+	// Still skipping, or at a breakpoint - let the interpreter carry on.
+	EmitExit(pc,count,stub.state,true,false);
+}
+
+
+// Leaves the block, having executed count instructions, writing back any state
+// which the block tracked statically.
+
+void EightThirtyTwoJIT::EmitExit(unsigned int pc,int count,const State &s,bool setpc,bool cond)
+{
+	AddImm(layout.tick,count);
+	if(setpc)
+		StoreImm(layout.regfile+28,pc);
+	if(!cond)
+		StoreImm(layout.cond,0);
+	if(s.sizemod!=WORD)
+		StoreImm(layout.sizemod,s.sizemod);
+	if(s.sign_mod)
+		StoreByteImm(layout.sign_mod,1);
+	if(s.immediate_continuation)
+		StoreByteImm(layout.immediate_continuation,1);
+	// pop rbx; ret
+	Byte(0x5b);
+	Byte(0xc3);
+	if(count>maxticks)
+		maxticks=count;
+}
+
+
+// Instructions which write r7 without setting the flags themselves take them
+// from bits 31 and 30 of the new value - see PC_MASK.
+
+void EightThirtyTwoJIT::EmitPCFlags()
+{
+	Load(ECX,layout.regfile+28);
+	ShiftImm(EXT_SHR,ECX,31);
+	Store(layout.zero,ECX);
+	Load(ECX,layout.regfile+28);
+	ShiftImm(EXT_SHR,ECX,30);
+	AluImm(EXT_AND,ECX,1);
+	Store(layout.carry,ECX);
+	// and dword [rbx+r7],PC_MASK
+	Byte(0x81); ModRM(EXT_AND,layout.regfile+28); Word32(PC_MASK);
+}
+
+
+// Memory accesses.  The address is in esi and the value to write in edx.
+
+void EightThirtyTwoJIT::EmitRead(e32size size)
+{
+	MovImm(EDX,size);
+	Call((void *)layout.read);
+}
+
+
+void EightThirtyTwoJIT::EmitWrite(e32size size)
+{
+	MovImm(ECX,size);
+	Call((void *)layout.write);
+}
+
+
+// After a store, leave the block if translated code was overwritten.
+
+void EightThirtyTwoJIT::EmitStoreCheck(unsigned int pc,int count,const State &s)
+{
+	RegReg(OP_TEST,EAX,EAX);
+	Stub stub;
+	stub.patch=Branch(CC_NZ);
+	stub.pc=pc+1;
+	stub.count=count;
+	stub.state=s;
+	stub.skip=false;
+	stubs.push_back(stub);
+}
+
+
+// Converts the carry and zero flags to 0 or 1 in ecx and edx respectively.
+
+void EightThirtyTwoJIT::EmitFlags()
+{
+	SetCC(CC_C,ECX);
+	SetCC(CC_Z,EDX);
+	Movzx(ECX);
+	Movzx(EDX);
+}
+
+
+void EightThirtyTwoJIT::Byte(int b)
+{
+	if(codeptr<codesize)
+		code[codeptr++]=b;
+}
+
+
+void EightThirtyTwoJIT::Word32(unsigned int w)
+{
+	for(int i=0;i<4;++i)
+		Byte((w>>(i*8))&255);
+}
+
+
+void EightThirtyTwoJIT::Word64(unsigned long long w)
+{
+	Word32(w);
+	Word32(w>>32);
+}
+
+
+// [rbx+disp32]
+
+void EightThirtyTwoJIT::ModRM(int reg,int offset)
+{
+	Byte(0x83|(reg<<3));
+	Word32(offset);
+}
+
+
+void EightThirtyTwoJIT::Load(int reg,int offset)
+{
+	Byte(0x8b);
+	ModRM(reg,offset);
+}
+
+
+void EightThirtyTwoJIT::Store(int offset,int reg)
+{
+	Byte(0x89);
+	ModRM(reg,offset);
+}
+
+
+void EightThirtyTwoJIT::StoreImm(int offset,unsigned int imm)
+{
+	Byte(0xc7);
+	ModRM(0,offset);
+	Word32(imm);
+}
+
+
+void EightThirtyTwoJIT::StoreByteImm(int offset,int imm)
+{
+	Byte(0xc6);
+	ModRM(0,offset);
+	Byte(imm);
+}
+
+
+void EightThirtyTwoJIT::AddImm(int offset,int imm)
+{
+	Byte(0x81);
+	ModRM(EXT_ADD,offset);
+	Word32(imm);
+}
+
+
+void EightThirtyTwoJIT::Alu(int opcode,int reg,int offset)
+{
+	Byte(opcode);
+	ModRM(reg,offset);
+}
+
+
+void EightThirtyTwoJIT::MovImm(int reg,unsigned int imm)
+{
+	Byte(0xb8+reg);
+	Word32(imm);
+}
+
+
+void EightThirtyTwoJIT::RegReg(int opcode,int dst,int src)
+{
+	Byte(opcode);
+	Byte(0xc0|(src<<3)|dst);
+}
+
+
+void EightThirtyTwoJIT::SetCC(int cc,int reg)
+{
+	Byte(0x0f);
+	Byte(0x90|cc);
+	Byte(0xc0|reg);
+}
+
+
+void EightThirtyTwoJIT::Movzx(int reg)
+{
+	Byte(0x0f);
+	Byte(0xb6);
+	Byte(0xc0|(reg<<3)|reg);
+}
+
+
+// Shift by cl
+
+void EightThirtyTwoJIT::Shift(int ext,int reg)
+{
+	Byte(0xd3);
+	Byte(0xc0|(ext<<3)|reg);
+}
+
+
+void EightThirtyTwoJIT::ShiftImm(int ext,int reg,int imm)
+{
+	Byte(0xc1);
+	Byte(0xc0|(ext<<3)|reg);
+	Byte(imm);
+}
+
+
+void EightThirtyTwoJIT::AluImm(int ext,int reg,int imm)
+{
+	Byte(0x83);
+	Byte(0xc0|(ext<<3)|reg);
+	Byte(imm);
+}
+
+
+void EightThirtyTwoJIT::Call(void *fn)
+{
+	// mov rdi,rbx; mov rax,fn; call rax
+	Byte(0x48); Byte(0x89); Byte(0xdf);
+	Byte(0x48); Byte(0xb8);
+	Word64((unsigned long long)fn);
+	Byte(0xff); Byte(0xd0);
+}
+
+
+// Emits a jump with a 32-bit displacement, returning the offset of the
+// displacement so it can be patched later.
+
+int EightThirtyTwoJIT::Branch(int cc)
+{
+	if(cc==CC_ALWAYS)
+		Byte(0xe9);
+	else
+	{
+		Byte(0x0f);
+		Byte(0x80|cc);
+	}
+	int at=codeptr;
+	Word32(0);
+	return(at);
+}
+
+
+// Points the displacement at offset "at" to the current position.
+
+void EightThirtyTwoJIT::Patch(int at)
+{
+	unsigned int rel=codeptr-(at+4);
+	for(int i=0;i<4;++i)
+		code[at+i]=(rel>>(i*8))&255;
+}
+
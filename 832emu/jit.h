@@ -0,0 +1,156 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <vector>
+#include <unordered_map>
+
+#include "memorymap.h"
+#include "predecode.h"
+
+// Basic-block translator from 832 code to x86-64 host code.
+//
+// Blocks start at jump targets which have been reached often enough to be
+// considered hot, and run until an instruction writes to r7.  The translator
+// tracks the li continuation state, the hlf / byt / sgn modifiers and the
+// contents of temp during an li chain statically, so a block may only be entered
+// with cond set, no li chain in progress and no modifiers pending.
+// A cond whose condition fails leaves the block through a stub which works out,
+// from the code that follows, where execution resumes - skipped instructions
+// have no effect other than counting steps, so this can be decided at translation
+// time, testing the flags again at any further cond.
+// Writes to r7 leave the program counter unmasked unless the instruction takes
+// the flags from it, so the caller must apply PC_MASK before using it.
+// Memory accesses call back into the emulator, so MMIO behaves exactly as it
+// does in the interpreter.  Each byte of translated code is flagged in the
+// decode cache; a store which hits a flagged byte discards all translations,
+// and the block making the store returns to the interpreter immediately, as it
+// does after a store to a device which needs attention.
+//
+// On hosts other than x86-64 the translator is unavailable and Lookup()
+// always returns NULL.
+
+#define JIT_CACHESIZE 4096
+
+
+typedef void (*EightThirtyTwoJITCode)(void *emu);
+
+struct EightThirtyTwoJITBlock
+{
+	EightThirtyTwoJITCode code;	// NULL if the block hasn't been (or can't be) translated
+	int maxticks;	// The most instructions any path through the block executes
+	int count;	// Times the block's start address has been reached
+	bool attempted;
+};
+
+
+// Where the translated code finds the emulator's state.  Offsets are relative
+// to the emulator object passed to the translated code.
+
+struct EightThirtyTwoJITLayout
+{
+	int regfile;
+	int temp;
+	int zero;
+	int carry;
+	int cond;
+	int tick;
+	int sizemod;	// enum e32size
+	int sign_mod;	// bool
+	int immediate_continuation;	// bool
+	unsigned int (*read)(void *emu,unsigned int addr,int size);
+	// Returns non-zero if the store invalidated translated code, or a device needs
+	// attention, so the block should return to the interpreter.
+	int (*write)(void *emu,unsigned int addr,unsigned int v,int size);
+};
+
+
+class EightThirtyTwoJIT
+{
+	public:
+	EightThirtyTwoJIT(const EightThirtyTwoJITLayout &layout,EightThirtyTwoMemory &memory,EightThirtyTwoDecodeCache &codecache);
+	~EightThirtyTwoJIT();
+	bool IsAvailable();
+	// Returns the block starting at pc if it has been translated.
+	// Counts visits to untranslated blocks, translating them once they're hot.
+	inline EightThirtyTwoJITBlock *Lookup(unsigned int pc)
+	{
+		CacheEntry &c=cache[pc&(JIT_CACHESIZE-1)];
+		if(c.block && c.pc==pc)
+			return(c.block->code ? c.block : 0);
+		return(SlowLookup(pc));
+	}
+	// Discards all translations.
+	void Flush();
+	void ReportStats();
+	protected:
+	struct CacheEntry
+	{
+		unsigned int pc;
+		EightThirtyTwoJITBlock *block;
+	};
+	struct State
+	{
+		e32size sizemod;
+		bool sign_mod;
+		bool immediate_continuation;
+		bool tempknown;	// Within an li chain, temp holds tempval
+		unsigned int tempval;
+	};
+	struct Stub
+	{
+		int patch;	// Offset of the rel32 branching to the stub
+		unsigned int pc;
+		int count;
+		State state;
+		bool skip;	// A failed cond, rather than a plain exit
+	};
+	EightThirtyTwoJITBlock *SlowLookup(unsigned int pc);
+	bool Translate(unsigned int pc,EightThirtyTwoJITBlock &block);
+	EightThirtyTwoDecoded Fetch(unsigned int pc);
+	bool EmitInstruction(unsigned int pc,EightThirtyTwoDecoded d,State &s,int count);
+	void EmitExit(unsigned int pc,int count,const State &s,bool setpc=true,bool cond=true);
+	void EmitSkip(const Stub &stub);
+	bool EmitCondTest(int operand);
+	void EmitRead(e32size size);
+	void EmitWrite(e32size size);
+	void EmitStoreCheck(unsigned int pc,int count,const State &s);
+	void EmitFlags();
+	void EmitPCFlags();
+	// x86-64 encoding
+	void Byte(int b);
+	void Word32(unsigned int w);
+	void Word64(unsigned long long w);
+	void ModRM(int reg,int offset);
+	void Load(int reg,int offset);
+	void Store(int offset,int reg);
+	void StoreImm(int offset,unsigned int imm);
+	void StoreByteImm(int offset,int imm);
+	void AddImm(int offset,int imm);
+	void Alu(int opcode,int reg,int offset);
+	void MovImm(int reg,unsigned int imm);
+	void RegReg(int opcode,int dst,int src);
+	void SetCC(int cc,int reg);
+	void Movzx(int reg);
+	void Shift(int ext,int reg);
+	void ShiftImm(int ext,int reg,int imm);
+	void AluImm(int ext,int reg,int imm);
+	void Call(void *fn);
+	int Branch(int cc);
+	void Patch(int at);
+
+	EightThirtyTwoJITLayout layout;
+	EightThirtyTwoMemory &memory;
+	EightThirtyTwoDecodeCache &codecache;
+	std::unordered_map<unsigned int,EightThirtyTwoJITBlock> blocks;
+	CacheEntry cache[JIT_CACHESIZE];
+	std::vector<Stub> stubs;
+	unsigned char *code;
+	int codesize;
+	int codeptr;
+	int maxticks;
+	int translated;
+	int flushes;
+};
+
+#endif
+
@@ -0,0 +1,320 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+
+#include "debug.h"
+#include "util.h"
+#include "lcov.h"
+
+
+// 832a's token delimiters.
+static const char *lcov_delims=" \t:\n\r,";
+
+
+// The path without its extension, and the name without its directory.
+
+static std::string lcov_stem(const std::string &path)
+{
+	size_t slash=path.find_last_of("/\\");
+	size_t dot=path.rfind('.');
+	if(dot==std::string::npos || (slash!=std::string::npos && dot<slash))
+		return(path);
+	return(path.substr(0,dot));
+}
+
+
+static std::string lcov_basename(const std::string &path)
+{
+	size_t slash=path.find_last_of("/\\");
+	return(slash==std::string::npos ? path : path.substr(slash+1));
+}
+
+
+// The length of a quoted string given to .ascii, once escapes are resolved.
+
+static unsigned int lcov_asciilength(const char *str)
+{
+	while(*str && *str!='"')
+		++str;
+	if(!*str++)
+		return(0);
+	unsigned int len=0;
+	while(*str && *str!='"')
+	{
+		if(*str++=='\\' && *str)
+		{
+			if(*str>='0' && *str<='7')
+			{
+				for(int i=0;i<3 && *str>='0' && *str<='7';++i)
+					++str;
+			}
+			else
+				++str;
+		}
+		++len;
+	}
+	return(len);
+}
+
+
+EightThirtyTwoLCOV::EightThirtyTwoLCOV(EightThirtyTwoSymbolMap &symbols,EightThirtyTwoCoverage &coverage,
+	const unsigned char *image,unsigned int imagesize)
+	: symbols(symbols), coverage(coverage), image(image), imagesize(imagesize)
+{
+}
+
+
+EightThirtyTwoLCOV::~EightThirtyTwoLCOV()
+{
+}
+
+
+// Returns the index of a section from the source's object file, preferring one
+// in the same directory if several object files share its name.
+
+int EightThirtyTwoLCOV::FindObject(const std::string &source)
+{
+	std::string stem=lcov_stem(source);
+	std::string name=lcov_basename(stem);
+	int result=-1;
+	for(int i=0;i<symbols.GetSectionCount();++i)
+	{
+		std::string obj=lcov_stem(symbols.GetSection(i).file);
+		if(obj==stem)
+			return(i);
+		if(result<0 && lcov_basename(obj)==name)
+			result=i;
+	}
+	return(result);
+}
+
+
+// The number of bytes in the li chain at addr.
+
+unsigned int EightThirtyTwoLCOV::LiLength(unsigned int addr)
+{
+	unsigned int len=0;
+	while(addr+len<imagesize && (image[addr+len]&0xc0)==0xc0)
+		++len;
+	return(len ? len : 1);
+}
+
+
+void EightThirtyTwoLCOV::AddSource(const char *filename)
+{
+	int obj=FindObject(filename);
+	if(obj<0)
+	{
+		Debug[WARN] << "Warning: " << filename << " has no sections in the map file" << std::endl;
+		return;
+	}
+	FILE *f;
+	if(!(f=FOpenUTF8(filename,"r")))
+		throw "Can't open assembly source";
+
+	// Where each of the object's sections starts, and where its labels are.
+	const std::string objfile=symbols.GetSection(obj).file;
+	std::map<std::string,unsigned int> cursors;
+	std::map<std::string,bool> codesections;
+	std::map<std::string,int> labels;
+	for(int i=0;i<symbols.GetSectionCount();++i)
+	{
+		const EightThirtyTwoSection &sect=symbols.GetSection(i);
+		if(sect.file==objfile && !cursors.count(sect.name))
+		{
+			cursors[sect.name]=sect.address;
+			codesections[sect.name]=symbols.IsCode(i);
+		}
+	}
+	for(int i=0;i<symbols.GetCount();++i)
+	{
+		const EightThirtyTwoSymbol &sym=symbols[i];
+		if(sym.section>=0 && symbols.GetSection(sym.section).file==objfile)
+			labels[sym.name]=i;
+	}
+
+	std::string source=filename;
+	std::string dir;
+	size_t slash=source.find_last_of("/\\");
+	if(slash!=std::string::npos)
+		dir=source.substr(0,slash+1);
+	if(!records.count(source))
+		sources.push_back(source);
+	Record &record=records[source];
+
+	std::string section=".text";	// 832a's default
+	std::string lastop,lastreg;	// For the peephole optimiser
+	std::string cfile;	// The C line the code belongs to, if known
+	int cline=0;
+	Function pending;	// The current function, until its first line of C is known
+	bool haspending=false;
+	bool drifted=false;	// Only warn once about the layout differing from the map
+
+	char buf[4096];
+	char raw[4096];
+	int line=0;
+	while(fgets(buf,sizeof(buf),f))
+	{
+		++line;
+		strcpy(raw,buf);
+		bool indented=buf[0]==' ' || buf[0]=='\t';
+		char *tok=strtok(buf,lcov_delims);
+		if(!tok)
+			continue;
+		if((tok[0]=='/' && tok[1]=='/') || tok[0]==';' || tok[0]=='#')
+		{
+			// vbcc's line comments take the form "//file, line n".
+			const char *c=strstr(raw,"//");
+			const char *l=c ? strstr(c,", line ") : 0;
+			if(l && l>c+2)
+			{
+				cfile=std::string(c+2,l-c-2);
+				if(cfile[0]!='/')
+					cfile=dir+cfile;
+				cline=atoi(l+7);
+			}
+			continue;
+		}
+		std::map<std::string,unsigned int>::iterator cursor=cursors.find(section);
+		bool code=cursor!=cursors.end() && codesections[section];
+
+		// Labels start in column zero.
+		if(!indented)
+		{
+			lastop.clear();
+			std::map<std::string,int>::iterator it=labels.find(tok);
+			if(it==labels.end() || cursor==cursors.end())
+				continue;
+			const EightThirtyTwoSymbol &sym=symbols[it->second];
+			if(cursor->second!=sym.address && !drifted)
+			{
+				Debug[WARN] << "Warning: " << filename << " line " << std::dec << line << ": " << tok << " is at 0x" << std::hex
+					<< sym.address << ", not 0x" << cursor->second << " - is the source out of date?" << std::endl;
+				drifted=true;
+			}
+			cursor->second=sym.address;
+			if(code && !sym.local)
+			{
+				Function fn;
+				fn.name=tok;
+				fn.line=line;
+				fn.hit=coverage.IsCovered(sym.address);
+				record.functions.push_back(fn);
+				pending=fn;
+				haspending=true;
+				cfile.clear();
+			}
+			continue;
+		}
+
+		std::string op=tok;
+		std::transform(op.begin(),op.end(),op.begin(),::tolower);
+		char *arg=strtok(0,lcov_delims);
+		unsigned int len=0;
+		bool instruction=false;
+		if(op[0]=='.')
+		{
+			lastop.clear();
+			if(op==".section" || op==".ctor" || op==".dtor" || op==".bss")
+			{
+				if(arg)
+					section=arg;
+				continue;
+			}
+			if(op==".int" || op==".ref")
+				len=4;
+			else if(op==".short")
+				len=2;
+			else if(op==".byte")
+				len=1;
+			else if(op==".space" && arg)
+				len=strtoul(arg,0,0);
+			else if(op==".ascii")
+				len=lcov_asciilength(raw);
+			else if(op==".align" && arg && cursor!=cursors.end())
+			{
+				unsigned int align=strtoul(arg,0,0);
+				if(align)
+					cursor->second=(cursor->second+align-1)/align*align;
+			}
+			else if((op==".liconst" || op==".lipcrel" || op==".liabs") && cursor!=cursors.end())
+			{
+				len=LiLength(cursor->second);
+				instruction=true;
+			}
+		}
+		else
+		{
+			// The peephole optimiser drops mr or mt following the other with the same register.
+			std::string reg=arg ? arg : "";
+			std::transform(reg.begin(),reg.end(),reg.begin(),::tolower);
+			bool dropped=reg==lastreg && ((lastop=="mt" && op=="mr") || (lastop=="mr" && op=="mt"));
+			lastop=op;
+			lastreg=reg;
+			len=dropped ? 0 : 1;
+			instruction=true;
+		}
+		if(cursor==cursors.end())
+			continue;
+		if(code && instruction && len)
+		{
+			bool hit=coverage.Count(cursor->second,cursor->second+len)>0;
+			bool &l=record.lines[line];
+			l=l || hit;
+			if(!cfile.empty())
+			{
+				if(!records.count(cfile))
+					sources.push_back(cfile);
+				Record &c=records[cfile];
+				bool &cl=c.lines[cline];
+				cl=cl || hit;
+				if(haspending)
+				{
+					pending.line=cline;
+					c.functions.push_back(pending);
+					haspending=false;
+				}
+			}
+		}
+		cursor->second+=len;
+	}
+	fclose(f);
+}
+
+
+void EightThirtyTwoLCOV::WriteRecord(FILE *f,const std::string &source,const Record &r)
+{
+	fprintf(f,"TN:\nSF:%s\n",source.c_str());
+	int hit=0;
+	for(unsigned int i=0;i<r.functions.size();++i)
+		fprintf(f,"FN:%d,%s\n",r.functions[i].line,r.functions[i].name.c_str());
+	for(unsigned int i=0;i<r.functions.size();++i)
+	{
+		fprintf(f,"FNDA:%d,%s\n",r.functions[i].hit ? 1 : 0,r.functions[i].name.c_str());
+		if(r.functions[i].hit)
+			++hit;
+	}
+	fprintf(f,"FNF:%d\nFNH:%d\n",int(r.functions.size()),hit);
+	hit=0;
+	for(std::map<int,bool>::const_iterator it=r.lines.begin();it!=r.lines.end();++it)
+	{
+		fprintf(f,"DA:%d,%d\n",it->first,it->second ? 1 : 0);
+		if(it->second)
+			++hit;
+	}
+	fprintf(f,"LF:%d\nLH:%d\nend_of_record\n",int(r.lines.size()),hit);
+}
+
+
+void EightThirtyTwoLCOV::Write(const char *filename)
+{
+	FILE *f;
+	if(!(f=FOpenUTF8(filename,"w")))
+		throw "Can't create lcov file";
+	for(unsigned int i=0;i<sources.size();++i)
+		WriteRecord(f,sources[i],records[sources[i]]);
+	fclose(f);
+}
+
@@ -0,0 +1,62 @@
+#ifndef LCOV_H
+#define LCOV_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "mapfile.h"
+#include "coverage.h"
+
+// Line coverage in lcov's tracefile format, for the assembly sources of a
+// program - the .asm files vbcc emits, or hand-written 832a sources.
+//
+// Each source is laid out as 832a would assemble it, starting from the
+// addresses the map file gives its sections and labels: the map's object file
+// with the same name as the source, less its extension, is taken to have
+// been assembled from it.  Instructions take a byte, except where 832a's
+// peephole optimiser removes an mt or mr; the lengths of .liconst, .lipcrel
+// and .liabs, which the linker may relax, are read from the program image.
+// Each label the map lists puts the layout back in step, so a map written
+// with 832l -M, which includes local labels, gives the most robust results.
+// Sections which were discarded by the linker aren't reported.
+//
+// A record is written for each source, with a line for each instruction in
+// a code section, hit if the CPU reached it, and a function for each global
+// label.  vbcc's "//file, line n" comments attribute the code which follows
+// them to a line of C, so a record is also written for each C file they name.
+
+class EightThirtyTwoLCOV
+{
+	public:
+	EightThirtyTwoLCOV(EightThirtyTwoSymbolMap &symbols,EightThirtyTwoCoverage &coverage,
+		const unsigned char *image,unsigned int imagesize);
+	~EightThirtyTwoLCOV();
+	void AddSource(const char *filename);
+	void Write(const char *filename);
+	protected:
+	struct Function
+	{
+		std::string name;
+		int line;
+		bool hit;
+	};
+	struct Record
+	{
+		std::map<int,bool> lines;	// Hit by line number
+		std::vector<Function> functions;
+	};
+	int FindObject(const std::string &source);
+	unsigned int LiLength(unsigned int addr);
+	void WriteRecord(FILE *f,const std::string &source,const Record &r);
+	EightThirtyTwoSymbolMap &symbols;
+	EightThirtyTwoCoverage &coverage;
+	const unsigned char *image;
+	unsigned int imagesize;
+	std::vector<std::string> sources;	// In the order added, then C sources in order of appearance
+	std::map<std::string,Record> records;
+};
+
+#endif
+
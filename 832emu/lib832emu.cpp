@@ -0,0 +1,258 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <exception>
+
+#include "emulator.h"
+#include "lib832emu.h"
+
+
+// A peripheral implemented by the host.
+
+class EightThirtyTwoCallbackDevice : public EightThirtyTwoDevice
+{
+	public:
+	EightThirtyTwoCallbackDevice(const char *name,e832emu_readfn readfn,e832emu_writefn writefn,void *userdata)
+		: EightThirtyTwoDevice(name), readfn(readfn), writefn(writefn), userdata(userdata)
+	{
+	}
+	virtual unsigned int Read(unsigned int offset,e32size size)
+	{
+		return(readfn ? readfn(userdata,offset,size) : 0);
+	}
+	virtual void Write(unsigned int offset,unsigned int v,e32size size)
+	{
+		if(writefn)
+			writefn(userdata,offset,v,size);
+	}
+	protected:
+	e832emu_readfn readfn;
+	e832emu_writefn writefn;
+	void *userdata;
+};
+
+
+struct e832emu
+{
+	e832emu(const char *memorymap) : memory(memorymap), devices(0)
+	{
+	}
+	EightThirtyTwoMemory memory;
+	EightThirtyTwoEmu emu;
+	std::string uartin;
+	std::string uartout;
+	std::string error;
+	int devices;	// For naming callback devices
+};
+
+
+extern "C" {
+
+struct e832emu *e832emu_new(const char *memorymap,int flags)
+{
+	e832emu *e=0;
+	try
+	{
+		e=new e832emu(memorymap);
+		e->emu.SetEndian(flags&E832EMU_BIGENDIAN ? BIGENDIAN : LITTLEENDIAN);
+		e->emu.SetJIT(flags&E832EMU_JIT);
+		e->memory.SetUARTOut(&e->uartout);
+		e->emu.Reset(e->memory);
+		return(e);
+	}
+	catch(const char *err)
+	{
+		Debug[ERROR] << "Error: " << err << std::endl;
+	}
+	catch(const std::exception &err)
+	{
+		Debug[ERROR] << "Error: " << err.what() << std::endl;
+	}
+	delete e;
+	return(0);
+}
+
+
+void e832emu_delete(struct e832emu *emu)
+{
+	delete emu;
+}
+
+
+const char *e832emu_error(struct e832emu *emu)
+{
+	return(emu->error.c_str());
+}
+
+
+int e832emu_load(struct e832emu *emu,unsigned int addr,const void *data,unsigned int len)
+{
+	try
+	{
+		emu->memory.LoadImage(addr,(const unsigned char *)data,len);
+		emu->emu.MemoryChanged(addr,len);
+		return(0);
+	}
+	catch(const char *err)
+	{
+		emu->error=err;
+	}
+	catch(const std::exception &err)
+	{
+		emu->error=err.what();
+	}
+	return(-1);
+}
+
+
+int e832emu_mapdevice(struct e832emu *emu,unsigned int base,unsigned int size,
+	e832emu_readfn read,e832emu_writefn write,void *userdata)
+{
+	EightThirtyTwoCallbackDevice *device=0;
+	try
+	{
+		char name[32];
+		snprintf(name,sizeof(name),"callback%d",emu->devices++);
+		device=new EightThirtyTwoCallbackDevice(name,read,write,userdata);
+		emu->memory.MapDevice(base,size,device);
+		return(0);
+	}
+	catch(const char *err)
+	{
+		emu->error=err;
+	}
+	catch(const std::exception &err)
+	{
+		emu->error=err.what();
+	}
+	delete device;
+	return(-1);
+}
+
+
+int e832emu_reset(struct e832emu *emu)
+{
+	try
+	{
+		emu->emu.Reset(emu->memory);
+		return(0);
+	}
+	catch(const char *err)
+	{
+		emu->error=err;
+	}
+	catch(const std::exception &err)
+	{
+		emu->error=err.what();
+	}
+	return(-1);
+}
+
+
+int e832emu_step(struct e832emu *emu,int count)
+{
+	try
+	{
+		return(emu->emu.Advance(count));
+	}
+	catch(const char *err)
+	{
+		emu->error=err;
+	}
+	catch(const std::exception &err)
+	{
+		emu->error=err.what();
+	}
+	return(-1);
+}
+
+
+int e832emu_exitstatus(struct e832emu *emu)
+{
+	return(emu->emu.HasExited() ? emu->emu.GetExitStatus() : -1);
+}
+
+
+unsigned long long e832emu_getcycles(struct e832emu *emu)
+{
+	return(emu->emu.GetCycles());
+}
+
+
+unsigned int e832emu_getreg(struct e832emu *emu,int reg)
+{
+	return(emu->emu.GetRegister(reg));
+}
+
+
+void e832emu_setreg(struct e832emu *emu,int reg,unsigned int value)
+{
+	emu->emu.SetRegister(reg,value);
+}
+
+
+unsigned int e832emu_read(struct e832emu *emu,unsigned int addr,int size)
+{
+	try
+	{
+		return(emu->memory.Read(addr,emu->emu.GetEndian(),e32size(size)));
+	}
+	catch(const char *err)
+	{
+		emu->error=err;
+	}
+	catch(const std::exception &err)
+	{
+		emu->error=err.what();
+	}
+	return(0);
+}
+
+
+int e832emu_write(struct e832emu *emu,unsigned int addr,unsigned int value,int size)
+{
+	try
+	{
+		emu->memory.Write(addr,value,emu->emu.GetEndian(),e32size(size));
+		emu->emu.MemoryChanged(addr,size==E832EMU_WORD ? 4 : (size==E832EMU_HALFWORD ? 2 : 1));
+		return(0);
+	}
+	catch(const char *err)
+	{
+		emu->error=err;
+	}
+	catch(const std::exception &err)
+	{
+		emu->error=err.what();
+	}
+	return(-1);
+}
+
+
+int e832emu_setuartin(struct e832emu *emu,const char *input)
+{
+	try
+	{
+		emu->uartin=input;
+		emu->memory.SetUARTIn(emu->uartin.c_str());
+		return(0);
+	}
+	catch(const std::exception &err)
+	{
+		emu->error=err.what();
+	}
+	return(-1);
+}
+
+
+unsigned int e832emu_getuartout(struct e832emu *emu,char *buf,unsigned int len)
+{
+	if(len>emu->uartout.size())
+		len=emu->uartout.size();
+	memcpy(buf,emu->uartout.data(),len);
+	emu->uartout.erase(0,len);
+	return(len);
+}
+
+}
+
@@ -0,0 +1,86 @@
+#ifndef LIB832EMU_H
+#define LIB832EMU_H
+
+/* lib832emu - the EightThirtyTwo emulator as a library, with a C interface so
+   that test harnesses and other hosts can run many emulated CPUs in-process.
+
+   Each emulator has its own memory map, built from a map file as for 832e -M,
+   or the default map if none is given.  Programs are loaded from memory, and
+   further peripherals can be mapped with read and write callbacks; regions
+   mapped later take precedence over earlier ones.  The UART's output is kept
+   for the host to collect rather than written to stdout.
+
+   Functions returning int return zero on success, or -1 on failure, in which
+   case e832emu_error() describes the problem.  Emulators are independent, so
+   different threads can run different emulators at the same time.  Once the
+   program's memory has been touched, stepping allocates nothing. */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Flags for e832emu_new() */
+#define E832EMU_BIGENDIAN 1
+#define E832EMU_JIT 2	/* Translate frequently executed code to native code (x86-64 hosts only) */
+
+/* Registers for e832emu_getreg() and e832emu_setreg(), following r0 - r7 */
+#define E832EMU_REG_TMP 8
+#define E832EMU_REG_ZERO 9
+#define E832EMU_REG_CARRY 10
+#define E832EMU_REG_COND 11
+
+/* Access sizes */
+#define E832EMU_WORD 0
+#define E832EMU_HALFWORD 1
+#define E832EMU_BYTE 2
+
+/* Peripheral callbacks.  The offset is relative to the start of the region. */
+typedef unsigned int (*e832emu_readfn)(void *userdata,unsigned int offset,int size);
+typedef void (*e832emu_writefn)(void *userdata,unsigned int offset,unsigned int value,int size);
+
+struct e832emu;
+
+/* Returns NULL if the memory map can't be read. */
+struct e832emu *e832emu_new(const char *memorymap,int flags);
+void e832emu_delete(struct e832emu *emu);
+const char *e832emu_error(struct e832emu *emu);
+
+/* Copies data into RAM or ROM, bypassing write protection. */
+int e832emu_load(struct e832emu *emu,unsigned int addr,const void *data,unsigned int len);
+/* Either callback may be NULL; reads then return zero. */
+int e832emu_mapdevice(struct e832emu *emu,unsigned int base,unsigned int size,
+	e832emu_readfn read,e832emu_writefn write,void *userdata);
+
+/* Puts the CPU into its reset state, with the PC at zero and the stack pointer
+   at 0x800000, as 832e does.  Memory and peripherals are left alone.  New
+   emulators start in this state. */
+int e832emu_reset(struct e832emu *emu);
+/* Runs up to count instructions, returning the number executed, which is fewer
+   if the CPU is paused by cond NEX with no timer to wake it or the program has
+   exited, or -1 on failure. */
+int e832emu_step(struct e832emu *emu,int count);
+/* The status the program gave the semihosting exit call, or -1 if it hasn't
+   made it since reset. */
+int e832emu_exitstatus(struct e832emu *emu);
+/* Emulated clock cycles since reset - one per instruction, plus time spent paused. */
+unsigned long long e832emu_getcycles(struct e832emu *emu);
+
+unsigned int e832emu_getreg(struct e832emu *emu,int reg);
+void e832emu_setreg(struct e832emu *emu,int reg,unsigned int value);
+
+/* Memory accesses as made by the CPU, including to peripherals.  A failed read
+   returns zero and a failed write -1, leaving the reason in e832emu_error(). */
+unsigned int e832emu_read(struct e832emu *emu,unsigned int addr,int size);
+int e832emu_write(struct e832emu *emu,unsigned int addr,unsigned int value,int size);
+
+/* The UART reads from a copy of input until its end.  Returns -1 on failure. */
+int e832emu_setuartin(struct e832emu *emu,const char *input);
+/* Moves up to len bytes written to the UART into buf, returning the number moved. */
+unsigned int e832emu_getuartout(struct e832emu *emu,char *buf,unsigned int len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
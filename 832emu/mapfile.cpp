@@ -0,0 +1,236 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+
+#include "debug.h"
+#include "util.h"
+#include "mapfile.h"
+
+
+static bool symbol_compare(const EightThirtyTwoSymbol &a,const EightThirtyTwoSymbol &b)
+{
+	return(a.address<b.address);
+}
+
+
+// Labels beginning with '.' are local to an assembly file, while vbcc
+// emits its internal labels as 'l' followed by digits.
+
+static bool symbol_islocal(const char *name)
+{
+	if(name[0]=='.')
+		return(true);
+	if(name[0]=='l' && name[1])
+	{
+		const char *p=name+1;
+		while(*p && isdigit(*p))
+			++p;
+		return(*p==0);
+	}
+	return(false);
+}
+
+
+EightThirtyTwoSymbolMap::EightThirtyTwoSymbolMap()
+{
+}
+
+
+EightThirtyTwoSymbolMap::EightThirtyTwoSymbolMap(const char *filename)
+{
+	Load(filename);
+}
+
+
+EightThirtyTwoSymbolMap::~EightThirtyTwoSymbolMap()
+{
+}
+
+
+// Map file lines take the form "0x00000000 Section: file,section"
+// or "0x00000000    symbol".
+
+void EightThirtyTwoSymbolMap::Load(const char *filename)
+{
+	FILE *f;
+	if(!(f=FOpenUTF8(filename,"r")))
+		throw "Can't open map file";
+
+	char line[1024];
+	int section=-1;
+	while(fgets(line,sizeof(line),f))
+	{
+		char *endptr;
+		unsigned long v=strtoul(line,&endptr,0);
+		if(endptr==line)
+			continue;
+		while(*endptr==' ' || *endptr=='\t')
+			++endptr;
+		char *end=endptr+strlen(endptr);
+		while(end>endptr && isspace(end[-1]))
+			*--end=0;
+		if(strncmp(endptr,"Section:",8)==0)
+		{
+			// The section's name follows the last comma, since the file name may contain one.
+			char *name=strrchr(endptr,',');
+			if(!name)
+				continue;
+			*name++=0;
+			endptr+=8;
+			while(*endptr==' ' || *endptr=='\t')
+				++endptr;
+			EightThirtyTwoSection sect;
+			sect.address=v;
+			sect.file=endptr;
+			sect.name=name;
+			section=sections.size();
+			sections.push_back(sect);
+			continue;
+		}
+		if(!*endptr)
+			continue;
+		EightThirtyTwoSymbol sym;
+		sym.address=v;
+		sym.name=endptr;
+		sym.local=symbol_islocal(endptr);
+		sym.section=section;
+		symbols.push_back(sym);
+	}
+	fclose(f);
+	std::stable_sort(symbols.begin(),symbols.end(),symbol_compare);
+	Debug[TRACE] << "Loaded " << symbols.size() << " symbols from " << filename << std::endl;
+}
+
+
+int EightThirtyTwoSymbolMap::GetCount()
+{
+	return(symbols.size());
+}
+
+
+bool EightThirtyTwoSymbolMap::IsEmpty()
+{
+	return(symbols.empty());
+}
+
+
+const EightThirtyTwoSymbol &EightThirtyTwoSymbolMap::operator[](int idx)
+{
+	return(symbols[idx]);
+}
+
+
+int EightThirtyTwoSymbolMap::Find(const char *name)
+{
+	for(unsigned int i=0;i<symbols.size();++i)
+	{
+		if(symbols[i].name==name)
+			return(i);
+	}
+	return(-1);
+}
+
+
+int EightThirtyTwoSymbolMap::FindFunction(unsigned int addr)
+{
+	// Binary search for the last symbol at or below addr, then step back over local labels.
+	int lo=0;
+	int hi=symbols.size();
+	while(lo<hi)
+	{
+		int mid=(lo+hi)/2;
+		if(symbols[mid].address<=addr)
+			lo=mid+1;
+		else
+			hi=mid;
+	}
+	int i=lo-1;
+	while(i>=0 && symbols[i].local)
+		--i;
+	// Where several functions share an address, report the first.
+	while(i>0 && !symbols[i-1].local && symbols[i-1].address==symbols[i].address)
+		--i;
+	return(i);
+}
+
+
+unsigned int EightThirtyTwoSymbolMap::FunctionEnd(int idx)
+{
+	for(unsigned int i=idx+1;i<symbols.size();++i)
+	{
+		if(!symbols[i].local && symbols[i].address>symbols[idx].address)
+			return(symbols[i].address);
+	}
+	return(0xffffffff);
+}
+
+
+bool EightThirtyTwoSymbolMap::Resolve(const char *str,unsigned int &addr)
+{
+	char *endptr;
+	unsigned long v=strtoul(str,&endptr,0);
+	if(endptr!=str && *endptr==0)
+	{
+		addr=v;
+		return(true);
+	}
+	int idx=Find(str);
+	if(idx>=0)
+	{
+		addr=symbols[idx].address;
+		return(true);
+	}
+	return(false);
+}
+
+
+std::string EightThirtyTwoSymbolMap::Describe(unsigned int addr)
+{
+	char buf[32];
+	int idx=FindFunction(addr);
+	if(idx<0)
+	{
+		snprintf(buf,sizeof(buf),"0x%x",addr);
+		return(buf);
+	}
+	std::string result=symbols[idx].name;
+	if(addr!=symbols[idx].address)
+	{
+		snprintf(buf,sizeof(buf),"+0x%x",addr-symbols[idx].address);
+		result+=buf;
+	}
+	return(result);
+}
+
+
+int EightThirtyTwoSymbolMap::GetSectionCount()
+{
+	return(sections.size());
+}
+
+
+const EightThirtyTwoSection &EightThirtyTwoSymbolMap::GetSection(int idx)
+{
+	return(sections[idx]);
+}
+
+
+unsigned int EightThirtyTwoSymbolMap::SectionEnd(int idx)
+{
+	unsigned int end=0xffffffff;
+	for(unsigned int i=0;i<sections.size();++i)
+	{
+		if(sections[i].address>sections[idx].address && sections[i].address<end)
+			end=sections[i].address;
+	}
+	return(end);
+}
+
+
+bool EightThirtyTwoSymbolMap::IsCode(int idx)
+{
+	const std::string &name=sections[idx].name;
+	return(name.compare(0,5,".text")==0 && (name.size()==5 || name[5]=='.'));
+}
@@ -0,0 +1,65 @@
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#include <string>
+#include <vector>
+
+// Symbol table loaded from a map file written by 832l -m or -M.
+// Symbols are kept sorted by address so that an address can be
+// attributed to the function containing it.  The sections are kept
+// too, in the order the map lists them, along with the object file
+// each came from.
+
+struct EightThirtyTwoSymbol
+{
+	unsigned int address;
+	std::string name;
+	bool local;	// Local label (.label or vbcc's lnnn) rather than a function
+	int section;	// Index of the section the map lists the symbol under, or -1
+};
+
+
+struct EightThirtyTwoSection
+{
+	unsigned int address;
+	std::string file;	// Object file, or "<internal>" for the linker's own sections
+	std::string name;
+};
+
+
+class EightThirtyTwoSymbolMap
+{
+	public:
+	EightThirtyTwoSymbolMap();
+	EightThirtyTwoSymbolMap(const char *filename);
+	~EightThirtyTwoSymbolMap();
+	void Load(const char *filename);
+	int GetCount();
+	bool IsEmpty();
+	const EightThirtyTwoSymbol &operator[](int idx);
+	// Returns the index of the named symbol, or -1 if not found.
+	int Find(const char *name);
+	// Returns the index of the function containing addr, or -1 if addr precedes
+	// all functions.  Local labels are skipped.
+	int FindFunction(unsigned int addr);
+	// Returns the address of the next function after the one at index idx,
+	// or 0xffffffff if it's the last.
+	unsigned int FunctionEnd(int idx);
+	// Parses either a symbol name or a numeric address.
+	bool Resolve(const char *str,unsigned int &addr);
+	// Formats addr as function+offset, or as a plain hex value if there's no function.
+	std::string Describe(unsigned int addr);
+	int GetSectionCount();
+	const EightThirtyTwoSection &GetSection(int idx);
+	// Returns the address of the next section after the one at index idx,
+	// or 0xffffffff if it's the last.
+	unsigned int SectionEnd(int idx);
+	// True if the section holds code - .text, or .text followed by a suffix.
+	bool IsCode(int idx);
+	protected:
+	std::vector<EightThirtyTwoSymbol> symbols;
+	std::vector<EightThirtyTwoSection> sections;
+};
+
+#endif
+
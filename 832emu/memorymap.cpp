@@ -0,0 +1,869 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "debug.h"
+#include "util.h"
+#include "memorymap.h"
+#include "peripherals.h"
+
+
+EightThirtyTwoMemory::EightThirtyTwoMemory(const char *filename) : pages(0), snapshotpages(0), watchhit(false), uart(0), clock(0), frequency(100000000), nextevent(0), interrupt(false), quietuntil(0)
+{
+	pages=(EightThirtyTwoPage *)calloc(MEMORY_PAGES,sizeof(EightThirtyTwoPage));
+	if(!pages)
+		throw "Can't allocate page table";
+	try
+	{
+		if(filename)
+			LoadMap(filename);
+		else
+			DefaultMap();
+	}
+	catch(...)
+	{
+		// The destructor won't run for a half-built map, so free what it would.
+		Release();
+		throw;
+	}
+}
+
+
+EightThirtyTwoMemory::~EightThirtyTwoMemory()
+{
+	Release();
+}
+
+
+void EightThirtyTwoMemory::Release()
+{
+	for(unsigned int i=0;i<allocated.size();++i)
+	{
+		if(!pages[allocated[i]].borrowed)
+			free(pages[allocated[i]].data);
+		free(pages[allocated[i]].copy);
+	}
+	for(std::map<std::string,EightThirtyTwoDevice *>::iterator it=devices.begin();it!=devices.end();++it)
+		delete it->second;
+	devices.clear();
+	if(pages)
+		free(pages);
+	pages=0;
+}
+
+
+// RAM throughout the lower half of the address space, so that stacks and BSS can be
+// placed anywhere within it, and the peripherals found on the various SoCs built
+// around the CPU.
+
+void EightThirtyTwoMemory::DefaultMap()
+{
+	MapRAM(0,0x80000000);
+	MapDevice(0xda8000,4,"uart",16);
+	MapDevice(0xfffffc00,12,"timer");
+	MapDevice(0xffffff84,4,"uart");
+	MapDevice(0xffffff88,4,"uart_divisor");
+	MapDevice(0xffffff8c,4,"overlay");
+	MapDevice(0xffffff90,4,"hex");
+	MapDevice(0xffffffa0,16,"semihost");
+	MapDevice(0xffffffc0,4,"uart");
+	MapDevice(0xffffffc4,4,"spi_cs");
+	MapDevice(0xffffffc8,4,"milliseconds");	// The SPI data register on most SoCs, but Dhrystone expects a timer here.
+	MapDevice(0xffffffcc,4,"spi_pump");
+	MapDevice(0xfffffffc,4,"breadcrumb");
+}
+
+
+// Memory map files contain one region per line, in the form
+//   ram base size
+//   rom base size
+//   type base [size [shift]]
+// where type names a peripheral.  Everything after a '#' is ignored.
+
+void EightThirtyTwoMemory::LoadMap(const char *filename)
+{
+	FILE *f;
+	if(!(f=FOpenUTF8(filename,"r")))
+		throw "Can't open memory map";
+
+	try
+	{
+		char line[1024];
+		int lineno=0;
+		while(fgets(line,sizeof(line),f))
+		{
+			++lineno;
+			char *c=strchr(line,'#');
+			if(c)
+				*c=0;
+			char type[64];
+			char base[32],size[32]="4",shift[32]="0";
+			int fields=sscanf(line,"%63s %31s %31s %31s",type,base,size,shift);
+			if(fields<=0)
+				continue;
+			if(fields<2)
+			{
+				Debug[ERROR] << "Memory map line " << std::dec << lineno << std::hex << ": missing base address" << std::endl;
+				throw "Bad memory map";
+			}
+			unsigned int b=strtoul(base,0,0);
+			unsigned int s=strtoul(size,0,0);
+			if(strcmp(type,"ram")==0)
+				MapRAM(b,s);
+			else if(strcmp(type,"rom")==0)
+				MapRAM(b,s,false);
+			else
+				MapDevice(b,s,type,strtoul(shift,0,0));
+		}
+	}
+	catch(...)
+	{
+		fclose(f);
+		throw;
+	}
+	fclose(f);
+}
+
+
+void EightThirtyTwoMemory::MapRAM(unsigned int base,unsigned int size,bool writable)
+{
+	EightThirtyTwoRegion region;
+	region.base=base;
+	region.size=size;
+	region.writable=writable;
+	region.device=0;
+	region.shift=0;
+	AddRegion(region);
+}
+
+
+void EightThirtyTwoMemory::MapDevice(unsigned int base,unsigned int size,const char *type,int shift)
+{
+	std::map<std::string,EightThirtyTwoDevice *>::iterator it=devices.find(type);
+	if(it!=devices.end())
+	{
+		MapDevice(base,size,it->second,shift);
+		return;
+	}
+	EightThirtyTwoDevice *device=EightThirtyTwoNewDevice(type);
+	try
+	{
+		MapDevice(base,size,device,shift);
+	}
+	catch(...)
+	{
+		delete device;
+		throw;
+	}
+	if(strcmp(type,"uart")==0)
+		uart=(EightThirtyTwoUART *)device;
+}
+
+
+void EightThirtyTwoMemory::MapDevice(unsigned int base,unsigned int size,EightThirtyTwoDevice *device,int shift)
+{
+	EightThirtyTwoRegion region;
+	region.base=base;
+	region.size=size;
+	region.writable=true;
+	region.shift=shift;
+	region.device=device;
+
+	std::map<std::string,EightThirtyTwoDevice *>::iterator it=devices.find(device->GetName());
+	if(it!=devices.end() && it->second!=device)
+		throw "A different device of the same name is already mapped";
+	AddRegion(region);
+	if(it==devices.end())
+	{
+		devices[device->GetName()]=device;
+		device->Attach(this);
+	}
+}
+
+
+// Pages touched by a device always take the slow path.  Other pages get their
+// pointers when they're allocated.
+
+void EightThirtyTwoMemory::AddRegion(EightThirtyTwoRegion &region)
+{
+	if(!region.size)
+		return;
+	regions.push_back(region);
+
+	if(region.device)
+	{
+		unsigned int first=region.base>>MEMORY_PAGEBITS;
+		unsigned int last=(region.base+region.size-1)>>MEMORY_PAGEBITS;
+		for(unsigned int page=first;page<=last;++page)
+			pages[page].read=pages[page].write=0;
+	}
+}
+
+
+// Allocates backing store for a page.  The page is given host pointers only if a
+// single RAM or ROM region covers all of it and no device overlaps it.
+
+unsigned char *EightThirtyTwoMemory::AllocatePage(unsigned int page)
+{
+	EightThirtyTwoPage &p=pages[page];
+	if(p.data)
+		return(p.data);
+	if(!(p.data=(unsigned char *)calloc(MEMORY_PAGESIZE,1)))
+		throw "Can't allocate RAM";
+	allocated.push_back(page);
+	MapPage(page);
+	return(p.data);
+}
+
+
+void EightThirtyTwoMemory::MapPage(unsigned int page)
+{
+	EightThirtyTwoPage &p=pages[page];
+	unsigned int pagebase=page<<MEMORY_PAGEBITS;
+	p.read=p.write=0;
+	for(unsigned int i=0;i<regions.size();++i)
+	{
+		EightThirtyTwoRegion &r=regions[i];
+		unsigned int start=pagebase-r.base;
+		if(r.device)
+		{
+			if(r.base-pagebase<MEMORY_PAGESIZE || start<r.size)
+			{
+				p.read=p.write=0;
+				return;
+			}
+		}
+		else if(start<r.size && r.size-start>=MEMORY_PAGESIZE)
+		{
+			p.read=p.data;
+			p.write=r.writable ? p.data : 0;
+		}
+	}
+	// Pages shared with a snapshot take the slow path for writes until they're copied.
+	if(p.shared)
+		p.write=0;
+	if(p.watched)
+		p.read=p.write=0;
+}
+
+
+// Takes a copy of a page shared with the snapshot, before its first write.
+
+void EightThirtyTwoMemory::Unshare(unsigned int page)
+{
+	EightThirtyTwoPage &p=pages[page];
+	if(!p.copy && !(p.copy=(unsigned char *)malloc(MEMORY_PAGESIZE)))
+		throw "Can't allocate RAM";
+	memcpy(p.copy,p.data,MEMORY_PAGESIZE);
+	p.shared=false;
+	dirty.push_back(page);
+	MapPage(page);
+}
+
+
+// Later regions take precedence over earlier ones.
+
+EightThirtyTwoRegion *EightThirtyTwoMemory::FindRegion(unsigned int addr)
+{
+	for(int i=regions.size()-1;i>=0;--i)
+	{
+		if(addr-regions[i].base<regions[i].size)
+			return(&regions[i]);
+	}
+	return(0);
+}
+
+
+unsigned char EightThirtyTwoMemory::SlowPeek(unsigned int addr)
+{
+	const EightThirtyTwoPage &p=pages[addr>>MEMORY_PAGEBITS];
+	if(p.data)
+		return(p.data[addr&MEMORY_PAGEMASK]);
+	return(0);
+}
+
+
+unsigned int EightThirtyTwoMemory::SlowRead(unsigned int addr,e32endian endian,e32size opsize)
+{
+	unsigned int result=0;
+	EightThirtyTwoRegion *r=FindRegion(addr);
+	if(r && r->device)
+	{
+		unsigned long long until=r->device->GetQuietUntil(addr-r->base,GetCycles());
+		if(until<quietuntil)
+			quietuntil=until;
+		result=r->device->Read(addr-r->base,opsize);
+	}
+	else
+	{
+		// First access to a page, an access straddling a page boundary, or a watched page.
+		int bytes=opsize==WORD ? 4 : (opsize==HALFWORD ? 2 : 1);
+		for(int i=0;i<bytes;++i)
+		{
+			unsigned int a=addr+i;
+			unsigned int b=0;
+			r=FindRegion(a);
+			if(r && !r->device)
+				b=AllocatePage(a>>MEMORY_PAGEBITS)[a&MEMORY_PAGEMASK];
+			else
+				Debug[COMMENT] << std::endl << "Reading from unmapped address " << a << std::endl;
+			if(endian==BIGENDIAN)
+				result=(result<<8)|b;
+			else
+				result|=b<<(i*8);
+		}
+	}
+	if(!watchpoints.empty())
+		CheckWatchpoints(addr,result,opsize,WATCH_READ);
+	return(result);
+}
+
+
+void EightThirtyTwoMemory::SlowWrite(unsigned int addr,unsigned int v,e32endian endian,e32size opsize)
+{
+	if(!watchpoints.empty())
+		CheckWatchpoints(addr,v,opsize,WATCH_WRITE);
+	EightThirtyTwoRegion *r=FindRegion(addr);
+	if(r && r->device)
+	{
+		r->device->Write(addr-r->base,v>>r->shift,opsize);
+		return;
+	}
+
+	int bytes=opsize==WORD ? 4 : (opsize==HALFWORD ? 2 : 1);
+	for(int i=0;i<bytes;++i)
+	{
+		unsigned int a=addr+i;
+		unsigned char b=endian==BIGENDIAN ? v>>((bytes-1-i)*8) : v>>(i*8);
+		r=FindRegion(a);
+		if(r && !r->device && r->writable)
+		{
+			unsigned char *data=AllocatePage(a>>MEMORY_PAGEBITS);
+			if(pages[a>>MEMORY_PAGEBITS].shared)
+				Unshare(a>>MEMORY_PAGEBITS);
+			data[a&MEMORY_PAGEMASK]=b;
+		}
+		else
+			Debug[COMMENT] << std::endl << "Writing to " << (r ? "read-only" : "unmapped") << " address " << a << std::endl;
+	}
+}
+
+
+void EightThirtyTwoMemory::CheckWatchpoints(unsigned int addr,unsigned int v,e32size opsize,int flags)
+{
+	unsigned int bytes=opsize==WORD ? 4 : (opsize==HALFWORD ? 2 : 1);
+	for(unsigned int i=0;i<watchpoints.size();++i)
+	{
+		const EightThirtyTwoWatchpoint &w=watchpoints[i];
+		if((w.flags&flags) && addr<w.end && addr+bytes>w.start && !watchhit)
+		{
+			watchhit=true;
+			lastwatch.addr=addr;
+			lastwatch.value=v;
+			lastwatch.size=opsize;
+			lastwatch.flags=flags;
+			if(clock)
+				clock->Reschedule();
+		}
+	}
+}
+
+
+// Recomputes the watched flag of the pages covering a range of addresses.
+
+void EightThirtyTwoMemory::WatchPages(unsigned int start,unsigned int end)
+{
+	if(end<=start)
+		return;
+	for(unsigned int page=start>>MEMORY_PAGEBITS;page<=(end-1)>>MEMORY_PAGEBITS;++page)
+	{
+		unsigned int pagebase=page<<MEMORY_PAGEBITS;
+		bool watched=false;
+		for(unsigned int i=0;i<watchpoints.size();++i)
+		{
+			if(watchpoints[i].start<=pagebase+MEMORY_PAGEMASK && watchpoints[i].end>pagebase)
+				watched=true;
+		}
+		pages[page].watched=watched;
+		MapPage(page);
+	}
+}
+
+
+void EightThirtyTwoMemory::AddWatchpoint(unsigned int start,unsigned int end,int flags)
+{
+	if(end<=start)
+		throw "Watchpoint range is empty";
+	EightThirtyTwoWatchpoint w;
+	w.start=start;
+	w.end=end;
+	w.flags=flags;
+	watchpoints.push_back(w);
+	WatchPages(start,end);
+}
+
+
+void EightThirtyTwoMemory::RemoveWatchpoint(unsigned int start,unsigned int end,int flags)
+{
+	for(unsigned int i=0;i<watchpoints.size();++i)
+	{
+		if(watchpoints[i].start==start && watchpoints[i].end==end && watchpoints[i].flags==flags)
+		{
+			watchpoints.erase(watchpoints.begin()+i);
+			WatchPages(start,end);
+			return;
+		}
+	}
+}
+
+
+void EightThirtyTwoMemory::ClearWatchpoints()
+{
+	std::vector<EightThirtyTwoWatchpoint> old;
+	old.swap(watchpoints);
+	for(unsigned int i=0;i<old.size();++i)
+		WatchPages(old[i].start,old[i].end);
+	watchhit=false;
+}
+
+
+// Finds whether any watchpoint of the given kind covers part of a range.
+
+bool EightThirtyTwoMemory::IsWatched(unsigned int start,unsigned int end,int flags)
+{
+	for(unsigned int i=0;i<watchpoints.size();++i)
+	{
+		const EightThirtyTwoWatchpoint &w=watchpoints[i];
+		if((w.flags&flags) && start<w.end && end>w.start)
+			return(true);
+	}
+	return(false);
+}
+
+
+// Steps a region at a time, stopping early wherever a later region starts,
+// since it takes precedence.
+
+unsigned int EightThirtyTwoMemory::GetMemorySpan(unsigned int addr,unsigned int len)
+{
+	unsigned int result=0;
+	while(result<len)
+	{
+		EightThirtyTwoRegion *r=FindRegion(addr);
+		if(!r || r->device)
+			break;
+		unsigned int span=r->size-(addr-r->base);
+		for(unsigned int i=r-&regions[0]+1;i<regions.size();++i)
+		{
+			if(regions[i].base-addr<span)
+				span=regions[i].base-addr;
+		}
+		if(span>=len-result)
+			return(len);
+		addr+=span;
+		result+=span;
+	}
+	return(result);
+}
+
+
+void EightThirtyTwoMemory::Poke(unsigned int addr,unsigned char v)
+{
+	const EightThirtyTwoPage &page=pages[addr>>MEMORY_PAGEBITS];
+	if(page.write)
+	{
+		page.write[addr&MEMORY_PAGEMASK]=v;
+		return;
+	}
+	EightThirtyTwoRegion *r=FindRegion(addr);
+	if(r && !r->device && r->writable)
+	{
+		unsigned char *data=AllocatePage(addr>>MEMORY_PAGEBITS);
+		if(pages[addr>>MEMORY_PAGEBITS].shared)
+			Unshare(addr>>MEMORY_PAGEBITS);
+		data[addr&MEMORY_PAGEMASK]=v;
+	}
+}
+
+
+// Throws unless RAM or ROM covers every byte of the range.  Steps a region at a
+// time, stopping early wherever a later region starts, since it takes precedence.
+
+void EightThirtyTwoMemory::CheckImage(unsigned int addr,int len)
+{
+	unsigned int remaining=len>0 ? len : 0;
+	while(remaining)
+	{
+		EightThirtyTwoRegion *r=FindRegion(addr);
+		if(!r || r->device)
+			throw "Program doesn't fit within the memory map";
+		unsigned int span=r->size-(addr-r->base);
+		for(unsigned int i=r-&regions[0]+1;i<regions.size();++i)
+		{
+			if(regions[i].base-addr<span)
+				span=regions[i].base-addr;
+		}
+		if(span>=remaining)
+			return;
+		addr+=span;
+		remaining-=span;
+	}
+}
+
+
+void EightThirtyTwoMemory::LoadImage(unsigned int addr,const unsigned char *data,int len)
+{
+	CheckImage(addr,len);
+	while(len>0)
+	{
+		int offset=addr&MEMORY_PAGEMASK;
+		int chunk=MEMORY_PAGESIZE-offset;
+		if(chunk>len)
+			chunk=len;
+		memcpy(AllocatePage(addr>>MEMORY_PAGEBITS)+offset,data,chunk);
+		addr+=chunk;
+		data+=chunk;
+		len-=chunk;
+	}
+}
+
+
+void EightThirtyTwoMemory::MapImage(unsigned int addr,unsigned char *data,int len)
+{
+	CheckImage(addr,len);
+	while(len>=MEMORY_PAGESIZE && !(addr&MEMORY_PAGEMASK))
+	{
+		unsigned int page=addr>>MEMORY_PAGEBITS;
+		EightThirtyTwoPage &p=pages[page];
+		if(p.data)
+			memcpy(p.data,data,MEMORY_PAGESIZE);
+		else
+		{
+			p.data=data;
+			p.borrowed=true;
+			allocated.push_back(page);
+			MapPage(page);
+		}
+		addr+=MEMORY_PAGESIZE;
+		data+=MEMORY_PAGESIZE;
+		len-=MEMORY_PAGESIZE;
+	}
+	LoadImage(addr,data,len);
+}
+
+
+void EightThirtyTwoMemory::SetUARTIn(const char *c)
+{
+	if(uart)
+		uart->SetUARTIn(c);
+}
+
+
+void EightThirtyTwoMemory::SetUARTOut(std::string *out)
+{
+	if(uart)
+		uart->SetUARTOut(out);
+}
+
+
+void EightThirtyTwoMemory::SetUARTInFile(const char *filename)
+{
+	if(uart)
+		uart->SetUARTInFile(filename);
+}
+
+
+void EightThirtyTwoMemory::SetUARTTiming(int baud,int fifo)
+{
+	if(uart)
+		uart->SetTiming(baud,fifo);
+}
+
+
+void EightThirtyTwoMemory::FlushUART()
+{
+	if(uart)
+		uart->Flush();
+}
+
+
+void EightThirtyTwoMemory::SetReplaying(bool replaying)
+{
+	if(uart)
+		uart->SetReplaying(replaying);
+}
+
+
+unsigned int EightThirtyTwoMemory::GetResidentSize()
+{
+	return(allocated.size()*MEMORY_PAGESIZE);
+}
+
+
+
+void EightThirtyTwoMemory::SetClock(EightThirtyTwoClock *c,unsigned int f)
+{
+	clock=c;
+	frequency=f;
+}
+
+
+unsigned long long EightThirtyTwoMemory::GetCycles()
+{
+	return(clock ? clock->GetCycles() : 0);
+}
+
+
+// Replaces any event the device has already scheduled.
+
+void EightThirtyTwoMemory::Schedule(EightThirtyTwoDevice *device,unsigned long long cycle)
+{
+	bool sooner=events.empty() || cycle<nextevent;
+	events[device]=cycle;
+	FindNextEvent();
+	if(sooner && clock)
+		clock->Reschedule();
+}
+
+
+void EightThirtyTwoMemory::Cancel(EightThirtyTwoDevice *device)
+{
+	events.erase(device);
+	FindNextEvent();
+}
+
+
+void EightThirtyTwoMemory::FindNextEvent()
+{
+	std::map<EightThirtyTwoDevice *,unsigned long long>::iterator it=events.begin();
+	if(it!=events.end())
+		nextevent=it->second;
+	for(;it!=events.end();++it)
+	{
+		if(it->second<nextevent)
+			nextevent=it->second;
+	}
+}
+
+
+// Updates every device whose event is due.  Each device's event is removed
+// first, so it may schedule another.
+
+void EightThirtyTwoMemory::Update()
+{
+	unsigned long long now=GetCycles();
+	while(!events.empty() && nextevent<=now)
+	{
+		std::map<EightThirtyTwoDevice *,unsigned long long>::iterator it=events.begin();
+		while(it->second>now)
+			++it;
+		EightThirtyTwoDevice *device=it->first;
+		events.erase(it);
+		FindNextEvent();
+		device->Update(now);
+	}
+}
+
+
+void EightThirtyTwoMemory::UpdateInterrupt()
+{
+	bool raised=false;
+	for(std::map<std::string,EightThirtyTwoDevice *>::iterator it=devices.begin();it!=devices.end();++it)
+		raised|=it->second->GetInterrupt();
+	if(raised!=interrupt && clock)
+		clock->Reschedule();
+	interrupt=raised;
+}
+
+
+void EightThirtyTwoMemory::HostCall(unsigned int addr,unsigned int len)
+{
+	if(clock)
+		clock->HostCall(addr,len);
+}
+
+
+void EightThirtyTwoMemory::Exit(int status)
+{
+	if(clock)
+		clock->Exit(status);
+}
+
+
+void EightThirtyTwoWriteState(FILE *f,const std::vector<unsigned long long> &state)
+{
+	unsigned int count=state.size();
+	if(fwrite(&count,sizeof(count),1,f)!=1
+			|| (count && fwrite(&state[0],sizeof(unsigned long long),count,f)!=count))
+		throw "Can't write checkpoint";
+}
+
+
+void EightThirtyTwoReadState(FILE *f,std::vector<unsigned long long> &state)
+{
+	unsigned int count;
+	if(fread(&count,sizeof(count),1,f)!=1)
+		throw "Checkpoint is truncated";
+	state.resize(count);
+	if(count && fread(&state[0],sizeof(unsigned long long),count,f)!=count)
+		throw "Checkpoint is truncated";
+}
+
+
+static bool memory_iszero(const unsigned char *p,int len)
+{
+	while(len--)
+	{
+		if(*p++)
+			return(false);
+	}
+	return(true);
+}
+
+
+void EightThirtyTwoMemory::SaveState(FILE *f)
+{
+	std::vector<unsigned long long> saved;
+	for(unsigned int i=0;i<allocated.size();++i)
+	{
+		if(!memory_iszero(pages[allocated[i]].data,MEMORY_PAGESIZE))
+			saved.push_back(allocated[i]);
+	}
+	EightThirtyTwoWriteState(f,saved);
+	for(unsigned int i=0;i<saved.size();++i)
+	{
+		if(fwrite(pages[saved[i]].data,MEMORY_PAGESIZE,1,f)!=1)
+			throw "Can't write checkpoint";
+	}
+
+	std::vector<unsigned long long> state;
+	state.push_back(devices.size());
+	EightThirtyTwoWriteState(f,state);
+	for(std::map<std::string,EightThirtyTwoDevice *>::iterator it=devices.begin();it!=devices.end();++it)
+	{
+		unsigned int len=it->first.size();
+		if(fwrite(&len,sizeof(len),1,f)!=1 || fwrite(it->first.c_str(),1,len,f)!=len)
+			throw "Can't write checkpoint";
+		state.clear();
+		it->second->SaveState(state);
+		EightThirtyTwoWriteState(f,state);
+	}
+}
+
+
+void EightThirtyTwoMemory::RestoreState(FILE *f)
+{
+	// Pages are only written where they differ from the checkpoint, so those
+	// mapped from the program's image stay shared with the file.
+	std::vector<unsigned long long> saved;
+	EightThirtyTwoReadState(f,saved);
+	std::vector<bool> restored(MEMORY_PAGES);
+	std::vector<unsigned char> buf(MEMORY_PAGESIZE);
+	for(unsigned int i=0;i<saved.size();++i)
+	{
+		if(saved[i]>=MEMORY_PAGES || fread(&buf[0],MEMORY_PAGESIZE,1,f)!=1)
+			throw "Checkpoint is truncated";
+		unsigned char *data=AllocatePage(saved[i]);
+		if(memcmp(data,&buf[0],MEMORY_PAGESIZE))
+			memcpy(data,&buf[0],MEMORY_PAGESIZE);
+		restored[saved[i]]=true;
+	}
+	for(unsigned int i=0;i<allocated.size();++i)
+	{
+		unsigned char *data=pages[allocated[i]].data;
+		if(!restored[allocated[i]] && !memory_iszero(data,MEMORY_PAGESIZE))
+			memset(data,0,MEMORY_PAGESIZE);
+	}
+
+	std::vector<unsigned long long> state;
+	EightThirtyTwoReadState(f,state);
+	unsigned int count=state.size() ? state[0] : 0;
+	while(count--)
+	{
+		unsigned int len;
+		char name[256];
+		if(fread(&len,sizeof(len),1,f)!=1 || len>=sizeof(name) || fread(name,1,len,f)!=len)
+			throw "Checkpoint is truncated";
+		name[len]=0;
+		EightThirtyTwoReadState(f,state);
+		std::map<std::string,EightThirtyTwoDevice *>::iterator it=devices.find(name);
+		if(it!=devices.end())
+			it->second->RestoreState(state);
+		else
+			Debug[WARN] << "Checkpoint has state for " << name << ", which isn't in the memory map" << std::endl;
+	}
+	UpdateInterrupt();
+}
+
+
+void EightThirtyTwoMemory::SaveDevices(std::map<std::string,std::vector<unsigned long long> > &state)
+{
+	state.clear();
+	for(std::map<std::string,EightThirtyTwoDevice *>::iterator it=devices.begin();it!=devices.end();++it)
+		it->second->SaveState(state[it->first]);
+}
+
+
+void EightThirtyTwoMemory::RestoreDevices(std::map<std::string,std::vector<unsigned long long> > &state)
+{
+	for(std::map<std::string,EightThirtyTwoDevice *>::iterator it=devices.begin();it!=devices.end();++it)
+		it->second->RestoreState(state[it->first]);
+	UpdateInterrupt();
+}
+
+
+void EightThirtyTwoMemory::Snapshot()
+{
+	for(unsigned int i=0;i<allocated.size();++i)
+	{
+		pages[allocated[i]].shared=true;
+		MapPage(allocated[i]);
+	}
+	dirty.clear();
+	snapshotpages=allocated.size();
+	SaveDevices(snapshotstate);
+}
+
+
+#define MEMORY_COMPAREBLOCK 256
+
+// Only the bytes which differ from the snapshot are reported, since the
+// caller will usually have to discard code decoded from them.
+
+void EightThirtyTwoMemory::Rollback(std::vector<std::pair<unsigned int,unsigned int> > &restored)
+{
+	for(unsigned int i=0;i<dirty.size();++i)
+	{
+		EightThirtyTwoPage &p=pages[dirty[i]];
+		unsigned int pagebase=dirty[i]<<MEMORY_PAGEBITS;
+		// Most of a page is usually unchanged, so compare a block at a time.
+		for(unsigned int block=0;block<MEMORY_PAGESIZE;block+=MEMORY_COMPAREBLOCK)
+		{
+			if(!memcmp(p.data+block,p.copy+block,MEMORY_COMPAREBLOCK))
+				continue;
+			unsigned int j=block;
+			while(j<block+MEMORY_COMPAREBLOCK)
+			{
+				if(p.data[j]==p.copy[j])
+				{
+					++j;
+					continue;
+				}
+				unsigned int start=j;
+				while(j<block+MEMORY_COMPAREBLOCK && p.data[j]!=p.copy[j])
+					++j;
+				restored.push_back(std::make_pair(pagebase+start,j-start));
+			}
+		}
+		memcpy(p.data,p.copy,MEMORY_PAGESIZE);
+		p.shared=true;
+		MapPage(dirty[i]);
+	}
+	dirty.clear();
+	for(unsigned int i=snapshotpages;i<allocated.size();++i)
+	{
+		memset(pages[allocated[i]].data,0,MEMORY_PAGESIZE);
+		restored.push_back(std::make_pair(allocated[i]<<MEMORY_PAGEBITS,MEMORY_PAGESIZE));
+	}
+	RestoreDevices(snapshotstate);
+}
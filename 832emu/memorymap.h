@@ -0,0 +1,413 @@
+#ifndef MEMORYMAP_H
+#define MEMORYMAP_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <map>
+
+enum e32endian {BIGENDIAN,LITTLEENDIAN};
+enum e32size {WORD,HALFWORD,BYTE};
+
+
+// Page-table memory map.
+// The 32-bit address space is divided into 64KB pages.  RAM and ROM pages hold host
+// pointers to their data, so a load or store within a page needs only a table lookup.
+// Writes use a separate pointer, which is NULL for ROM.  Pages without a pointer, and
+// accesses which straddle a page boundary, take the slow path, which finds the region
+// containing the address and passes MMIO accesses to that region's device.
+// Storage for RAM and ROM is allocated a page at a time, on first access, so a map
+// can cover the whole address space while only the pages a program uses are resident.
+
+#define MEMORY_PAGEBITS 16
+#define MEMORY_PAGESIZE (1<<MEMORY_PAGEBITS)
+#define MEMORY_PAGEMASK (MEMORY_PAGESIZE-1)
+#define MEMORY_PAGES (1<<(32-MEMORY_PAGEBITS))
+
+
+// Emulated time, supplied by the emulator.
+
+class EightThirtyTwoClock
+{
+	public:
+	virtual ~EightThirtyTwoClock()
+	{
+	}
+	virtual unsigned long long GetCycles()=0;
+	// Called when an event has been scheduled sooner than the emulator expected,
+	// the interrupt line has changed or a watchpoint has been hit, so it can stop
+	// and take notice.
+	virtual void Reschedule()=0;
+	// Called after a device has made a call to the host on the program's behalf,
+	// which may have written len bytes at addr directly.  Host calls can't be
+	// repeated, so the emulator discards its history as well as any code decoded
+	// from those bytes.
+	virtual void HostCall(unsigned int addr,unsigned int len)=0;
+	// Called when the program asks to end, with its exit status.
+	virtual void Exit(int status)=0;
+};
+
+
+class EightThirtyTwoMemory;
+
+// Memory-mapped peripheral.  Addresses are passed as offsets from the start of the region.
+
+class EightThirtyTwoDevice
+{
+	public:
+	EightThirtyTwoDevice(const char *name) : name(name), bus(0)
+	{
+	}
+	virtual ~EightThirtyTwoDevice()
+	{
+	}
+	virtual unsigned int Read(unsigned int offset,e32size size)=0;
+	virtual void Write(unsigned int offset,unsigned int v,e32size size)=0;
+	// Called once emulated time reaches the cycle the device asked for with
+	// EightThirtyTwoMemory::Schedule().
+	virtual void Update(unsigned long long cycles)
+	{
+	}
+	// Returns true while the device is asserting the interrupt line.
+	virtual bool GetInterrupt()
+	{
+		return(false);
+	}
+	// For skipping busy-wait loops: the cycle before which reading the register at
+	// offset will return the same value without side effects, short of a write or
+	// an event the device has scheduled.  Reads have side effects unless a device
+	// says otherwise.
+	virtual unsigned long long GetQuietUntil(unsigned int offset,unsigned long long cycles)
+	{
+		return(cycles);
+	}
+	// Checkpoints - devices with state append it to, and take it back from, a list of values.
+	virtual void SaveState(std::vector<unsigned long long> &state)
+	{
+	}
+	virtual void RestoreState(const std::vector<unsigned long long> &state)
+	{
+	}
+	void Attach(EightThirtyTwoMemory *memory)
+	{
+		bus=memory;
+	}
+	const char *GetName()
+	{
+		return(name.c_str());
+	}
+	protected:
+	std::string name;
+	EightThirtyTwoMemory *bus;
+};
+
+
+struct EightThirtyTwoPage
+{
+	unsigned char *read;	// Host pointer to the start of the page, or NULL to take the slow path
+	unsigned char *write;	// As above, but also NULL for read-only pages
+	unsigned char *data;	// Backing store, NULL until the page is first accessed
+	unsigned char *copy;	// Contents at the last snapshot, taken on the first write after it
+	bool shared;	// Unwritten since the last snapshot
+	bool watched;	// Holds a watchpoint, so every access takes the slow path
+	bool borrowed;	// data points into an image owned by the caller, so isn't freed
+};
+
+
+// Data watchpoints cover the bytes from start up to, but not including, end.
+
+#define WATCH_READ 1
+#define WATCH_WRITE 2
+
+struct EightThirtyTwoWatchpoint
+{
+	unsigned int start;
+	unsigned int end;
+	int flags;
+};
+
+
+struct EightThirtyTwoWatchHit
+{
+	unsigned int addr;
+	unsigned int value;	// Read or written
+	e32size size;
+	int flags;	// WATCH_READ or WATCH_WRITE
+};
+
+
+struct EightThirtyTwoRegion
+{
+	unsigned int base;
+	unsigned int size;
+	bool writable;
+	EightThirtyTwoDevice *device;	// Set for MMIO regions, NULL for RAM and ROM
+	int shift;	// Written values are shifted right by this many bits before reaching the device
+};
+
+
+class EightThirtyTwoUART;
+
+class EightThirtyTwoMemory
+{
+	public:
+	// Builds the memory map from a file, or the default map if filename is NULL.
+	EightThirtyTwoMemory(const char *filename=0);
+	virtual ~EightThirtyTwoMemory();
+	void MapRAM(unsigned int base,unsigned int size,bool writable=true);
+	void MapDevice(unsigned int base,unsigned int size,const char *type,int shift=0);
+	// Maps a device created by the caller, which the memory map owns once this
+	// returns.  If it throws, the caller still owns it.  Each device needs a
+	// unique name.
+	void MapDevice(unsigned int base,unsigned int size,EightThirtyTwoDevice *device,int shift=0);
+	// Copies data into RAM or ROM, bypassing write protection.
+	void LoadImage(unsigned int addr,const unsigned char *data,int len);
+	// As LoadImage(), but whole pages not yet allocated use the image itself as
+	// their backing store rather than a copy of it, so data must stay valid, and
+	// writable, for as long as the memory map exists.  Stores go into the image.
+	void MapImage(unsigned int addr,unsigned char *data,int len);
+	virtual void SetUARTIn(const char *c);
+	// Appends the UART's output to out, rather than writing it to stdout.
+	virtual void SetUARTOut(std::string *out);
+	// Reads the UART's console input from a file, FIFO or terminal rather than stdin.
+	void SetUARTInFile(const char *filename);
+	// See EightThirtyTwoUART::SetTiming().
+	void SetUARTTiming(int baud,int fifo);
+	// Writes out the UART's buffered output.
+	void FlushUART();
+	// The console UART, or NULL if the map has none.
+	EightThirtyTwoUART *GetUART()
+	{
+		return(uart);
+	}
+	// Returns the number of bytes of RAM and ROM allocated so far.
+	unsigned int GetResidentSize();
+
+	// Time and interrupts.  Devices ask to be updated at a particular cycle with
+	// Schedule(); the emulator calls Update() once GetNextEvent() is reached and
+	// checks GetInterrupt() between instructions.  Devices call UpdateInterrupt()
+	// whenever their interrupt output may have changed.
+	void SetClock(EightThirtyTwoClock *clock,unsigned int frequency);
+	unsigned long long GetCycles();
+	unsigned int GetFrequency()
+	{
+		return(frequency);
+	}
+	void Schedule(EightThirtyTwoDevice *device,unsigned long long cycle);
+	void Cancel(EightThirtyTwoDevice *device);
+	inline bool IsScheduled()
+	{
+		return(!events.empty());
+	}
+	inline unsigned long long GetNextEvent()
+	{
+		return(nextevent);
+	}
+	void Update();
+	void UpdateInterrupt();
+	// Busy-wait detection: the earliest cycle at which a register read since
+	// BeginQuiet() could return something different, as GetQuietUntil() reports.
+	// RAM doesn't change by itself, so only MMIO reads count.
+	void BeginQuiet()
+	{
+		quietuntil=~0ULL;
+	}
+	unsigned long long GetQuietUntil()
+	{
+		return(quietuntil);
+	}
+	// Passed on to the clock, for the semihosting device.
+	void HostCall(unsigned int addr,unsigned int len);
+	void Exit(int status);
+	inline bool GetInterrupt()
+	{
+		return(interrupt);
+	}
+
+	// Checkpoints.  RAM and ROM pages which have been allocated are saved, other
+	// than those which are entirely zero, followed by the state of each device.
+	// Restoring clears any pages not in the checkpoint; devices reschedule their events.
+	void SaveState(FILE *f);
+	void RestoreState(FILE *f);
+
+	// Snapshots for the fork server.  Taking a snapshot copies nothing: pages are
+	// write-protected, and each is copied the first time it's written afterwards.
+	// Rolling back copies those pages back, clears pages allocated since, and restores
+	// the state of each device.  The address and length of each range of bytes
+	// which changed are added to restored.
+	void Snapshot();
+	void Rollback(std::vector<std::pair<unsigned int,unsigned int> > &restored);
+	// The state of each device, by name, as held in checkpoints and snapshots.
+	void SaveDevices(std::map<std::string,std::vector<unsigned long long> > &state);
+	void RestoreDevices(std::map<std::string,std::vector<unsigned long long> > &state);
+	// Writes a byte of RAM, as a store would but without watchpoints; ROM, MMIO
+	// and unmapped addresses are left alone.  For undoing stores, and host calls
+	// which fill the program's buffers.
+	void Poke(unsigned int addr,unsigned char v);
+	// Returns how many of the len bytes from addr lie in RAM or ROM before the
+	// first which doesn't, for host calls given a buffer by the program.
+	unsigned int GetMemorySpan(unsigned int addr,unsigned int len);
+	// While the emulator replays instructions it has already run, when moving
+	// back through its history, the UART's output is discarded.
+	void SetReplaying(bool replaying);
+
+	// Watchpoints.  Pages holding one take the slow path, which checks each access
+	// against the watchpoints.  A hit is kept for the emulator to collect, and the
+	// clock told to reschedule, so the emulator can stop after the instruction.
+	void AddWatchpoint(unsigned int start,unsigned int end,int flags);
+	void RemoveWatchpoint(unsigned int start,unsigned int end,int flags);
+	void ClearWatchpoints();
+	// True if a watchpoint for the given kind of access overlaps start up to, but not including, end.
+	bool IsWatched(unsigned int start,unsigned int end,int flags);
+	bool HasWatchpoints()
+	{
+		return(!watchpoints.empty());
+	}
+	// Returns true, and fills in hit, if a watchpoint has been hit since the last call.
+	inline bool TakeWatchHit(EightThirtyTwoWatchHit &hit)
+	{
+		if(!watchhit)
+			return(false);
+		hit=lastwatch;
+		watchhit=false;
+		return(true);
+	}
+
+	inline unsigned int Read(unsigned int addr,e32endian endian,e32size opsize)
+	{
+		const EightThirtyTwoPage &page=pages[addr>>MEMORY_PAGEBITS];
+		unsigned int offset=addr&MEMORY_PAGEMASK;
+		if(page.read && offset<=MEMORY_PAGESIZE-4)
+		{
+			const unsigned char *p=page.read+offset;
+			switch(opsize)
+			{
+				case WORD:
+					if(endian==BIGENDIAN)
+						return(((unsigned int)p[0]<<24)|(p[1]<<16)|(p[2]<<8)|p[3]);
+					return(((unsigned int)p[3]<<24)|(p[2]<<16)|(p[1]<<8)|p[0]);
+				case HALFWORD:
+					if(endian==BIGENDIAN)
+						return((p[0]<<8)|p[1]);
+					return((p[1]<<8)|p[0]);
+				default:
+					return(p[0]);
+			}
+		}
+		return(SlowRead(addr,endian,opsize));
+	}
+
+	inline void Write(unsigned int addr,unsigned int v,e32endian endian,e32size opsize)
+	{
+		const EightThirtyTwoPage &page=pages[addr>>MEMORY_PAGEBITS];
+		unsigned int offset=addr&MEMORY_PAGEMASK;
+		if(page.write && offset<=MEMORY_PAGESIZE-4)
+		{
+			unsigned char *p=page.write+offset;
+			switch(opsize)
+			{
+				case WORD:
+					if(endian==BIGENDIAN)
+					{
+						p[0]=v>>24; p[1]=v>>16; p[2]=v>>8; p[3]=v;
+					}
+					else
+					{
+						p[3]=v>>24; p[2]=v>>16; p[1]=v>>8; p[0]=v;
+					}
+					break;
+				case HALFWORD:
+					if(endian==BIGENDIAN)
+					{
+						p[0]=v>>8; p[1]=v;
+					}
+					else
+					{
+						p[1]=v>>8; p[0]=v;
+					}
+					break;
+				default:
+					p[0]=v;
+					break;
+			}
+		}
+		else
+			SlowWrite(addr,v,endian,opsize);
+	}
+
+	// Reads a byte without side effects, for instruction fetch.  MMIO and unmapped
+	// addresses read as zero.
+	inline unsigned char Peek(unsigned int addr)
+	{
+		const EightThirtyTwoPage &page=pages[addr>>MEMORY_PAGEBITS];
+		if(page.read)
+			return(page.read[addr&MEMORY_PAGEMASK]);
+		return(SlowPeek(addr));
+	}
+
+	// True if a write of v would leave memory as it is: addr lies in RAM which
+	// already holds the value.  MMIO, ROM and pages taking the slow path never do.
+	inline bool Holds(unsigned int addr,unsigned int v,e32endian endian,e32size opsize)
+	{
+		const EightThirtyTwoPage &page=pages[addr>>MEMORY_PAGEBITS];
+		unsigned int offset=addr&MEMORY_PAGEMASK;
+		if(!page.write || offset>MEMORY_PAGESIZE-4)
+			return(false);
+		const unsigned char *p=page.write+offset;
+		switch(opsize)
+		{
+			case WORD:
+				if(endian==BIGENDIAN)
+					return((((unsigned int)p[0]<<24)|(p[1]<<16)|(p[2]<<8)|p[3])==v);
+				return((((unsigned int)p[3]<<24)|(p[2]<<16)|(p[1]<<8)|p[0])==v);
+			case HALFWORD:
+				if(endian==BIGENDIAN)
+					return(((p[0]<<8)|p[1])==(v&0xffff));
+				return(((p[1]<<8)|p[0])==(v&0xffff));
+			default:
+				return(p[0]==(v&0xff));
+		}
+	}
+
+	protected:
+	void DefaultMap();
+	void LoadMap(const char *filename);
+	void Release();
+	void AddRegion(EightThirtyTwoRegion &region);
+	EightThirtyTwoRegion *FindRegion(unsigned int addr);
+	void CheckImage(unsigned int addr,int len);
+	unsigned char *AllocatePage(unsigned int page);
+	void MapPage(unsigned int page);
+	void Unshare(unsigned int page);
+	unsigned int SlowRead(unsigned int addr,e32endian endian,e32size opsize);
+	void SlowWrite(unsigned int addr,unsigned int v,e32endian endian,e32size opsize);
+	unsigned char SlowPeek(unsigned int addr);
+	void CheckWatchpoints(unsigned int addr,unsigned int v,e32size opsize,int flags);
+	void WatchPages(unsigned int start,unsigned int end);
+	void FindNextEvent();
+	EightThirtyTwoPage *pages;
+	std::vector<unsigned int> allocated;	// Indices of pages with backing store
+	std::vector<unsigned int> dirty;	// Pages copied since the last snapshot
+	unsigned int snapshotpages;	// Pages allocated when the snapshot was taken
+	std::map<std::string,std::vector<unsigned long long> > snapshotstate;	// Device state by name
+	std::vector<EightThirtyTwoRegion> regions;
+	std::vector<EightThirtyTwoWatchpoint> watchpoints;
+	bool watchhit;
+	EightThirtyTwoWatchHit lastwatch;
+	std::map<std::string,EightThirtyTwoDevice *> devices;	// One instance of each device type, shared between its regions
+	EightThirtyTwoUART *uart;
+	EightThirtyTwoClock *clock;
+	unsigned int frequency;	// Hz
+	std::map<EightThirtyTwoDevice *,unsigned long long> events;	// At most one per device
+	unsigned long long nextevent;
+	bool interrupt;
+	unsigned long long quietuntil;
+};
+
+
+// Checkpoint files hold lists of values, written in the host's byte order.
+void EightThirtyTwoWriteState(FILE *f,const std::vector<unsigned long long> &state);
+void EightThirtyTwoReadState(FILE *f,std::vector<unsigned long long> &state);
+
+#endif
+
@@ -0,0 +1,727 @@
+#include <iostream>
+#include <cstring>
+#include <ctime>
+
+#include "debug.h"
+#include "util.h"
+#include "peripherals.h"
+
+
+EightThirtyTwoUART::EightThirtyTwoUART() : EightThirtyTwoDevice("uart"), uartbusyctr(0), uartin(0), uartout(0), taken(0), replaying(false),
+	nextpoll(0), baud(0), fifo(1), txdone(0), rxnext(-1), rxarrival(0), rxlast(0)
+{
+	// The UART is polled and written constantly, so avoid formatting
+	// messages for the null stream on every access.
+	comment=Debug.GetLevel()>=COMMENT;
+}
+
+
+EightThirtyTwoUART::~EightThirtyTwoUART()
+{
+}
+
+
+// New input replaces any which was received after the current state.
+
+void EightThirtyTwoUART::SetUARTIn(const char *c)
+{
+	uartin=c;
+	received.resize(taken);
+}
+
+
+void EightThirtyTwoUART::SetUARTOut(std::string *out)
+{
+	uartout=out;
+}
+
+
+void EightThirtyTwoUART::SetUARTInFile(const char *filename)
+{
+	console.SetInput(filename);
+}
+
+
+void EightThirtyTwoUART::SetTiming(int baud,int fifo)
+{
+	if(baud<0 || fifo<1 || fifo>UART_MAXFIFO)
+		throw "The UART needs a positive baud rate and a FIFO of 1 to 256 characters";
+	this->baud=baud;
+	this->fifo=fifo;
+}
+
+
+void EightThirtyTwoUART::Flush()
+{
+	console.Flush();
+}
+
+
+// Takes the next character of input, if there is one yet.
+
+int EightThirtyTwoUART::Fetch(unsigned long long cycles)
+{
+	if(taken<received.size())
+		return((unsigned char)received[taken++]);
+	int c=-1;
+	if(uartin)
+	{
+		c=(unsigned char)*uartin++;
+		if(!c)	// End of string
+			uartin=0;
+	}
+	else if(!uartout && cycles>=nextpoll)
+	{
+		c=console.Get();
+		if(c<0)
+			nextpoll=cycles+UART_POLLINTERVAL;
+	}
+	if(c>=0)
+	{
+		received+=char(c);
+		++taken;
+	}
+	return(c);
+}
+
+
+unsigned int EightThirtyTwoUART::Read(unsigned int offset,e32size size)
+{
+	if(comment)
+		Debug[COMMENT] << std::endl << "Reading from UART" << std::endl;
+	unsigned long long cycles=bus->GetCycles();
+	if(!baud)
+	{
+		if(uartbusyctr)
+		{
+			--uartbusyctr;
+			return(0);
+		}
+		uartbusyctr=1;	// Make the UART pretend to be busy for the next n cycles
+		int c=Fetch(cycles);
+		return(c<0 ? 0x100 : 0x300|c);	// Received byte ready...
+	}
+
+	unsigned long long charcycles=bus->GetFrequency()*10ULL/baud;
+	int result=0;
+	if(txdone<=cycles+(fifo-1)*charcycles)
+		result=0x100;
+	if(rxnext<0 && (rxnext=Fetch(cycles))>=0)
+	{
+		rxarrival=rxlast+charcycles;
+		if(rxarrival<cycles)
+			rxarrival=cycles;
+		if(rxreads.size()==(unsigned int)fifo && rxarrival<rxreads.front())
+			rxarrival=rxreads.front();
+	}
+	if(rxnext>=0 && cycles>=rxarrival)
+	{
+		result|=0x200|rxnext;
+		rxnext=-1;
+		rxlast=rxarrival;
+		rxreads.push_back(cycles);
+		if(rxreads.size()>(unsigned int)fifo)
+			rxreads.pop_front();
+	}
+	return(result);
+}
+
+
+void EightThirtyTwoUART::Write(unsigned int offset,unsigned int v,e32size size)
+{
+	if(baud)
+	{
+		unsigned long long cycles=bus->GetCycles();
+		txdone=(txdone>cycles ? txdone : cycles)+bus->GetFrequency()*10ULL/baud;
+	}
+	if(replaying)
+		return;
+	if(char(v))
+	{
+		if(comment)
+			Debug[COMMENT] << std::endl << "Writing " << char(v) << " to UART" << std::endl;
+		if(uartout)
+			*uartout+=char(v);
+		else
+			console.Put(char(v));
+	}
+	else
+	{
+		Debug[COMMENT] << std::endl << "Writing (nul) to UART" << std::endl;
+		if(uartout)
+			*uartout+="(nul)";
+		else
+			console.Write("(nul)",5);
+	}
+}
+
+
+// With a baud rate, reading the register changes nothing until a character
+// arrives, the transmit FIFO drains enough to take another, or it's time to
+// check the console again.
+
+unsigned long long EightThirtyTwoUART::GetQuietUntil(unsigned int offset,unsigned long long cycles)
+{
+	if(!baud)
+		return(cycles);
+	unsigned long long until=~0ULL;
+	if(rxnext>=0)
+		until=rxarrival;
+	else if(taken<received.size() || uartin)
+		return(cycles);
+	else if(!uartout && !console.AtEnd())
+		until=nextpoll;
+	unsigned long long backlog=bus->GetFrequency()*10ULL/baud*(fifo-1);
+	if(txdone>cycles+backlog && txdone-backlog<until)
+		until=txdone-backlog;
+	return(until>cycles ? until : cycles);
+}
+
+
+// The input string isn't saved - a program restored from a checkpoint reads
+// the one given on the command line.
+
+void EightThirtyTwoUART::SaveState(std::vector<unsigned long long> &state)
+{
+	state.push_back(uartbusyctr);
+	state.push_back(taken);
+	state.push_back(txdone);
+	state.push_back((long long)rxnext);
+	state.push_back(rxarrival);
+	state.push_back(rxlast);
+	for(unsigned int i=0;i<rxreads.size();++i)
+		state.push_back(rxreads[i]);
+}
+
+
+void EightThirtyTwoUART::RestoreState(const std::vector<unsigned long long> &state)
+{
+	if(state.size()>=1)
+		uartbusyctr=state[0];
+	taken=state.size()>=2 && state[1]<received.size() ? state[1] : received.size();
+	txdone=state.size()>=3 ? state[2] : 0;
+	rxnext=state.size()>=4 ? (long long)state[3] : -1;
+	rxarrival=state.size()>=5 ? state[4] : 0;
+	rxlast=state.size()>=6 ? state[5] : 0;
+	rxreads.clear();
+	for(unsigned int i=6;i<state.size();++i)
+		rxreads.push_back(state[i]);
+	nextpoll=0;
+}
+
+
+void EightThirtyTwoUART::SetReplaying(bool r)
+{
+	replaying=r;
+}
+
+
+unsigned int EightThirtyTwoUART::Receive(char *buf,unsigned int len)
+{
+	unsigned int n=0;
+	if(rxnext>=0 && len)
+	{
+		buf[n++]=rxnext;
+		rxnext=-1;
+	}
+	while(n<len && taken<received.size())
+		buf[n++]=received[taken++];
+	unsigned int replayed=n;
+	while(n<len && uartin && *uartin)
+		buf[n++]=*uartin++;
+	if(uartin && !*uartin)
+		uartin=0;
+	// Like a terminal, the console gives a line at a time.
+	if(!n && !uartin && !uartout)
+		n=console.GetLine(buf,len);
+	// Keep what was read, as Read() does, so it can be replayed.
+	received.append(buf+replayed,n-replayed);
+	taken+=n-replayed;
+	return(n);
+}
+
+
+void EightThirtyTwoUART::Send(const char *buf,unsigned int len,bool error)
+{
+	if(replaying)
+		return;
+	Debug[COMMENT] << std::endl << "Sending " << std::dec << len << std::hex << " characters to the console" << std::endl;
+	if(uartout)
+		uartout->append(buf,len);
+	else if(error)
+	{
+		console.Flush();
+		std::cerr.write(buf,len);
+	}
+	else
+		console.Write(buf,len);
+}
+
+
+EightThirtyTwoSemihost::EightThirtyTwoSemihost() : EightThirtyTwoDevice("semihost"), result(0)
+{
+	for(int i=0;i<3;++i)
+		args[i]=0;
+}
+
+
+EightThirtyTwoSemihost::~EightThirtyTwoSemihost()
+{
+	for(unsigned int i=0;i<files.size();++i)
+	{
+		if(files[i])
+			fclose(files[i]);
+	}
+}
+
+
+unsigned int EightThirtyTwoSemihost::Read(unsigned int offset,e32size size)
+{
+	if((offset&~3)==SEMIHOST_CALL)
+		return(result);
+	return(args[(offset>>2)%3]);
+}
+
+
+unsigned long long EightThirtyTwoSemihost::GetQuietUntil(unsigned int offset,unsigned long long cycles)
+{
+	return(~0ULL);
+}
+
+
+void EightThirtyTwoSemihost::Write(unsigned int offset,unsigned int v,e32size size)
+{
+	if((offset&~3)==SEMIHOST_CALL)
+	{
+		Debug[COMMENT] << std::endl << "Semihosting call " << v << " (0x" << args[0] << ", 0x" << args[1] << ", 0x" << args[2] << ")" << std::endl;
+		result=Call(v);
+		// Reads fill the buffer directly.
+		bool filled=v==SEMIHOST_READ && result>0;
+		bus->HostCall(filled ? args[1] : 0,filled ? result : 0);
+	}
+	else
+		args[(offset>>2)%3]=v;
+}
+
+
+int EightThirtyTwoSemihost::Call(unsigned int call)
+{
+	switch(call)
+	{
+		case SEMIHOST_EXIT:
+			bus->Exit(args[0]);
+			return(0);
+		case SEMIHOST_WRITE:
+			return(WriteFile(args[0],args[1],args[2]));
+		case SEMIHOST_READ:
+			return(ReadFile(args[0],args[1],args[2]));
+		case SEMIHOST_OPEN:
+			return(Open(args[0],args[1]));
+		case SEMIHOST_CLOSE:
+			return(Close(args[0]));
+		case SEMIHOST_CLOCK:
+			return(bus->GetCycles()/(bus->GetFrequency()/1000));
+		case SEMIHOST_TIME:
+			return(time(0));
+		default:
+			Debug[WARN] << "Unknown semihosting call " << call << std::endl;
+			return(-1);
+	}
+}
+
+
+FILE *EightThirtyTwoSemihost::GetFile(int fd)
+{
+	if(fd<3 || (unsigned int)(fd-3)>=files.size())
+		return(0);
+	return(files[fd-3]);
+}
+
+
+// The length the program gives is only trusted as far as the memory map goes,
+// and the result has to fit in an int.
+
+unsigned int EightThirtyTwoSemihost::ClampLength(unsigned int buffer,unsigned int length)
+{
+	if(length>0x7fffffff)
+		length=0x7fffffff;
+	return(bus->GetMemorySpan(buffer,length));
+}
+
+
+int EightThirtyTwoSemihost::WriteFile(int fd,unsigned int buffer,unsigned int length)
+{
+	EightThirtyTwoUART *uart=0;
+	FILE *f=0;
+	if(fd==1 || fd==2)
+		uart=bus->GetUART();
+	else
+		f=GetFile(fd);
+	unsigned int len=ClampLength(buffer,length);
+	if((!uart && !f) || (length && !len))
+		return(-1);
+	std::vector<char> data(len<SEMIHOST_CHUNK ? len : SEMIHOST_CHUNK);
+	unsigned int done=0;
+	while(done<len)
+	{
+		unsigned int chunk=len-done<SEMIHOST_CHUNK ? len-done : SEMIHOST_CHUNK;
+		for(unsigned int i=0;i<chunk;++i)
+			data[i]=bus->Peek(buffer+done+i);
+		if(uart)
+			uart->Send(&data[0],chunk,fd==2);
+		else if(fwrite(&data[0],1,chunk,f)!=chunk)
+			return(done ? done : -1);
+		done+=chunk;
+	}
+	return(done);
+}
+
+
+// Stops at the first short read, since the console gives a line at a time.
+
+int EightThirtyTwoSemihost::ReadFile(int fd,unsigned int buffer,unsigned int length)
+{
+	EightThirtyTwoUART *uart=0;
+	FILE *f=0;
+	if(fd==0)
+		uart=bus->GetUART();
+	else
+		f=GetFile(fd);
+	unsigned int len=ClampLength(buffer,length);
+	if((!uart && !f) || (length && !len))
+		return(-1);
+	std::vector<char> data(len<SEMIHOST_CHUNK ? len : SEMIHOST_CHUNK);
+	unsigned int done=0;
+	while(done<len)
+	{
+		unsigned int chunk=len-done<SEMIHOST_CHUNK ? len-done : SEMIHOST_CHUNK;
+		unsigned int got=uart ? uart->Receive(&data[0],chunk) : fread(&data[0],1,chunk,f);
+		for(unsigned int i=0;i<got;++i)
+			bus->Poke(buffer+done+i,data[i]);
+		done+=got;
+		if(got<chunk)
+			break;
+	}
+	return(done);
+}
+
+
+int EightThirtyTwoSemihost::Open(unsigned int name,unsigned int flags)
+{
+	std::string filename;
+	char c;
+	while((c=bus->Peek(name++)) && filename.size()<4096)
+		filename+=c;
+	const char *mode;
+	switch(flags&(SEMIHOST_RDWR|SEMIHOST_CREATE|SEMIHOST_APPEND))
+	{
+		case SEMIHOST_RDONLY:
+			mode="rb";
+			break;
+		case SEMIHOST_WRONLY:
+		case SEMIHOST_RDWR:
+			mode="r+b";
+			break;
+		case SEMIHOST_WRONLY|SEMIHOST_CREATE:
+			mode="wb";
+			break;
+		case SEMIHOST_RDWR|SEMIHOST_CREATE:
+			mode="w+b";
+			break;
+		case SEMIHOST_WRONLY|SEMIHOST_APPEND:
+		case SEMIHOST_WRONLY|SEMIHOST_CREATE|SEMIHOST_APPEND:
+			mode="ab";
+			break;
+		case SEMIHOST_RDWR|SEMIHOST_APPEND:
+		case SEMIHOST_RDWR|SEMIHOST_CREATE|SEMIHOST_APPEND:
+			mode="a+b";
+			break;
+		default:
+			return(-1);
+	}
+	FILE *f=FOpenUTF8(filename.c_str(),mode);
+	if(!f)
+	{
+		Debug[COMMENT] << "Can't open " << filename << std::endl;
+		return(-1);
+	}
+	unsigned int fd=0;
+	while(fd<files.size() && files[fd])
+		++fd;
+	if(fd==files.size())
+		files.push_back(f);
+	else
+		files[fd]=f;
+	return(fd+3);
+}
+
+
+int EightThirtyTwoSemihost::Close(int fd)
+{
+	if(fd>=0 && fd<3)
+		return(0);
+	FILE *f=GetFile(fd);
+	if(!f)
+		return(-1);
+	files[fd-3]=0;
+	return(fclose(f) ? -1 : 0);
+}
+
+
+// Open files aren't saved - a program restored from a checkpoint has to open them again.
+
+void EightThirtyTwoSemihost::SaveState(std::vector<unsigned long long> &state)
+{
+	for(int i=0;i<3;++i)
+		state.push_back(args[i]);
+	state.push_back((unsigned int)result);
+}
+
+
+void EightThirtyTwoSemihost::RestoreState(const std::vector<unsigned long long> &state)
+{
+	if(state.empty())	// A checkpoint from a map without the device
+		return;
+	if(state.size()<4)
+		throw "Checkpoint has bad semihosting state";
+	for(int i=0;i<3;++i)
+		args[i]=state[i];
+	result=state[3];
+}
+
+
+EightThirtyTwoTimer::EightThirtyTwoTimer() : EightThirtyTwoDevice("timer"), enabled(0), expired(0), index(0)
+{
+	for(int i=0;i<TIMER_COUNT;++i)
+	{
+		period[i]=0;
+		next[i]=0;
+	}
+}
+
+
+EightThirtyTwoTimer::~EightThirtyTwoTimer()
+{
+}
+
+
+unsigned int EightThirtyTwoTimer::Read(unsigned int offset,e32size size)
+{
+	unsigned int result=0;
+	Update(bus->GetCycles());
+	switch(offset&~3)
+	{
+		case TIMER_ENABLE:
+			result=expired;
+			expired=0;
+			bus->UpdateInterrupt();
+			break;
+		case TIMER_INDEX:
+			result=index;
+			break;
+		case TIMER_COUNTER:
+			if(enabled&(1<<index) && period[index])
+				result=next[index]-bus->GetCycles();
+			else
+				result=period[index];
+			break;
+	}
+	Debug[COMMENT] << std::endl << "Reading " << result << " from timer register " << offset << std::endl;
+	return(result);
+}
+
+
+void EightThirtyTwoTimer::Write(unsigned int offset,unsigned int v,e32size size)
+{
+	unsigned long long now=bus->GetCycles();
+	Debug[COMMENT] << std::endl << "Writing " << v << " to timer register " << offset << std::endl;
+	Update(now);
+	switch(offset&~3)
+	{
+		case TIMER_ENABLE:
+			v&=(1<<TIMER_COUNT)-1;
+			for(int i=0;i<TIMER_COUNT;++i)
+			{
+				if((v&~enabled)&(1<<i))
+					Start(i,now);
+			}
+			enabled=v;
+			break;
+		case TIMER_INDEX:
+			index=v%TIMER_COUNT;
+			break;
+		case TIMER_COUNTER:
+			period[index]=v;
+			Start(index,now);
+			break;
+	}
+	ScheduleNext();
+}
+
+
+void EightThirtyTwoTimer::Start(int timer,unsigned long long cycles)
+{
+	next[timer]=cycles+period[timer];
+}
+
+
+// Expires any timers which have reached zero, reloading them from their periods.
+
+void EightThirtyTwoTimer::Update(unsigned long long cycles)
+{
+	for(int i=0;i<TIMER_COUNT;++i)
+	{
+		if((enabled&(1<<i)) && period[i] && next[i]<=cycles)
+		{
+			expired|=1<<i;
+			next[i]+=((cycles-next[i])/period[i]+1)*period[i];
+		}
+	}
+	ScheduleNext();
+	bus->UpdateInterrupt();
+}
+
+
+void EightThirtyTwoTimer::ScheduleNext()
+{
+	unsigned long long first=0;
+	bool any=false;
+	for(int i=0;i<TIMER_COUNT;++i)
+	{
+		if((enabled&(1<<i)) && period[i] && (!any || next[i]<first))
+		{
+			first=next[i];
+			any=true;
+		}
+	}
+	if(any)
+		bus->Schedule(this,first);
+	else
+		bus->Cancel(this);
+}
+
+
+bool EightThirtyTwoTimer::GetInterrupt()
+{
+	return(expired!=0);
+}
+
+
+// Expiry is a scheduled event, so the expired timers only change before then if
+// they're acknowledged, which is a side effect.  A running counter changes every cycle.
+
+unsigned long long EightThirtyTwoTimer::GetQuietUntil(unsigned int offset,unsigned long long cycles)
+{
+	switch(offset&~3)
+	{
+		case TIMER_ENABLE:
+			return(expired ? cycles : ~0ULL);
+		case TIMER_COUNTER:
+			return(enabled&(1<<index) && period[index] ? cycles : ~0ULL);
+	}
+	return(~0ULL);
+}
+
+
+void EightThirtyTwoTimer::SaveState(std::vector<unsigned long long> &state)
+{
+	state.push_back(enabled);
+	state.push_back(expired);
+	state.push_back(index);
+	for(int i=0;i<TIMER_COUNT;++i)
+	{
+		state.push_back(period[i]);
+		state.push_back(next[i]);
+	}
+}
+
+
+void EightThirtyTwoTimer::RestoreState(const std::vector<unsigned long long> &state)
+{
+	if(state.size()<3+2*TIMER_COUNT)
+		throw "Checkpoint has bad timer state";
+	enabled=state[0];
+	expired=state[1];
+	index=state[2];
+	for(int i=0;i<TIMER_COUNT;++i)
+	{
+		period[i]=state[3+2*i];
+		next[i]=state[4+2*i];
+	}
+	ScheduleNext();
+}
+
+
+EightThirtyTwoMilliseconds::EightThirtyTwoMilliseconds() : EightThirtyTwoDevice("milliseconds")
+{
+}
+
+
+EightThirtyTwoMilliseconds::~EightThirtyTwoMilliseconds()
+{
+}
+
+
+unsigned int EightThirtyTwoMilliseconds::Read(unsigned int offset,e32size size)
+{
+	return(bus->GetCycles()/(bus->GetFrequency()/1000));
+}
+
+
+void EightThirtyTwoMilliseconds::Write(unsigned int offset,unsigned int v,e32size size)
+{
+	Debug[COMMENT] << std::endl << "Writing " << v << " to " << name << std::endl;
+}
+
+
+// The start of the next millisecond.
+
+unsigned long long EightThirtyTwoMilliseconds::GetQuietUntil(unsigned int offset,unsigned long long cycles)
+{
+	unsigned long long ms=bus->GetFrequency()/1000;
+	return((cycles/ms+1)*ms);
+}
+
+
+EightThirtyTwoLogDevice::EightThirtyTwoLogDevice(const char *name) : EightThirtyTwoDevice(name)
+{
+}
+
+
+EightThirtyTwoLogDevice::~EightThirtyTwoLogDevice()
+{
+}
+
+
+unsigned int EightThirtyTwoLogDevice::Read(unsigned int offset,e32size size)
+{
+	Debug[COMMENT] << std::endl << "Reading from " << name << std::endl;
+	return(0);
+}
+
+
+void EightThirtyTwoLogDevice::Write(unsigned int offset,unsigned int v,e32size size)
+{
+	Debug[COMMENT] << std::endl << "Writing " << v << " to " << name << std::endl;
+}
+
+
+unsigned long long EightThirtyTwoLogDevice::GetQuietUntil(unsigned int offset,unsigned long long cycles)
+{
+	return(~0ULL);
+}
+
+
+EightThirtyTwoDevice *EightThirtyTwoNewDevice(const char *type)
+{
+	if(strcmp(type,"uart")==0)
+		return(new EightThirtyTwoUART);
+	if(strcmp(type,"timer")==0)
+		return(new EightThirtyTwoTimer);
+	if(strcmp(type,"milliseconds")==0)
+		return(new EightThirtyTwoMilliseconds);
+	if(strcmp(type,"semihost")==0)
+		return(new EightThirtyTwoSemihost);
+	return(new EightThirtyTwoLogDevice(type));
+}
+
@@ -0,0 +1,216 @@
+#ifndef PERIPHERALS_H
+#define PERIPHERALS_H
+
+#include <deque>
+
+#include "memorymap.h"
+#include "console.h"
+
+// Emulated peripherals, attached to the memory map by type name.
+
+
+// The UART's single register reports transmit ready in bit 8, receive ready in bit 9
+// and the received character in bits 7:0.  Input comes from a string given on the
+// command line, then from the console - stdin, or a file given with SetUARTInFile().
+// Output goes to the console, unless it's being captured, in which case the
+// console isn't read either.  When nothing has arrived, the console is checked
+// again only after UART_POLLINTERVAL cycles.
+// Characters received are kept, and the number taken so far is part of the UART's
+// state, so that restoring an earlier state in the same run - as the emulator does
+// to run backwards - replays the same input.
+//
+// Without a baud rate, the UART reports itself busy on every other read, as it
+// always has.  With one, each character takes ten bit times to send or receive:
+// transmit is ready while the transmit FIFO has room, and a received character
+// is ready once it has arrived at the line rate.  Input is never lost - once the
+// receive FIFO is full, further characters wait until the program reads one, as
+// if under flow control.  Neither FIFO needs servicing, so a loop polling the
+// UART while it can't send or receive is idle, and busy-wait loops are skipped.
+
+#define UART_POLLINTERVAL 10000
+#define UART_MAXFIFO 256
+
+class EightThirtyTwoUART : public EightThirtyTwoDevice
+{
+	public:
+	EightThirtyTwoUART();
+	virtual ~EightThirtyTwoUART();
+	virtual unsigned int Read(unsigned int offset,e32size size);
+	virtual void Write(unsigned int offset,unsigned int v,e32size size);
+	virtual void SetUARTIn(const char *c);
+	virtual void SetUARTOut(std::string *out);
+	virtual unsigned long long GetQuietUntil(unsigned int offset,unsigned long long cycles);
+	virtual void SaveState(std::vector<unsigned long long> &state);
+	virtual void RestoreState(const std::vector<unsigned long long> &state);
+	// Reads the console input from a file, FIFO or terminal, rather than stdin.
+	void SetUARTInFile(const char *filename);
+	// Models the line's timing at the given baud rate, with FIFOs of the given
+	// depth; a baud rate of zero restores the untimed behaviour.
+	void SetTiming(int baud,int fifo);
+	// Writes out buffered output.
+	void Flush();
+	// Discards output while set.
+	void SetReplaying(bool r);
+	// Console access for host calls, bypassing the register.  Receive() takes up
+	// to len characters of input, waiting for a line from stdin if there's nothing
+	// else to take, and returns the number taken - zero at the end of input.  Send()
+	// writes len characters of output, to stderr rather than stdout if error is
+	// set and the output isn't being captured.
+	unsigned int Receive(char *buf,unsigned int len);
+	void Send(const char *buf,unsigned int len,bool error=false);
+	protected:
+	int Fetch(unsigned long long cycles);
+	int uartbusyctr;
+	const char *uartin;
+	std::string *uartout;
+	EightThirtyTwoConsole console;
+	bool comment;
+	std::string received;
+	unsigned int taken;	// Characters of received the program has read, or is about to
+	bool replaying;
+	unsigned long long nextpoll;	// Don't check the console again before this cycle
+	int baud;
+	int fifo;
+	unsigned long long txdone;	// The cycle at which the last character sent finishes
+	int rxnext;	// The character arriving, or -1
+	unsigned long long rxarrival;	// and the cycle at which it arrives
+	unsigned long long rxlast;	// The cycle at which the previous character arrived
+	std::deque<unsigned long long> rxreads;	// When the program read the last fifo characters
+};
+
+
+// Timers and interrupt controller, as expected by vbcc/dhrystone/timer.h.
+// Register 0 enables timers, one bit each, when written; when read it returns the
+// timers which have expired since it was last read, acknowledging the interrupt.
+// Register 4 selects a timer, and register 8 sets the selected timer's period in
+// clock cycles, or when read returns the cycles left until it next expires.
+// The interrupt line is raised while any expired timer hasn't been acknowledged.
+
+#define TIMER_COUNT 4
+#define TIMER_ENABLE 0
+#define TIMER_INDEX 4
+#define TIMER_COUNTER 8
+
+class EightThirtyTwoTimer : public EightThirtyTwoDevice
+{
+	public:
+	EightThirtyTwoTimer();
+	virtual ~EightThirtyTwoTimer();
+	virtual unsigned int Read(unsigned int offset,e32size size);
+	virtual void Write(unsigned int offset,unsigned int v,e32size size);
+	virtual void Update(unsigned long long cycles);
+	virtual bool GetInterrupt();
+	virtual unsigned long long GetQuietUntil(unsigned int offset,unsigned long long cycles);
+	virtual void SaveState(std::vector<unsigned long long> &state);
+	virtual void RestoreState(const std::vector<unsigned long long> &state);
+	protected:
+	void Start(int timer,unsigned long long cycles);
+	void ScheduleNext();
+	unsigned int enabled;
+	unsigned int expired;
+	int index;
+	unsigned int period[TIMER_COUNT];
+	unsigned long long next[TIMER_COUNT];	// The cycle at which each timer next expires
+};
+
+
+// Milliseconds elapsed since the start of emulation, according to the clock frequency.
+
+class EightThirtyTwoMilliseconds : public EightThirtyTwoDevice
+{
+	public:
+	EightThirtyTwoMilliseconds();
+	virtual ~EightThirtyTwoMilliseconds();
+	virtual unsigned int Read(unsigned int offset,e32size size);
+	virtual void Write(unsigned int offset,unsigned int v,e32size size);
+	virtual unsigned long long GetQuietUntil(unsigned int offset,unsigned long long cycles);
+};
+
+
+// Semihosting: calls to the host on the program's behalf, so that programs can
+// use the host's console and files without polling the UART a byte at a time.
+// The arguments are written to registers 0, 4 and 8, then the call number to
+// register 12, which makes the call; reading register 12 returns the result,
+// -1 on failure.  Buffers and file names are passed as addresses.
+//   SEMIHOST_EXIT (status) ends emulation, with the given exit status.
+//   SEMIHOST_WRITE (fd, buffer, length) returns the number of bytes written.
+//   SEMIHOST_READ (fd, buffer, length) returns the number of bytes read, zero
+//     at the end of the file.
+//   Either stops short at the end of RAM or ROM, and fails if the buffer
+//   doesn't start within it.
+//   SEMIHOST_OPEN (name, flags) returns a file descriptor.
+//   SEMIHOST_CLOSE (fd)
+//   SEMIHOST_CLOCK returns the emulated time in milliseconds, as "milliseconds" does.
+//   SEMIHOST_TIME returns the host's time in seconds since 1970.
+// Descriptors 0, 1 and 2 are the console, shared with the UART: input comes
+// from the same place, and output from 1 and 2 is captured along with the
+// UART's.  Files are opened relative to the emulator's working directory, and
+// aren't part of checkpoints or snapshots.
+
+#define SEMIHOST_ARG0 0
+#define SEMIHOST_ARG1 4
+#define SEMIHOST_ARG2 8
+#define SEMIHOST_CALL 12
+
+#define SEMIHOST_EXIT 1
+#define SEMIHOST_WRITE 2
+#define SEMIHOST_READ 3
+#define SEMIHOST_OPEN 4
+#define SEMIHOST_CLOSE 5
+#define SEMIHOST_CLOCK 6
+#define SEMIHOST_TIME 7
+
+// Flags for SEMIHOST_OPEN.  Without SEMIHOST_CREATE, writing needs an
+// existing file; with it, the file is created or truncated.
+#define SEMIHOST_RDONLY 1
+#define SEMIHOST_WRONLY 2
+#define SEMIHOST_RDWR 3
+#define SEMIHOST_CREATE 4
+#define SEMIHOST_APPEND 8
+
+// Reads and writes go through a buffer of this many bytes at a time.
+#define SEMIHOST_CHUNK 65536
+
+class EightThirtyTwoSemihost : public EightThirtyTwoDevice
+{
+	public:
+	EightThirtyTwoSemihost();
+	virtual ~EightThirtyTwoSemihost();
+	virtual unsigned int Read(unsigned int offset,e32size size);
+	virtual void Write(unsigned int offset,unsigned int v,e32size size);
+	virtual unsigned long long GetQuietUntil(unsigned int offset,unsigned long long cycles);
+	virtual void SaveState(std::vector<unsigned long long> &state);
+	virtual void RestoreState(const std::vector<unsigned long long> &state);
+	protected:
+	int Call(unsigned int call);
+	unsigned int ClampLength(unsigned int buffer,unsigned int length);
+	int WriteFile(int fd,unsigned int buffer,unsigned int length);
+	int ReadFile(int fd,unsigned int buffer,unsigned int length);
+	int Open(unsigned int name,unsigned int flags);
+	int Close(int fd);
+	FILE *GetFile(int fd);
+	unsigned int args[3];
+	int result;
+	std::vector<FILE *> files;	// From descriptor 3 up; NULL once closed
+};
+
+
+// A register which does nothing but report accesses.  Used for hardware the
+// emulator doesn't model, such as the SPI interface and the HEX display.
+
+class EightThirtyTwoLogDevice : public EightThirtyTwoDevice
+{
+	public:
+	EightThirtyTwoLogDevice(const char *name);
+	virtual ~EightThirtyTwoLogDevice();
+	virtual unsigned int Read(unsigned int offset,e32size size);
+	virtual void Write(unsigned int offset,unsigned int v,e32size size);
+	virtual unsigned long long GetQuietUntil(unsigned int offset,unsigned long long cycles);
+};
+
+
+// Creates a device of the given type.  Unrecognised types become logging registers.
+EightThirtyTwoDevice *EightThirtyTwoNewDevice(const char *type);
+
+#endif
+
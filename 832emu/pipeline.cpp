@@ -0,0 +1,442 @@
+#include <cstring>
+
+#include "832opcodes.h"
+#include "pipeline.h"
+
+#define PIPE_POSTINC 4096	// Occupies E and M for two cycles
+
+#define PIPE_WRITETMP (PIPE_Q1TOTMP|PIPE_Q2TOTMP|PIPE_LOAD)
+#define PIPE_WRITEFLAGS (PIPE_FLAGS|PIPE_LOAD)
+#define PIPE_LOADSTORE (PIPE_LOAD|PIPE_STORE)
+
+
+// Per-opcode behaviour, as decoded by eightthirtytwo_decode.vhd.
+
+static int PipelineProps(int opcode)
+{
+	int reg=opcode&7;
+	if((opcode&0xc0)==0xc0)
+		return(PIPE_Q2TOTMP|PIPE_LI);
+
+	// Instructions with tmp as the ALU's first operand.
+	const int tmpfirst=PIPE_READTMP|PIPE_READREG|PIPE_REG1TMP;
+	const int both=PIPE_READTMP|PIPE_READREG;
+
+	switch(opcode&0xf8)
+	{
+		case opc_cond:
+			return(PIPE_COND);
+		case opc_exg:
+			return(tmpfirst|PIPE_Q1TOREG|PIPE_Q2TOTMP);
+		case opc_ldbinc:
+		case opc_ldinc:
+			return(PIPE_READREG|PIPE_LOAD|PIPE_Q1TOREG|PIPE_POSTINC);
+		case opc_stdec:
+			return(both|PIPE_STORE|PIPE_Q1TOREG);
+		case opc_shr:
+		case opc_shl:
+		case opc_ror:
+		case opc_sub:
+			return(both|PIPE_Q1TOREG|PIPE_FLAGS);
+		case opc_stinc:
+		case opc_stbinc:
+			return(both|PIPE_STORE|PIPE_Q1TOREG|PIPE_POSTINC);
+		case opc_mr:
+			return(PIPE_READTMP|PIPE_REG1TMP|PIPE_Q1TOREG);
+		case opc_stmpdec:
+			return(tmpfirst|PIPE_STORE|PIPE_Q1TOTMP);
+		case opc_ldidx:
+			return(tmpfirst|PIPE_LOAD);
+		case opc_ld:
+			return(PIPE_READREG|PIPE_LOAD);
+		case opc_mt:
+			return(PIPE_READREG|PIPE_Q2TOTMP);
+		case opc_st:
+			return(both|PIPE_STORE);
+		case opc_add:
+			return(tmpfirst|(reg==7 ? PIPE_Q1TOREG|PIPE_Q2TOTMP : PIPE_Q1TOREG|PIPE_FLAGS));
+		case opc_mul:	// byt for r7
+			return(both|(reg==7 ? PIPE_FLAGS : PIPE_Q1TOREG|PIPE_Q2TOTMP|PIPE_FLAGS));
+		case opc_and:	// hlf for r7
+			return(both|(reg==7 ? PIPE_FLAGS : PIPE_Q1TOREG|PIPE_FLAGS));
+		case opc_addt:
+			return(both|PIPE_Q1TOTMP|PIPE_FLAGS);
+		case opc_cmp:	// sig for r7
+			return(both|(reg==7 ? 0 : PIPE_FLAGS));
+		case opc_or:	// sgn for r7
+			return(both|(reg==7 ? PIPE_SGN : PIPE_Q1TOREG|PIPE_FLAGS));
+		case opc_xor:	// ldt for r7
+			return(tmpfirst|(reg==7 ? PIPE_LOAD : PIPE_Q1TOREG|PIPE_FLAGS));
+	}
+	return(0);
+}
+
+
+EightThirtyTwoPipeline::EightThirtyTwoPipeline()
+{
+	for(int i=0;i<256;++i)
+		props[i]=PipelineProps(i);
+	Reset();
+}
+
+
+void EightThirtyTwoPipeline::Reset(int threads)
+{
+	this->threads=threads;
+	e.thread=m.thread=w.thread=-1;
+	e.props=m.props=w.props=0;
+	e.reg=m.reg=w.reg=0;
+	e.busy=m.busy=w.busy=0;
+	for(int t=0;t<2;++t)
+	{
+		refill[t]=0;
+		paused[t]=false;
+		pausedelay[t]=0;
+		fetchvalid[t]=false;
+		fetchword[t]=0;
+		fetchready[t]=prefetched[t]=0;
+		reason[t]=-1;
+	}
+	wakedelay=0;
+	last=0;
+	lastli=false;
+	forward=false;
+	cycles=0;
+	busfree=0;
+	for(int i=0;i<PIPE_STALL_COUNT;++i)
+		stalls[i]=0;
+	missingmul=0;
+	Mark();
+}
+
+
+bool EightThirtyTwoPipeline::Writes(const Stage &s,int t,int prop)
+{
+	return(s.thread==t && (s.props&prop));
+}
+
+
+unsigned long long EightThirtyTwoPipeline::Access(unsigned long long start,int n)
+{
+	if(start<busfree)
+		start=busfree;
+	busfree=start+n;
+	return(busfree);
+}
+
+
+// Returns true if the word containing pc hasn't yet arrived in thread t's opcode buffer.
+
+bool EightThirtyTwoPipeline::Fetch(int t,unsigned int pc)
+{
+	unsigned int word=pc>>2;
+	int n=1+timing.waitstates;
+	if(!fetchvalid[t] || word!=fetchword[t])
+	{
+		if(fetchvalid[t] && word==fetchword[t]+1)
+			fetchready[t]=timing.prefetch ? prefetched[t] : Access(cycles,n);
+		else	// A new PC - the first cycle of the fetch is covered by PIPE_REFILL.
+			fetchready[t]=Access(cycles,n)-1;
+		fetchword[t]=word;
+		fetchvalid[t]=true;
+		if(timing.prefetch)
+			prefetched[t]=Access(fetchready[t],n);
+	}
+	return(fetchready[t]>cycles);
+}
+
+
+bool EightThirtyTwoPipeline::Hazard(int t,int opcode,unsigned int pc)
+{
+	int p=props[opcode&0xff];
+	int reg=opcode&7;
+
+	reason[t]=-1;
+	if(t>=threads || paused[t])
+		return(true);
+	reason[t]=PIPE_STALL_HAZARD;
+	if(refill[t])
+		return(true);
+	// r7 is being written
+	if((Writes(e,t,PIPE_Q1TOREG) && e.reg==7) || (Writes(m,t,PIPE_Q1TOREG) && m.reg==7))
+		return(true);
+	if((p&PIPE_READTMP) && !(forward && t==last && (p&PIPE_REG1TMP)))
+	{
+		if(Writes(e,t,PIPE_WRITETMP) || Writes(m,t,PIPE_WRITETMP))
+			return(true);
+		if(Writes(w,t,PIPE_WRITETMP))
+		{
+			reason[t]=PIPE_STALL_MEMORY;
+			return(true);
+		}
+	}
+	if((p&PIPE_READREG) && ((Writes(e,t,PIPE_Q1TOREG) && e.reg==reg) || (Writes(m,t,PIPE_Q1TOREG) && m.reg==reg)))
+		return(true);
+	if((p&(PIPE_COND|PIPE_SGN)) && (Writes(e,t,PIPE_WRITEFLAGS) || Writes(m,t,PIPE_WRITEFLAGS) || Writes(w,t,PIPE_WRITEFLAGS)))
+		return(true);
+	reason[t]=PIPE_STALL_MEMORY;
+	// The load / store unit is shared between the threads.
+	if((p&PIPE_LOADSTORE) && ((e.props|m.props|w.props)&PIPE_LOADSTORE))
+		return(true);
+	if((p&PIPE_Q2TOTMP) && ((e.props|m.props|w.props)&PIPE_LOAD))
+		return(true);
+	reason[t]=PIPE_STALL_FETCH;
+	if(Fetch(t,pc))
+		return(true);
+	reason[t]=-1;
+	return(false);
+}
+
+
+// The thread which issued last keeps going until it hits a hazard.
+
+int EightThirtyTwoPipeline::Choose(int opcode1,unsigned int pc1,int opcode2,unsigned int pc2)
+{
+	bool h1=Hazard(0,opcode1,pc1);
+	bool h2=Hazard(1,opcode2,pc2);
+	// The other thread can't take over in the middle of an li chain, or while
+	// a result is being forwarded.
+	bool fwd=forward && (props[(last ? opcode2 : opcode1)&0xff]&PIPE_REG1TMP);
+	bool yield=!lastli && !fwd;
+	if(!h1 && (last==0 || paused[1] || threads<2 || (h2 && yield)))
+		return(0);
+	if(!h2 && (last==1 || paused[0] || (h1 && yield)))
+		return(1);
+	return(-1);
+}
+
+
+void EightThirtyTwoPipeline::Issue(int t,int opcode,bool skipped,unsigned int operand,int size)
+{
+	Stage s;
+	int p=props[opcode&0xff];
+	s.thread=t;
+	s.props=skipped ? 0 : p;
+	s.reg=opcode&7;
+	s.busy=0;
+
+	last=t;
+	lastli=(p&PIPE_LI)!=0;
+	forward=timing.forwarding && (s.props&PIPE_Q2TOTMP)!=0;
+
+	// cond instructions still reach E while skipping, so cond NEX pauses the thread either way.
+	if(opcode==(opc_cond|0))
+	{
+		pausedelay[t]=2;
+		forward=false;
+	}
+	if(opcode==ovl_sig && !skipped)
+		wakedelay=2;
+
+	// The access starts once the instruction reaches W, two cycles from now,
+	// and takes a second bus cycle if it straddles a word boundary.
+	if(s.props&PIPE_LOADSTORE)
+	{
+		int n=1+timing.waitstates;
+		if((size==4 && (operand&3)) || (size==2 && (operand&3)==3))
+			n*=2;
+		s.busy=Access(cycles+2,n)-(cycles+3);
+	}
+
+	Advance(s);
+	if(s.props&PIPE_POSTINC)
+		Advance(s);
+
+	// The shifter takes a cycle per bit; the multiplier takes one extra cycle.
+	int aluwait=0;
+	if(!skipped)
+	{
+		switch(opcode&0xf8)
+		{
+			case opc_shr:
+			case opc_shl:
+			case opc_ror:
+				aluwait=operand&31 ? operand&31 : 1;
+				break;
+			case opc_mul:
+				if(s.reg!=7)
+				{
+					aluwait=1;
+					if(!timing.multiplier)
+						++missingmul;
+				}
+				break;
+		}
+	}
+	stalls[PIPE_STALL_ALU]+=aluwait;
+	while(aluwait--)
+		Stall();
+}
+
+
+void EightThirtyTwoPipeline::Bubble()
+{
+	Stage s;
+	s.thread=-1;
+	s.props=0;
+	s.reg=0;
+	s.busy=0;
+	if(reason[last]>=0)
+		++stalls[reason[last]];
+	Advance(s);
+}
+
+
+void EightThirtyTwoPipeline::Advance(const Stage &s)
+{
+	// A write to r7 leaving M restarts the fetch.
+	for(int t=0;t<2;++t)
+	{
+		if(refill[t])
+			--refill[t];
+	}
+	if(m.thread>=0 && (m.props&PIPE_Q1TOREG) && m.reg==7)
+		refill[m.thread]=PIPE_REFILL;
+
+	// A load or store waiting on memory holds W; nothing else needs it.
+	if(w.busy)
+		--w.busy;
+	else
+	{
+		w=m;
+		if(!(w.props&PIPE_LOADSTORE))
+		{
+			w.thread=-1;
+			w.props=0;
+		}
+	}
+	m=e;
+	e=s;
+	Tick();
+}
+
+
+void EightThirtyTwoPipeline::Stall()
+{
+	for(int t=0;t<2;++t)
+	{
+		if(refill[t])
+			--refill[t];
+	}
+	if(w.busy)
+		--w.busy;
+	else
+	{
+		w.thread=-1;
+		w.props=0;
+	}
+	Tick();
+}
+
+
+void EightThirtyTwoPipeline::Tick()
+{
+	// sig wakes both threads; cond NEX takes effect afterwards.
+	if(wakedelay && !--wakedelay)
+		paused[0]=paused[1]=false;
+	for(int t=0;t<2;++t)
+	{
+		if(pausedelay[t] && !--pausedelay[t])
+			paused[t]=true;
+	}
+	++cycles;
+}
+
+
+bool EightThirtyTwoPipeline::IsPaused(int t)
+{
+	return(paused[t]);
+}
+
+
+bool EightThirtyTwoPipeline::Idle()
+{
+	for(int t=0;t<threads;++t)
+	{
+		if(!paused[t] || pausedelay[t])
+			return(false);
+	}
+	return(!wakedelay);
+}
+
+
+void EightThirtyTwoPipeline::Wake()
+{
+	paused[0]=paused[1]=false;
+}
+
+
+void EightThirtyTwoPipeline::Wait(unsigned long long n)
+{
+	// Once the pipeline has drained nothing changes, so skip the remaining cycles.
+	while(n && (e.thread>=0 || m.thread>=0 || w.thread>=0 || refill[0] || refill[1]))
+	{
+		Bubble();
+		--n;
+	}
+	cycles+=n;
+}
+
+
+void EightThirtyTwoPipeline::GetState(State &s)
+{
+	memset(&s,0,sizeof(s));	// So padding compares equal too
+	s.e=e;
+	s.m=m;
+	s.w=w;
+	for(int t=0;t<2;++t)
+	{
+		s.refill[t]=refill[t];
+		s.paused[t]=paused[t];
+		s.pausedelay[t]=pausedelay[t];
+		s.fetchword[t]=fetchword[t];
+		s.fetchready[t]=fetchready[t]>cycles ? fetchready[t]-cycles : 0;
+		s.prefetched[t]=prefetched[t]>cycles ? prefetched[t]-cycles : 0;
+		s.fetchvalid[t]=fetchvalid[t];
+		s.reason[t]=reason[t];
+	}
+	s.wakedelay=wakedelay;
+	s.last=last;
+	s.lastli=lastli;
+	s.forward=forward;
+	s.busfree=(long long)(busfree-cycles);
+}
+
+
+void EightThirtyTwoPipeline::Mark()
+{
+	GetState(mark);
+	markcycles=cycles;
+	for(int i=0;i<PIPE_STALL_COUNT;++i)
+		markstalls[i]=stalls[i];
+	markmissingmul=missingmul;
+}
+
+
+bool EightThirtyTwoPipeline::Repeats()
+{
+	State s;
+	GetState(s);
+	return(!memcmp(&s,&mark,sizeof(s)));
+}
+
+
+// A fetch which had arrived by the mark is at or before the current cycle, and
+// no later than busfree, so moving every time along by the same amount leaves
+// the pipeline behaving just as it would have.
+
+void EightThirtyTwoPipeline::Repeat(unsigned long long n)
+{
+	unsigned long long d=n*(cycles-markcycles);
+	cycles+=d;
+	busfree+=d;
+	for(int t=0;t<2;++t)
+	{
+		fetchready[t]+=d;
+		prefetched[t]+=d;
+	}
+	for(int i=0;i<PIPE_STALL_COUNT;++i)
+		stalls[i]+=n*(stalls[i]-markstalls[i]);
+	missingmul+=n*(missingmul-markmissingmul);
+	Mark();
+}
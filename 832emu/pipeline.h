@@ -0,0 +1,179 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+// Model of the CPU's dispatch logic, used to interleave the two threads the way
+// eightthirtytwo_cpu.vhd does.
+//
+// Instructions are dispatched from the decode stage into E, then pass through M
+// and, for loads and stores, W.  Each cycle the hazard logic checks the next
+// instruction of each thread against what that thread has in flight:
+//   - reading tmp, a register or the flags while an earlier instruction will
+//     still write them (tmp can be forwarded from the previous instruction);
+//   - any instruction while a write to r7 is in flight, and for a couple of
+//     cycles afterwards while the new PC is fetched;
+//   - a load or store while another load or store (from either thread) is in
+//     flight.
+// A thread keeps issuing until it hits a hazard or is paused by cond NEX; only
+// then may the other thread issue, and never in the middle of an li chain.
+// cond NEX pauses a thread, and sig wakes both, once the instruction reaches E;
+// the thread may issue once more in the meantime.
+//
+// Timing follows eightthirtytwo_fetchloadstore.vhd and eightthirtytwo_alu.vhd:
+//   - instruction fetches, loads and stores share one memory port, each access
+//     taking a cycle plus any wait states; a load or store stays in W until its
+//     access completes, and one which straddles a word boundary takes two;
+//   - with prefetch the next word of code is fetched as soon as the current one
+//     arrives, otherwise only once execution reaches it;
+//   - shifts stall the pipeline for a cycle per bit, mul for one cycle.
+
+#define PIPE_READTMP 1
+#define PIPE_READREG 2
+#define PIPE_REG1TMP 4	// tmp is the ALU's first operand, so can be forwarded
+#define PIPE_Q1TOREG 8
+#define PIPE_Q1TOTMP 16
+#define PIPE_Q2TOTMP 32
+#define PIPE_FLAGS 64
+#define PIPE_LOAD 128
+#define PIPE_STORE 256
+#define PIPE_COND 512
+#define PIPE_SGN 1024
+#define PIPE_LI 2048
+
+#define PIPE_REFILL 2	// Cycles to fetch from a new PC, after the write to r7 leaves M
+
+// Reasons for a bubble, or for the whole pipeline stalling.
+#define PIPE_STALL_HAZARD 0	// A register, tmp, the flags or r7 is being written
+#define PIPE_STALL_MEMORY 1	// Waiting for a load or store
+#define PIPE_STALL_FETCH 2	// Waiting for code to be fetched
+#define PIPE_STALL_ALU 3	// A shift or multiply is in progress
+#define PIPE_STALL_COUNT 4
+
+
+// Build options of the CPU which affect timing, named after eightthirtytwo_cpu.vhd's generics.
+
+struct EightThirtyTwoTiming
+{
+	EightThirtyTwoTiming() : prefetch(true), forwarding(true), multiplier(true), waitstates(0)
+	{
+	}
+	bool prefetch;
+	bool forwarding;
+	bool multiplier;
+	int waitstates;	// Extra cycles taken by each memory access
+};
+
+
+class EightThirtyTwoPipeline
+{
+	public:
+	EightThirtyTwoPipeline();
+	void SetTiming(const EightThirtyTwoTiming &t)
+	{
+		timing=t;
+	}
+	// With one thread, the second is never chosen.
+	void Reset(int threads=2);
+	// Returns true if thread t (0 or 1) can't issue opcode, from address pc, this cycle.
+	bool Hazard(int t,int opcode,unsigned int pc);
+	// Returns the thread to issue from this cycle, given the next opcode and
+	// address of each, or -1 for a bubble.
+	int Choose(int opcode1,unsigned int pc1,int opcode2,unsigned int pc2);
+	// Records that thread t issued opcode, which was skipped if cond was clear,
+	// and advances to the next cycle.  operand is the distance for a shift, or
+	// the address for a load or store, which accesses size bytes.
+	void Issue(int t,int opcode,bool skipped,unsigned int operand=0,int size=4);
+	// Advances to the next cycle without issuing anything.
+	void Bubble();
+	bool IsPaused(int t);
+	// Returns true if both threads are paused, with no sig in flight to wake them.
+	bool Idle();
+	// Unpauses both threads, as the interrupt signal does.
+	void Wake();
+	// Advances the given number of cycles with nothing issued.
+	void Wait(unsigned long long n);
+	unsigned long long GetCycles()
+	{
+		return(cycles);
+	}
+	// Returns the number of cycles lost for the given reason - see PIPE_STALL_.
+	unsigned long long GetStalls(int reason)
+	{
+		return(stalls[reason]);
+	}
+	// The number of times mul was executed without a multiplier.
+	unsigned long long GetMissingMultiplies()
+	{
+		return(missingmul);
+	}
+	// Busy-wait detection.  Mark() notes the pipeline's state, and Repeats()
+	// returns true if it has since come back to the same state relative to the
+	// current cycle.  Repeat() then advances as though the cycles since the mark
+	// had passed n more times, stalls included, and marks the new state.
+	void Mark();
+	bool Repeats();
+	void Repeat(unsigned long long n);
+	protected:
+	struct Stage
+	{
+		int thread;	// -1 for a bubble
+		int props;	// PIPE_ flags, cleared if the instruction was skipped
+		int reg;
+		int busy;	// Cycles a load or store waits in W for its access to complete
+	};
+	// Everything which decides what happens from here on, with times relative to
+	// the current cycle.  A fetch which has already arrived counts as zero.
+	struct State
+	{
+		Stage e,m,w;
+		int refill[2];
+		bool paused[2];
+		int pausedelay[2];
+		int wakedelay;
+		int last;
+		bool lastli;
+		bool forward;
+		long long busfree;
+		unsigned int fetchword[2];
+		long long fetchready[2];
+		long long prefetched[2];
+		bool fetchvalid[2];
+		int reason[2];
+	};
+	void GetState(State &s);
+	void Advance(const Stage &e);
+	// Holds E and M for a cycle while the ALU finishes.
+	void Stall();
+	void Tick();
+	bool Writes(const Stage &s,int t,int prop);
+	bool Fetch(int t,unsigned int pc);
+	// Queues a memory access of the given number of cycles, starting no sooner
+	// than start, and returns the cycle on which it completes.
+	unsigned long long Access(unsigned long long start,int n);
+	EightThirtyTwoTiming timing;
+	int threads;
+	int props[256];
+	Stage e,m,w;
+	int refill[2];
+	bool paused[2];
+	int pausedelay[2];	// Cycles until a cond NEX pauses the thread
+	int wakedelay;	// Cycles until a sig wakes both threads
+	int last;	// Thread which issued most recently
+	bool lastli;
+	bool forward;	// The previous instruction's tmp result can be forwarded to the next
+	unsigned long long cycles;
+	unsigned long long busfree;	// Cycle on which the memory port is next free
+	unsigned int fetchword[2];	// Address of the word in each thread's opcode buffer, >>2
+	unsigned long long fetchready[2];	// Cycle on which that word arrives
+	unsigned long long prefetched[2];	// Cycle on which the word after it arrives
+	bool fetchvalid[2];
+	int reason[2];	// Why each thread couldn't issue this cycle
+	unsigned long long stalls[PIPE_STALL_COUNT];
+	unsigned long long missingmul;
+	State mark;
+	unsigned long long markcycles;
+	unsigned long long markstalls[PIPE_STALL_COUNT];
+	unsigned long long markmissingmul;
+};
+
+#endif
+
@@ -0,0 +1,282 @@
+#ifndef PREDECODE_H
+#define PREDECODE_H
+
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+
+#include "832opcodes.h"
+
+// Each byte of code is decoded once into a compact handler / operand record,
+// which the emulator then dispatches through a table rather than re-decoding
+// the opcode on every step.
+
+enum EightThirtyTwoHandler
+{
+	// Handler zero marks a record which hasn't yet been decoded (or has been invalidated).
+	HANDLER_DECODE=0,
+
+	// Immediate and modifier instructions - these don't end an li chain.
+	HANDLER_LI,
+	HANDLER_HLF,
+	HANDLER_BYT,
+	HANDLER_SGN,
+	HANDLER_LDT,
+	HANDLER_SIG,
+	HANDLER_BREAK,	// Stops before the instruction - see DECODEFLAG_BREAK
+
+	// Superinstructions - an li chain, optionally followed by add r7, addt r7 or ldt,
+	// executed in a single dispatch.  Only the record for the chain's first byte
+	// is fused; the remaining bytes decode normally if executed on their own.
+	HANDLER_FUSED,
+	HANDLER_LICHAIN=HANDLER_FUSED,	// Load a constant
+	HANDLER_LIJUMP,	// PC-relative jump or call
+	HANDLER_LIADDT,	// PC-relative address
+	HANDLER_LILDT,	// Load from an absolute address
+
+	// Full opcodes - these end an li chain.
+	HANDLER_FULL,
+	HANDLER_COND=HANDLER_FULL,
+	HANDLER_EXG,
+	HANDLER_LDBINC,
+	HANDLER_STDEC,
+	HANDLER_LDINC,
+	HANDLER_SHR,
+	HANDLER_SHL,
+	HANDLER_ROR,
+	HANDLER_STINC,
+	HANDLER_MR,
+	HANDLER_STBINC,
+	HANDLER_STMPDEC,
+	HANDLER_LDIDX,
+	HANDLER_LD,
+	HANDLER_MT,
+	HANDLER_ST,
+	HANDLER_ADD,
+	HANDLER_SUB,
+	HANDLER_MUL,
+	HANDLER_AND,
+	HANDLER_ADDT,
+	HANDLER_CMP,
+	HANDLER_OR,
+	HANDLER_XOR,
+	HANDLER_COUNT
+};
+
+
+// Flags kept alongside each decoded byte.
+#define DECODEFLAG_JIT 1	// The byte is covered by a JIT translation
+#define DECODEFLAG_FUSED 2	// The byte is part of a superinstruction, but not its first byte
+#define DECODEFLAG_BREAK 4	// The byte has a breakpoint, so decodes as HANDLER_BREAK and is never fused
+#define DECODEFLAG_NOSKIP 8	// The byte starts a loop which isn't worth checking for busy-waiting
+
+struct EightThirtyTwoDecoded
+{
+	unsigned char handler;
+	unsigned char operand;	// Register number, condition code, or 6-bit immediate for li.
+	unsigned char flags;
+	unsigned char length;	// Superinstructions only: the number of bytes covered
+	unsigned int value;	// Superinstructions only: the constant built by the li chain
+};
+
+
+// Decode a single opcode byte.
+
+inline EightThirtyTwoDecoded EightThirtyTwoDecode(int opcode)
+{
+	static const unsigned char handlers[24]=
+	{
+		HANDLER_COND, HANDLER_EXG, HANDLER_LDBINC, HANDLER_STDEC,
+		HANDLER_LDINC, HANDLER_SHR, HANDLER_SHL, HANDLER_ROR,
+		HANDLER_STINC, HANDLER_MR, HANDLER_STBINC, HANDLER_STMPDEC,
+		HANDLER_LDIDX, HANDLER_LD, HANDLER_MT, HANDLER_ST,
+		HANDLER_ADD, HANDLER_SUB, HANDLER_MUL, HANDLER_AND,
+		HANDLER_ADDT, HANDLER_CMP, HANDLER_OR, HANDLER_XOR
+	};
+	EightThirtyTwoDecoded result;
+	result.flags=0;
+	opcode&=0xff;
+	if((opcode&0xc0)==0xc0)
+	{
+		result.handler=HANDLER_LI;
+		result.operand=opcode&0x3f;
+		return(result);
+	}
+	result.operand=opcode&7;
+	switch(opcode)
+	{
+		case ovl_hlf:
+			result.handler=HANDLER_HLF;
+			break;
+		case ovl_byt:
+			result.handler=HANDLER_BYT;
+			break;
+		case ovl_sgn:
+			result.handler=HANDLER_SGN;
+			break;
+		case ovl_ldt:
+			result.handler=HANDLER_LDT;
+			break;
+		case ovl_sig:
+			result.handler=HANDLER_SIG;
+			break;
+		default:
+			result.handler=handlers[opcode>>3];
+			break;
+	}
+	return(result);
+}
+
+
+// Turns the record for an li into a superinstruction if the code that follows
+// (code[0] being the li itself) is a chain of further lis and / or add r7,
+// addt r7 or ldt.  The constant is built as though the chain starts afresh.
+// Returns the number of bytes covered, which is 1 if nothing was fused.
+
+#define FUSE_MAXLENGTH 8
+
+inline int EightThirtyTwoFuse(EightThirtyTwoDecoded &d,const unsigned char *code)
+{
+	int len=0;
+	unsigned int v=0;
+	while(len<FUSE_MAXLENGTH-1 && (code[len]&0xc0)==0xc0)
+	{
+		int imm=code[len]&0x3f;
+		if(len)
+			v=(v<<6)|imm;
+		else
+			v=imm&0x20 ? imm|0xffffffc0 : imm;
+		++len;
+	}
+
+	int handler=HANDLER_LICHAIN;
+	switch(code[len])
+	{
+		case opc_add|7:
+			handler=HANDLER_LIJUMP;
+			++len;
+			break;
+		case opc_addt|7:
+			handler=HANDLER_LIADDT;
+			++len;
+			break;
+		case ovl_ldt:
+			handler=HANDLER_LILDT;
+			++len;
+			break;
+	}
+	if(len<2)
+		return(1);
+	d.handler=handler;
+	d.length=len;
+	d.value=v;
+	return(len);
+}
+
+
+// The program counter is 30 bits wide.  Instructions which write r7 without
+// setting the flags themselves (mr, exg, add and the stores) take the zero and
+// carry flags from bits 31 and 30 - this is how an interrupt handler's return
+// restores them.
+
+#define PC_MASK 0x3fffffff
+
+
+// The decode cache covers the CPU's 30-bit program counter space in pages,
+// which are allocated the first time code is executed from them.  The page
+// table itself is zero-filled by calloc(), so the host only backs the parts of
+// it which are written.
+// Records start out as HANDLER_DECODE and are filled in on first execution;
+// stores must call Invalidate() so that self-modifying code is re-decoded.
+// A store into the tail of a superinstruction also invalidates its first byte.
+// Invalidating a record leaves its flags alone, so breakpoints survive stores.
+
+#define DECODECACHE_PAGEBITS 12
+#define DECODECACHE_PAGESIZE (1<<DECODECACHE_PAGEBITS)
+#define DECODECACHE_ADDRBITS 30
+#define DECODECACHE_PAGES (1<<(DECODECACHE_ADDRBITS-DECODECACHE_PAGEBITS))
+
+class EightThirtyTwoDecodeCache
+{
+	public:
+	EightThirtyTwoDecodeCache() : pages(0)
+	{
+		pages=(EightThirtyTwoDecoded **)calloc(DECODECACHE_PAGES,sizeof(EightThirtyTwoDecoded *));
+		if(!pages)
+			throw "Can't allocate decode cache";
+	}
+	~EightThirtyTwoDecodeCache()
+	{
+		Clear();
+		free(pages);
+	}
+	void Clear()
+	{
+		for(unsigned int i=0;i<allocated.size();++i)
+		{
+			delete[] pages[allocated[i]];
+			pages[allocated[i]]=0;
+		}
+		allocated.clear();
+	}
+	inline EightThirtyTwoDecoded &operator[](unsigned int addr)
+	{
+		EightThirtyTwoDecoded *page=pages[(addr>>DECODECACHE_PAGEBITS)&(DECODECACHE_PAGES-1)];
+		if(!page)
+			page=AllocPage(addr);
+		return(page[addr&(DECODECACHE_PAGESIZE-1)]);
+	}
+	// Returns the flags of the invalidated records, so the caller can tell whether
+	// any of them belonged to a JIT translation.
+	inline int Invalidate(unsigned int addr,int len)
+	{
+		int flags=0;
+		unsigned int start=addr;
+		while(len--)
+		{
+			EightThirtyTwoDecoded *page=pages[(addr>>DECODECACHE_PAGEBITS)&(DECODECACHE_PAGES-1)];
+			if(page)
+			{
+				EightThirtyTwoDecoded &d=page[addr&(DECODECACHE_PAGESIZE-1)];
+				d.handler=HANDLER_DECODE;
+				flags|=d.flags;
+			}
+			++addr;
+		}
+		if(flags&DECODEFLAG_FUSED)
+			InvalidateFused(start);
+		return(flags);
+	}
+	void ClearFlags(int flags)
+	{
+		for(unsigned int i=0;i<allocated.size();++i)
+		{
+			for(int j=0;j<DECODECACHE_PAGESIZE;++j)
+				pages[allocated[i]][j].flags&=~flags;
+		}
+	}
+	protected:
+	void InvalidateFused(unsigned int addr)
+	{
+		for(int i=1;i<FUSE_MAXLENGTH;++i)
+		{
+			EightThirtyTwoDecoded &d=(*this)[addr-i];
+			if(d.handler>=HANDLER_FUSED && d.handler<HANDLER_FULL && d.length>i)
+				d.handler=HANDLER_DECODE;
+		}
+	}
+	EightThirtyTwoDecoded *AllocPage(unsigned int addr)
+	{
+		EightThirtyTwoDecoded *page=new EightThirtyTwoDecoded[DECODECACHE_PAGESIZE];
+		memset(page,0,sizeof(EightThirtyTwoDecoded)*DECODECACHE_PAGESIZE);
+		unsigned int index=(addr>>DECODECACHE_PAGEBITS)&(DECODECACHE_PAGES-1);
+		pages[index]=page;
+		allocated.push_back(index);
+		return(page);
+	}
+	EightThirtyTwoDecoded **pages;
+	std::vector<unsigned int> allocated;	// Indices of pages in use
+};
+
+#endif
+
@@ -0,0 +1,291 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include "util.h"
+#include "profile.h"
+
+
+EightThirtyTwoProfile::EightThirtyTwoProfile() : pages(0)
+{
+	pages=new EightThirtyTwoProfileCounter *[PROFILE_PAGES];
+	memset(pages,0,sizeof(EightThirtyTwoProfileCounter *)*PROFILE_PAGES);
+}
+
+
+EightThirtyTwoProfile::~EightThirtyTwoProfile()
+{
+	Clear();
+	delete[] pages;
+}
+
+
+void EightThirtyTwoProfile::Clear()
+{
+	for(int i=0;i<PROFILE_PAGES;++i)
+	{
+		if(pages[i])
+			delete[] pages[i];
+		pages[i]=0;
+	}
+}
+
+
+EightThirtyTwoProfileCounter *EightThirtyTwoProfile::AllocPage(unsigned int pc)
+{
+	EightThirtyTwoProfileCounter *page=new EightThirtyTwoProfileCounter[PROFILE_PAGESIZE];
+	memset(page,0,sizeof(EightThirtyTwoProfileCounter)*PROFILE_PAGESIZE);
+	pages[(pc>>PROFILE_PAGEBITS)&(PROFILE_PAGES-1)]=page;
+	return(page);
+}
+
+
+struct EightThirtyTwoProfileEntry
+{
+	int symbol;	// -1 for code outside any function
+	unsigned long long instructions;
+	unsigned long long cycles;
+	unsigned long long calls;
+};
+
+
+static bool profile_compare(const EightThirtyTwoProfileEntry &a,const EightThirtyTwoProfileEntry &b)
+{
+	if(a.cycles!=b.cycles)
+		return(a.cycles>b.cycles);
+	return(a.instructions>b.instructions);
+}
+
+
+void EightThirtyTwoProfile::Report(FILE *out,EightThirtyTwoSymbolMap &symbols,bool showcycles)
+{
+	// Index 0 collects code outside any function; function n is at index n+1.
+	std::vector<EightThirtyTwoProfileEntry> entries(symbols.GetCount()+1);
+	for(unsigned int i=0;i<entries.size();++i)
+	{
+		entries[i].symbol=i-1;
+		entries[i].instructions=entries[i].cycles=entries[i].calls=0;
+	}
+
+	unsigned long long instructions=0;
+	unsigned long long cycles=0;
+	for(int p=0;p<PROFILE_PAGES;++p)
+	{
+		if(!pages[p])
+			continue;
+		for(int i=0;i<PROFILE_PAGESIZE;++i)
+		{
+			const EightThirtyTwoProfileCounter &c=pages[p][i];
+			if(!c.instructions)
+				continue;
+			unsigned int pc=(p<<PROFILE_PAGEBITS)|i;
+			int idx=symbols.FindFunction(pc);
+			EightThirtyTwoProfileEntry &e=entries[idx+1];
+			e.instructions+=c.instructions;
+			e.cycles+=c.cycles;
+			if(idx>=0 && symbols[idx].address==pc)
+				e.calls+=c.entries;
+			instructions+=c.instructions;
+			cycles+=c.cycles;
+		}
+	}
+	// Sort by cycles if they were counted, otherwise by instructions.
+	if(!showcycles)
+	{
+		for(unsigned int i=0;i<entries.size();++i)
+			entries[i].cycles=0;
+	}
+	std::stable_sort(entries.begin(),entries.end(),profile_compare);
+
+	unsigned long long total=showcycles ? cycles : instructions;
+	fprintf(out,"\nFlat profile: %llu instructions",instructions);
+	if(showcycles)
+		fprintf(out,", %llu cycles",cycles);
+	fprintf(out,"\n\n  %%self  instructions%s        calls  function\n",showcycles ? "        cycles    CPI" : "");
+	for(unsigned int i=0;i<entries.size();++i)
+	{
+		const EightThirtyTwoProfileEntry &e=entries[i];
+		if(!e.instructions)
+			continue;
+		unsigned long long self=showcycles ? e.cycles : e.instructions;
+		fprintf(out,"%7.2f  %12llu",total ? 100.0*self/total : 0.0,e.instructions);
+		if(showcycles)
+			fprintf(out,"  %12llu  %5.2f",e.cycles,double(e.cycles)/e.instructions);
+		fprintf(out,"  %11llu  %s\n",e.calls,e.symbol>=0 ? symbols[e.symbol].name.c_str() : "<unknown>");
+	}
+}
+
+
+EightThirtyTwoCallGraph::EightThirtyTwoCallGraph(EightThirtyTwoSymbolMap &symbols) : symbols(symbols)
+{
+}
+
+
+EightThirtyTwoCallGraph::~EightThirtyTwoCallGraph()
+{
+}
+
+
+int EightThirtyTwoCallGraph::Child(int parent,int symbol)
+{
+	std::map<int,int> *children=parent<0 ? &roots : &nodes[parent].children;
+	std::map<int,int>::iterator it=children->find(symbol);
+	if(it!=children->end())
+		return(it->second);
+	Node n;
+	n.symbol=symbol;
+	n.parent=parent;
+	n.self=0;
+	n.calls=0;
+	nodes.push_back(n);
+	// Adding the node may have moved its parent.
+	children=parent<0 ? &roots : &nodes[parent].children;
+	(*children)[symbol]=nodes.size()-1;
+	return(nodes.size()-1);
+}
+
+
+bool EightThirtyTwoCallGraph::IsAncestor(int node,int symbol)
+{
+	for(;node>=0;node=nodes[node].parent)
+	{
+		if(nodes[node].symbol==symbol)
+			return(true);
+	}
+	return(false);
+}
+
+
+void EightThirtyTwoCallGraph::Count(int t,unsigned int pc,bool entered,unsigned int ret,unsigned int cycles)
+{
+	std::vector<Frame> &s=stack[t];
+	if(s.empty())
+	{
+		// The outermost frame never returns.
+		Frame f;
+		f.node=Child(-1,symbols.FindFunction(pc));
+		f.ret=0xffffffff;
+		++nodes[f.node].calls;
+		s.push_back(f);
+	}
+	else if(entered)
+	{
+		int i=s.size()-1;
+		while(i>0 && s[i].ret!=pc)
+			--i;
+		if(i>0)
+			s.resize(i);
+		else
+		{
+			int idx=symbols.FindFunction(pc);
+			if(idx>=0 && symbols[idx].address==pc && s.size()<CALLGRAPH_MAXDEPTH)
+			{
+				Frame f;
+				f.node=Child(s.back().node,idx);
+				f.ret=ret;
+				++nodes[f.node].calls;
+				s.push_back(f);
+			}
+		}
+	}
+	nodes[s.back().node].self+=cycles;
+}
+
+
+struct EightThirtyTwoCallGraphEntry
+{
+	EightThirtyTwoCallGraphEntry() : inclusive(0), exclusive(0), calls(0)
+	{
+	}
+	unsigned long long inclusive;
+	unsigned long long exclusive;
+	unsigned long long calls;
+};
+
+
+static bool callgraph_compare(const std::pair<int,EightThirtyTwoCallGraphEntry> &a,const std::pair<int,EightThirtyTwoCallGraphEntry> &b)
+{
+	return(a.second.inclusive>b.second.inclusive);
+}
+
+
+void EightThirtyTwoCallGraph::Report(FILE *out,const char *units)
+{
+	// Children are always created after their parents, so a reverse pass totals each subtree.
+	std::vector<unsigned long long> inclusive(nodes.size());
+	unsigned long long total=0;
+	for(unsigned int i=0;i<nodes.size();++i)
+	{
+		inclusive[i]=nodes[i].self;
+		total+=nodes[i].self;
+	}
+	for(int i=nodes.size()-1;i>=0;--i)
+	{
+		if(nodes[i].parent>=0)
+			inclusive[nodes[i].parent]+=inclusive[i];
+	}
+
+	// Recursive calls are only counted once towards inclusive costs.
+	std::map<int,EightThirtyTwoCallGraphEntry> functions;
+	std::map<std::pair<int,int>,EightThirtyTwoCallGraphEntry> edges;
+	for(unsigned int i=0;i<nodes.size();++i)
+	{
+		const Node &n=nodes[i];
+		bool recursive=IsAncestor(n.parent,n.symbol);
+		EightThirtyTwoCallGraphEntry &f=functions[n.symbol];
+		f.exclusive+=n.self;
+		f.calls+=n.calls;
+		if(!recursive)
+			f.inclusive+=inclusive[i];
+		if(n.parent>=0)
+		{
+			EightThirtyTwoCallGraphEntry &e=edges[std::make_pair(nodes[n.parent].symbol,n.symbol)];
+			e.calls+=n.calls;
+			if(!recursive)
+				e.inclusive+=inclusive[i];
+		}
+	}
+
+	std::vector<std::pair<int,EightThirtyTwoCallGraphEntry> > sorted(functions.begin(),functions.end());
+	std::stable_sort(sorted.begin(),sorted.end(),callgraph_compare);
+
+	fprintf(out,"\nCall graph: %llu %s\n\n  %%incl     inclusive     exclusive        calls  function\n",total,units);
+	for(unsigned int i=0;i<sorted.size();++i)
+	{
+		int symbol=sorted[i].first;
+		const EightThirtyTwoCallGraphEntry &f=sorted[i].second;
+		fprintf(out,"%7.2f  %12llu  %12llu  %11llu  %s\n",total ? 100.0*f.inclusive/total : 0.0,
+			f.inclusive,f.exclusive,f.calls,symbol>=0 ? symbols[symbol].name.c_str() : "<unknown>");
+		std::map<std::pair<int,int>,EightThirtyTwoCallGraphEntry>::iterator it=edges.lower_bound(std::make_pair(symbol,-1));
+		for(;it!=edges.end() && it->first.first==symbol;++it)
+		{
+			int callee=it->first.second;
+			fprintf(out,"         %12llu                %11llu      -> %s\n",it->second.inclusive,it->second.calls,
+				callee>=0 ? symbols[callee].name.c_str() : "<unknown>");
+		}
+	}
+}
+
+
+std::string EightThirtyTwoCallGraph::Path(int node)
+{
+	std::string name=nodes[node].symbol>=0 ? symbols[nodes[node].symbol].name : "<unknown>";
+	if(nodes[node].parent<0)
+		return(name);
+	return(Path(nodes[node].parent)+";"+name);
+}
+
+
+void EightThirtyTwoCallGraph::WriteCollapsed(const char *filename)
+{
+	FILE *f;
+	if(!(f=FOpenUTF8(filename,"w")))
+		throw "Can't open call graph file";
+	for(unsigned int i=0;i<nodes.size();++i)
+	{
+		if(nodes[i].self)
+			fprintf(f,"%s %llu\n",Path(i).c_str(),nodes[i].self);
+	}
+	fclose(f);
+}
@@ -0,0 +1,106 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <map>
+
+#include "mapfile.h"
+
+// Execution profile.  The emulator counts the instructions executed at each
+// address, the cycles they took when the pipeline is modelled, and the number
+// of times control was transferred to each address.  At exit the counts are
+// attributed to functions using a map file written by 832l.
+// Counters are kept in pages covering the 30-bit program counter space, which
+// are allocated the first time code is executed from them.
+
+#define PROFILE_PAGEBITS 12
+#define PROFILE_PAGESIZE (1<<PROFILE_PAGEBITS)
+#define PROFILE_ADDRBITS 30
+#define PROFILE_PAGES (1<<(PROFILE_ADDRBITS-PROFILE_PAGEBITS))
+
+struct EightThirtyTwoProfileCounter
+{
+	unsigned long long instructions;
+	unsigned long long cycles;
+	unsigned long long entries;	// Times the instruction was reached other than from the one before it
+};
+
+
+class EightThirtyTwoProfile
+{
+	public:
+	EightThirtyTwoProfile();
+	~EightThirtyTwoProfile();
+	void Clear();
+	inline void Count(unsigned int pc,bool entered,unsigned int cycles)
+	{
+		EightThirtyTwoProfileCounter *page=pages[(pc>>PROFILE_PAGEBITS)&(PROFILE_PAGES-1)];
+		if(!page)
+			page=AllocPage(pc);
+		EightThirtyTwoProfileCounter &c=page[pc&(PROFILE_PAGESIZE-1)];
+		++c.instructions;
+		c.cycles+=cycles;
+		if(entered)
+			++c.entries;
+	}
+	// Prints a flat profile, one line per function, most expensive first.
+	// Calls are counted as entries to the function's first instruction.
+	void Report(FILE *out,EightThirtyTwoSymbolMap &symbols,bool showcycles);
+	protected:
+	EightThirtyTwoProfileCounter *AllocPage(unsigned int pc);
+	EightThirtyTwoProfileCounter **pages;
+};
+
+
+// Call graph profile.  The CPU has no call instruction - calls, returns and
+// branches are all writes to r7 - so a shadow call stack is kept for each
+// thread: a transfer of control to the first instruction of a function in the
+// map file is taken as a call, returning to the address after the instruction
+// which made it, and a transfer to the return address of any frame on the
+// stack returns from it, along with any frames above it (tail calls).
+// Interrupts look like calls to location zero which return to the interrupted
+// instruction.  Costs are accumulated in a tree of the call paths seen.
+
+#define CALLGRAPH_MAXDEPTH 1024
+
+class EightThirtyTwoCallGraph
+{
+	public:
+	EightThirtyTwoCallGraph(EightThirtyTwoSymbolMap &symbols);
+	~EightThirtyTwoCallGraph();
+	// Charges cycles to thread t's current function.  If pc wasn't reached from
+	// the instruction before it, ret is the address following the instruction
+	// which transferred control.
+	void Count(int t,unsigned int pc,bool entered,unsigned int ret,unsigned int cycles);
+	// Prints inclusive and exclusive costs for each function, and its callees.
+	void Report(FILE *out,const char *units);
+	// Writes one line per call path, "outer;inner;innermost cost", as consumed by
+	// flamegraph.pl and compatible tools.
+	void WriteCollapsed(const char *filename);
+	protected:
+	struct Node
+	{
+		int symbol;	// -1 for code outside any function
+		int parent;	// -1 for the outermost functions
+		unsigned long long self;
+		unsigned long long calls;
+		std::map<int,int> children;	// Node index by symbol
+	};
+	struct Frame
+	{
+		int node;
+		unsigned int ret;
+	};
+	int Child(int parent,int symbol);
+	bool IsAncestor(int node,int symbol);
+	std::string Path(int node);
+	EightThirtyTwoSymbolMap &symbols;
+	std::vector<Node> nodes;
+	std::vector<Frame> stack[2];
+	std::map<int,int> roots;	// Outermost nodes by symbol
+};
+
+#endif
+
@@ -0,0 +1,196 @@
+#include <cstdio>
+#include <cstring>
+
+#include "util.h"
+#include "trace.h"
+#include "stats.h"
+#include "832opcodes.h"
+
+
+static const char *classnames[STATS_CLASSES]=
+{
+	"cond","exg","ldbinc","stdec","ldinc","shr","shl","ror",
+	"stinc","mr","stbinc","stmpdec","ldidx","ld","mt","st",
+	"add","sub","mul","and","addt","cmp","or","xor",
+	"li","hlf","byt","sgn","ldt","sig"
+};
+
+static const char *sizenames[]={"word","halfword","byte","?"};
+
+
+static int stats_class(int opcode)
+{
+	if((opcode&0xc0)==0xc0)
+		return(24);
+	switch(opcode)
+	{
+		case ovl_hlf:
+			return(25);
+		case ovl_byt:
+			return(26);
+		case ovl_sgn:
+			return(27);
+		case ovl_ldt:
+			return(28);
+		case ovl_sig:
+			return(29);
+	}
+	return(opcode>>3);
+}
+
+
+EightThirtyTwoStats::EightThirtyTwoStats()
+{
+	for(int i=0;i<256;++i)
+		classes[i]=stats_class(i);
+	bigrams=new unsigned long long[STATS_CLASSES*STATS_CLASSES];
+	trigrams=new unsigned long long[STATS_CLASSES*STATS_CLASSES*STATS_CLASSES];
+	Clear();
+}
+
+
+EightThirtyTwoStats::~EightThirtyTwoStats()
+{
+	delete[] bigrams;
+	delete[] trigrams;
+}
+
+
+void EightThirtyTwoStats::Clear()
+{
+	memset(executed,0,sizeof(executed));
+	memset(skipped,0,sizeof(skipped));
+	memset(chains,0,sizeof(chains));
+	memset(accesses,0,sizeof(accesses));
+	memset(bigrams,0,sizeof(unsigned long long)*STATS_CLASSES*STATS_CLASSES);
+	memset(trigrams,0,sizeof(unsigned long long)*STATS_CLASSES*STATS_CLASSES*STATS_CLASSES);
+	for(int t=0;t<2;++t)
+	{
+		chain[t]=0;
+		history[t][0]=history[t][1]=-1;
+	}
+}
+
+
+void EightThirtyTwoStats::EndChain(int t)
+{
+	if(chain[t])
+		++chains[chain[t]<STATS_MAXCHAIN ? chain[t] : STATS_MAXCHAIN];
+	chain[t]=0;
+}
+
+
+// Pairs and triples follow the instructions actually executed, so skipped ones are left out.
+
+void EightThirtyTwoStats::Count(int t,int opcode,bool skip,int memflags)
+{
+	opcode&=0xff;
+	if(skip)
+	{
+		++skipped[opcode];
+		return;
+	}
+	++executed[opcode];
+
+	int c=classes[opcode];
+	if(c==24)
+		++chain[t];
+	else
+		EndChain(t);
+
+	if(memflags)
+		++accesses[(memflags&TRACEMEM_WRITE) ? 1 : 0][memflags&TRACEMEM_SIZEMASK];
+
+	int *h=history[t];
+	if(h[1]>=0)
+	{
+		++bigrams[h[1]*STATS_CLASSES+c];
+		if(h[0]>=0)
+			++trigrams[(h[0]*STATS_CLASSES+h[1])*STATS_CLASSES+c];
+	}
+	h[0]=h[1];
+	h[1]=c;
+}
+
+
+void EightThirtyTwoStats::Write(const char *filename)
+{
+	FILE *f;
+	if(!(f=FOpenUTF8(filename,"w")))
+		throw "Can't open statistics file";
+
+	EndChain(0);
+	EndChain(1);
+
+	unsigned long long total=0;
+	unsigned long long totalskipped=0;
+	for(int i=0;i<256;++i)
+	{
+		total+=executed[i];
+		totalskipped+=skipped[i];
+	}
+	fprintf(f,"total\texecuted\t%llu\n",total);
+	fprintf(f,"total\tskipped\t%llu\n",totalskipped);
+
+	// Opcodes are listed individually, except for li whose immediates are merged.
+	unsigned long long li=0;
+	unsigned long long liskipped=0;
+	for(int i=0;i<256;++i)
+	{
+		if(classes[i]==24)
+		{
+			li+=executed[i];
+			liskipped+=skipped[i];
+		}
+		else
+		{
+			if(executed[i])
+				fprintf(f,"opcode\t%s\t%llu\n",EightThirtyTwoMnemonic(i),executed[i]);
+			if(skipped[i])
+				fprintf(f,"skipped\t%s\t%llu\n",EightThirtyTwoMnemonic(i),skipped[i]);
+		}
+	}
+	if(li)
+		fprintf(f,"opcode\tli\t%llu\n",li);
+	if(liskipped)
+		fprintf(f,"skipped\tli\t%llu\n",liskipped);
+
+	for(int i=1;i<=STATS_MAXCHAIN;++i)
+	{
+		if(chains[i])
+			fprintf(f,"lichain\t%d%s\t%llu\n",i,i==STATS_MAXCHAIN ? "+" : "",chains[i]);
+	}
+
+	for(int rw=0;rw<2;++rw)
+	{
+		for(int size=0;size<3;++size)
+		{
+			if(accesses[rw][size])
+				fprintf(f,"%s\t%s\t%llu\n",rw ? "store" : "load",sizenames[size],accesses[rw][size]);
+		}
+	}
+
+	for(int i=0;i<STATS_CLASSES;++i)
+	{
+		for(int j=0;j<STATS_CLASSES;++j)
+		{
+			unsigned long long n=bigrams[i*STATS_CLASSES+j];
+			if(n)
+				fprintf(f,"bigram\t%s,%s\t%llu\n",classnames[i],classnames[j],n);
+		}
+	}
+	for(int i=0;i<STATS_CLASSES;++i)
+	{
+		for(int j=0;j<STATS_CLASSES;++j)
+		{
+			for(int k=0;k<STATS_CLASSES;++k)
+			{
+				unsigned long long n=trigrams[(i*STATS_CLASSES+j)*STATS_CLASSES+k];
+				if(n)
+					fprintf(f,"trigram\t%s,%s,%s\t%llu\n",classnames[i],classnames[j],classnames[k],n);
+			}
+		}
+	}
+	fclose(f);
+}
+
@@ -0,0 +1,39 @@
+#ifndef STATS_H
+#define STATS_H
+
+// Instruction mix statistics: how often each opcode was executed or skipped
+// by cond, the lengths of li chains, the sizes of loads and stores, and the
+// frequencies of pairs and triples of consecutive opcodes.  Opcodes are
+// grouped into classes for the pairs and triples - the register operand,
+// condition code and immediate value are dropped.
+// The results are written as tab-separated "kind key count" lines, sorted so
+// that the files from two runs can be compared with diff.
+
+#define STATS_CLASSES 30
+#define STATS_MAXCHAIN 16	// Longer li chains are counted with this length
+
+class EightThirtyTwoStats
+{
+	public:
+	EightThirtyTwoStats();
+	~EightThirtyTwoStats();
+	void Clear();
+	// Counts an instruction issued by thread t.  memflags describes its memory
+	// access, if any, as in EightThirtyTwoTraceRecord.
+	void Count(int t,int opcode,bool skipped,int memflags);
+	void Write(const char *filename);
+	protected:
+	void EndChain(int t);
+	unsigned char classes[256];
+	unsigned long long executed[256];
+	unsigned long long skipped[256];
+	unsigned long long chains[STATS_MAXCHAIN+1];
+	unsigned long long accesses[2][4];	// Read / write by size
+	unsigned long long *bigrams;
+	unsigned long long *trigrams;
+	int chain[2];	// Length of each thread's current li chain
+	int history[2][2];	// Classes of each thread's previous two instructions, or -1
+};
+
+#endif
+
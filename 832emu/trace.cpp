@@ -0,0 +1,120 @@
+#include <cstdio>
+#include <cstring>
+
+#include "debug.h"
+#include "util.h"
+#include "trace.h"
+#include "832opcodes.h"
+
+
+EightThirtyTwoTrace::EightThirtyTwoTrace(int buffersize) : buffer(0), buffersize(buffersize), count(0)
+{
+	buffer=new EightThirtyTwoTraceRecord[buffersize];
+}
+
+
+EightThirtyTwoTrace::~EightThirtyTwoTrace()
+{
+	if(buffer)
+		delete[] buffer;
+}
+
+
+void EightThirtyTwoTrace::Flush()
+{
+	if(count)
+		Write(buffer,count);
+	count=0;
+}
+
+
+void EightThirtyTwoTrace::End(unsigned int ticks)
+{
+	Flush();
+}
+
+
+EightThirtyTwoTextTrace::EightThirtyTwoTextTrace(const char *filename,int buffersize)
+	: EightThirtyTwoTrace(buffersize), out(0), owned(true)
+{
+	if(!(out=FOpenUTF8(filename,"w")))
+		throw "Can't open trace file";
+}
+
+
+EightThirtyTwoTextTrace::EightThirtyTwoTextTrace(FILE *out,int buffersize)
+	: EightThirtyTwoTrace(buffersize), out(out), owned(false)
+{
+}
+
+
+EightThirtyTwoTextTrace::~EightThirtyTwoTextTrace()
+{
+	Flush();
+	if(owned && out)
+		fclose(out);
+}
+
+
+void EightThirtyTwoTextTrace::End(unsigned int ticks)
+{
+	Flush();
+	fprintf(out,"Emulation ended after %u steps\n\n",ticks);
+	fflush(out);
+}
+
+
+void EightThirtyTwoTextTrace::Write(const EightThirtyTwoTraceRecord *records,int count)
+{
+	for(int i=0;i<count;++i)
+	{
+		const EightThirtyTwoTraceRecord &r=records[i];
+		bool skipped=r.flags&TRACEFLAG_SKIPPED;
+		fprintf(out,"%u, r7: %x op: %x\tOp: %x, %s%s%s\n\t\t",
+			r.tick,r.pc,r.opcode&0xf8,r.opcode,skipped ? "(" : "",EightThirtyTwoMnemonic(r.opcode),skipped ? ")" : "");
+		fprintf(out,"Temp: %x, ",r.temp);
+		for(int j=0;j<7;++j)
+			fprintf(out,"r%d: %x, ",j,r.regs[j]);
+		fprintf(out,"Z: %d, C: %d, Cond: %d%s\n",(r.flags&TRACEFLAG_ZERO)!=0,(r.flags&TRACEFLAG_CARRY)!=0,(r.flags&TRACEFLAG_COND)!=0,
+			(r.flags&TRACEFLAG_THREAD2) ? ", Thread: 2" : "");
+	}
+}
+
+
+const char *EightThirtyTwoMnemonic(int opcode)
+{
+	static const char *mnem[24]=
+	{
+		"cond","exg","ldbinc","stdec","ldinc","shr","shl","ror",
+		"stinc","mr","stbinc","stmpdec","ldidx","ld","mt","st",
+		"add","sub","mul","and","addt","cmp","or","xor"
+	};
+	static const char *conds[8]={"NEX","SGT","EQ","GE","SLT","NEQ","LE","EX"};
+	static thread_local char buf[16];
+	opcode&=0xff;
+	if((opcode&0xc0)==0xc0)
+	{
+		int imm=opcode&0x3f;
+		snprintf(buf,sizeof(buf),"li %d",imm&0x20 ? imm-0x40 : imm);
+		return(buf);
+	}
+	switch(opcode)
+	{
+		case ovl_hlf:
+			return("hlf");
+		case ovl_byt:
+			return("byt");
+		case ovl_sgn:
+			return("sgn");
+		case ovl_ldt:
+			return("ldt");
+		case ovl_sig:
+			return("sig");
+	}
+	if((opcode&0xf8)==opc_cond)
+		snprintf(buf,sizeof(buf),"cond %s",conds[opcode&7]);
+	else
+		snprintf(buf,sizeof(buf),"%s r%d",mnem[opcode>>3],opcode&7);
+	return(buf);
+}
+
@@ -0,0 +1,80 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdio>
+
+// Execution trace.  The emulator appends one fixed-size record per instruction
+// to a preallocated buffer; nothing is formatted until the buffer fills up or
+// the trace is flushed.  When tracing is disabled the emulator runs a loop
+// which doesn't touch the trace at all.
+
+#define TRACEFLAG_ZERO 1
+#define TRACEFLAG_CARRY 2
+#define TRACEFLAG_COND 4
+#define TRACEFLAG_SKIPPED 8	// Instruction was skipped by a previous cond
+#define TRACEFLAG_THREAD2 16	// Instruction was issued by the second thread (dual-thread mode only)
+
+// Memory access flags - the low two bits hold the access size (WORD, HALFWORD or BYTE).
+#define TRACEMEM_SIZEMASK 3
+#define TRACEMEM_READ 4
+#define TRACEMEM_WRITE 8
+
+struct EightThirtyTwoTraceRecord
+{
+	unsigned int tick;
+	unsigned int pc;
+	unsigned int temp;
+	unsigned int regs[7];
+	unsigned int memaddr;
+	unsigned int memvalue;
+	unsigned char opcode;
+	unsigned char flags;
+	unsigned char memflags;
+};
+
+
+class EightThirtyTwoTrace
+{
+	public:
+	EightThirtyTwoTrace(int buffersize=65536);
+	virtual ~EightThirtyTwoTrace();
+	inline EightThirtyTwoTraceRecord &Append()
+	{
+		if(count==buffersize)
+			Flush();
+		return(buffer[count++]);
+	}
+	virtual void Flush();
+	virtual void End(unsigned int ticks);
+	protected:
+	virtual void Write(const EightThirtyTwoTraceRecord *records,int count)=0;
+	EightThirtyTwoTraceRecord *buffer;
+	int buffersize;
+	int count;
+};
+
+
+// Formats records as human-readable text, in the same layout as the
+// emulator's old "-r 4" output.
+
+class EightThirtyTwoTextTrace : public EightThirtyTwoTrace
+{
+	public:
+	EightThirtyTwoTextTrace(const char *filename,int buffersize=65536);
+	EightThirtyTwoTextTrace(FILE *out,int buffersize=65536);
+	virtual ~EightThirtyTwoTextTrace();
+	virtual void End(unsigned int ticks);
+	protected:
+	virtual void Write(const EightThirtyTwoTraceRecord *records,int count);
+	FILE *out;
+	bool owned;
+};
+
+
+// Returns the mnemonic for an opcode, including its operand.
+// The result is in a static buffer, overwritten by the thread's next call.
+
+const char *EightThirtyTwoMnemonic(int opcode);
+
+#endif
+
@@ -3,7 +3,8 @@ void abort()
 	while(1);
 }
 
-void exit(int rc)
+/* Weak, so that semihost.c can replace it. */
+__weak void exit(int rc)
 {
 	while(1);
 }
@@ -0,0 +1,75 @@
+#include "semihost.h"
+
+static int semihost_call(int call,int a,int b,int c)
+{
+	HW_SEMIHOST(REG_SEMIHOST_ARG0)=a;
+	HW_SEMIHOST(REG_SEMIHOST_ARG1)=b;
+	HW_SEMIHOST(REG_SEMIHOST_ARG2)=c;
+	HW_SEMIHOST(REG_SEMIHOST_CALL)=call;
+	return(HW_SEMIHOST(REG_SEMIHOST_CALL));
+}
+
+
+int semihost_write(int fd,const void *buf,int len)
+{
+	return(semihost_call(SEMIHOST_WRITE,fd,(int)buf,len));
+}
+
+
+int semihost_read(int fd,void *buf,int len)
+{
+	return(semihost_call(SEMIHOST_READ,fd,(int)buf,len));
+}
+
+
+int semihost_open(const char *name,int flags)
+{
+	return(semihost_call(SEMIHOST_OPEN,(int)name,flags,0));
+}
+
+
+int semihost_close(int fd)
+{
+	return(semihost_call(SEMIHOST_CLOSE,fd,0,0));
+}
+
+
+unsigned int semihost_clock()
+{
+	return(semihost_call(SEMIHOST_CLOCK,0,0,0));
+}
+
+
+unsigned int semihost_time()
+{
+	return(semihost_call(SEMIHOST_TIME,0,0,0));
+}
+
+
+/* Replace uart.c's console functions, and abort.c's exit(). */
+
+int putchar(int c)
+{
+	char ch=c;
+	semihost_write(1,&ch,1);
+	return(c);
+}
+
+
+int puts(const char *msg)
+{
+	int result=0;
+
+	while(msg[result])
+		++result;
+	semihost_write(1,msg,result);
+	return(result);
+}
+
+
+void exit(int rc)
+{
+	semihost_call(SEMIHOST_EXIT,rc,0,0);
+	while(1);
+}
+
@@ -0,0 +1,54 @@
+#ifndef SEMIHOST_H
+#define SEMIHOST_H
+
+/* Semihosting calls to the host, for programs running under 832e.
+   Link against libsemi832.a rather than lib832.a to send the console
+   through them instead of the UART. */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SEMIHOSTBASE 0xFFFFFFA0
+#define HW_SEMIHOST(x) *(volatile unsigned int *)(SEMIHOSTBASE+x)
+
+#define REG_SEMIHOST_ARG0 0x0
+#define REG_SEMIHOST_ARG1 0x4
+#define REG_SEMIHOST_ARG2 0x8
+#define REG_SEMIHOST_CALL 0xc
+
+#define SEMIHOST_EXIT 1
+#define SEMIHOST_WRITE 2
+#define SEMIHOST_READ 3
+#define SEMIHOST_OPEN 4
+#define SEMIHOST_CLOSE 5
+#define SEMIHOST_CLOCK 6
+#define SEMIHOST_TIME 7
+
+/* Flags for semihost_open() */
+#define SEMIHOST_RDONLY 1
+#define SEMIHOST_WRONLY 2
+#define SEMIHOST_RDWR 3
+#define SEMIHOST_CREATE 4
+#define SEMIHOST_APPEND 8
+
+/* File descriptors 0, 1 and 2 are the console.  Each returns -1 on failure. */
+int semihost_write(int fd,const void *buf,int len);
+int semihost_read(int fd,void *buf,int len);
+int semihost_open(const char *name,int flags);
+int semihost_close(int fd);
+/* Emulated milliseconds since reset */
+unsigned int semihost_clock();
+/* The host's time, in seconds since 1970 */
+unsigned int semihost_time();
+
+int putchar(int c);
+int puts(const char *msg);
+void exit(int rc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+